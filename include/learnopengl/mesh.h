@@ -7,7 +7,12 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <learnopengl/shader.h>
+#include <rg/GeometryArena.h>
+#include <rg/VertexLayout.h>
+#include <rg/TextureFormat.h>
 
+#include <cmath>
+#include <cstddef>
 #include <string>
 #include <vector>
 using namespace std;
@@ -27,10 +32,68 @@ struct Vertex {
 
 
 
+// the attributes of Vertex, by shader location
+typedef rg::MemberAttribute<0, Vertex, glm::vec3, &Vertex::Position> MeshPosition;
+typedef rg::MemberAttribute<1, Vertex, glm::vec3, &Vertex::Normal> MeshNormal;
+typedef rg::MemberAttribute<2, Vertex, glm::vec2, &Vertex::TexCoords> MeshTexCoords;
+typedef rg::MemberAttribute<3, Vertex, glm::vec3, &Vertex::Tangent> MeshTangent;
+typedef rg::MemberAttribute<4, Vertex, glm::vec3, &Vertex::Bitangent> MeshBitangent;
+
+// the layouts a mesh can be stored with, smallest first; a mesh takes the first one that has every
+// attribute its data provides and its program reads
+typedef rg::VertexLayout<MeshPosition> PositionLayout;
+typedef rg::VertexLayout<MeshPosition, MeshNormal> UntexturedMeshLayout;
+typedef rg::VertexLayout<MeshPosition, MeshNormal, MeshTexCoords> TexturedMeshLayout;
+typedef rg::VertexLayout<MeshPosition, MeshNormal, MeshTexCoords, MeshTangent, MeshBitangent> FullMeshLayout;
+
+static_assert(FullMeshLayout::Stride == sizeof(Vertex), "FullMeshLayout has to match Vertex");
+static_assert(FullMeshLayout::OffsetOf(4) == offsetof(Vertex, Bitangent), "FullMeshLayout has to match Vertex");
+
+const unsigned int AllMeshAttributes = FullMeshLayout::AttributeMask;
+
+// tightly packed positions, used by the depth pre-pass and position-only geometry like the skybox
+inline const rg::VertexFormat &positionVertexFormat()
+{
+    return PositionLayout::Format();
+}
+
+// the kind of map a material texture is, decides which sampler of the material it is bound to
+enum class MaterialSlot : unsigned char {
+    Diffuse,
+    Specular,
+    Normal,
+    Height,
+    Count
+};
+
+// sampler name without the index, the shaders declare <prefix><name><N> for the N-th map of a slot
+inline const char *materialSlotName(MaterialSlot slot)
+{
+    switch (slot)
+    {
+        case MaterialSlot::Diffuse: return "texture_diffuse";
+        case MaterialSlot::Specular: return "texture_specular";
+        case MaterialSlot::Normal: return "texture_normal";
+        case MaterialSlot::Height: return "texture_height";
+        default: return "";
+    }
+}
+
+// what the shaders read from each slot, decides the stored format of the texture
+inline rg::TextureUsage materialSlotUsage(MaterialSlot slot)
+{
+    switch (slot)
+    {
+        case MaterialSlot::Specular: return rg::TextureUsage::Mask;
+        case MaterialSlot::Normal: return rg::TextureUsage::Normal;
+        case MaterialSlot::Height: return rg::TextureUsage::Mask;
+        default: return rg::TextureUsage::Color;
+    }
+}
+
 struct Texture {
     unsigned int id;
-    string type;
-    string path;
+    MaterialSlot slot;
 };
 
 class Mesh {
@@ -40,14 +103,29 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
 
+    // VAOs are shared by every mesh of the same vertex format in the geometry arena
     unsigned int VAO;
+    // position-only stream used by the depth pre-pass
+    unsigned int depthVAO;
+    rg::GeometryAllocation geometry;
+    rg::GeometryAllocation depthGeometry;
+    // local space bounds, used to estimate screen coverage
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    // texture coordinate units per local space unit, averaged over the surface; picks the mip level to stream
+    float uvDensity;
     std::string glslIdentifierPrefix;
+    // vertex attributes stored in the arena, bit n for location n, and the bytes of one stored vertex
+    unsigned int attributeMask;
+    GLsizei vertexStride;
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures,
+         unsigned int attributeMask = AllMeshAttributes)
     {
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        this->attributeMask = attributeMask;
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
@@ -56,84 +134,147 @@ public:
     // render the mesh
     void Draw(Shader &shader)
     {
-        // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
+        BindTextures(shader);
+
+        // draw mesh
+        rg::geometryArena().Draw(geometry);
+    }
+
+    // binds the material textures and points the samplers at them, shared by all meshes of a material group
+    void BindTextures(Shader &shader)
+    {
+        const vector<GLint>& locations = samplerLocations(shader.ID);
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-            else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
-
-            // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (glslIdentifierPrefix + name + number).c_str()), i);
-            // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            // texture i always goes to unit i, the sampler is set every time because the
+            // caller may have pointed it elsewhere with setInt
+            if(locations[i] >= 0)
+                glUniform1i(locations[i], i);
+            rg::glState().BindTexture(i, GL_TEXTURE_2D, textures[i].id);
         }
+    }
 
+    // sampler names depend on the prefix, so the resolved locations are dropped with it
+    void SetShaderTextureNamePrefix(const std::string& prefix)
+    {
+        glslIdentifierPrefix = prefix;
+        materialBindings.clear();
+    }
 
+    // true when both meshes bind exactly the same textures, so they can be drawn in one batch
+    bool SharesMaterialWith(const Mesh &other) const
+    {
+        if (textures.size() != other.textures.size())
+            return false;
+        for (unsigned int i = 0; i < textures.size(); i++)
+        {
+            if (textures[i].id != other.textures[i].id || textures[i].slot != other.textures[i].slot)
+                return false;
+        }
+        return true;
+    }
 
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // render only the positions, for filling the depth buffer ahead of the shading pass
+    void DrawDepth()
+    {
+        rg::geometryArena().Draw(depthGeometry);
     }
 
 private:
-    // render data
-    unsigned int VBO, EBO;
+    // sampler locations of the textures for one program, in texture order, -1 for unused samplers
+    struct MaterialBinding {
+        GLuint program;
+        vector<GLint> locations;
+    };
+    // a mesh is drawn with one or two programs, so a linear search beats any map
+    vector<MaterialBinding> materialBindings;
 
-    // initializes all the buffer objects/arrays
+    // resolves the sampler names once per program, the draw path never touches a string
+    const vector<GLint>& samplerLocations(GLuint program)
+    {
+        for(const MaterialBinding& binding : materialBindings)
+        {
+            if(binding.program == program)
+                return binding.locations;
+        }
+
+        MaterialBinding binding;
+        binding.program = program;
+        unsigned int slotCount[(int)MaterialSlot::Count] = {};
+        for(const Texture& texture : textures)
+        {
+            // the N in texture_diffuseN counts the maps of the same slot
+            unsigned int number = ++slotCount[(int)texture.slot];
+            string name = glslIdentifierPrefix + materialSlotName(texture.slot) + std::to_string(number);
+            binding.locations.push_back(glGetUniformLocation(program, name.c_str()));
+        }
+        materialBindings.push_back(binding);
+        return materialBindings.back().locations;
+    }
+
+    // suballocates the vertex and index data from the geometry arena
     void setupMesh()
     {
-        // create buffers/arrays
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        // load data into vertex buffers
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        // A great thing about structs is that their memory layout is sequential for all its items.
-        // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-        // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-
-        // set the vertex attribute pointers
-        // vertex Positions
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // vertex normals
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // vertex texture coords
-        glEnableVertexAttribArray(2);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-        // vertex tangent
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-        // vertex bitangent
-        glEnableVertexAttribArray(4);
-        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
-
-        glBindVertexArray(0);
+        // attributes the program never reads or the data does not have are left out, so they cost
+        // neither memory nor fetch bandwidth; a disabled attribute reads as 0 in the shader
+        allocateWith<PositionLayout>() || allocateWith<UntexturedMeshLayout>() ||
+        allocateWith<TexturedMeshLayout>() || allocateWith<FullMeshLayout>();
+        VAO = rg::geometryArena().GetVAO(geometry.pool);
+
+        setupDepthStream();
+        computeUvDensity();
+    }
+
+    // stores the vertices with Layout when it has every attribute in attributeMask
+    template<typename Layout>
+    bool allocateWith()
+    {
+        if ((attributeMask & ~Layout::AttributeMask) != 0)
+            return false;
+        geometry = rg::geometryArena().Allocate(Layout::Format(), Layout::Pack(vertices).data(), vertices.size(),
+                                                indices.data(), indices.size());
+        attributeMask = Layout::AttributeMask;
+        vertexStride = Layout::Stride;
+        return true;
+    }
+
+    // square root of the texture area over the surface area, 0 when the mesh has no texture coordinates
+    void computeUvDensity()
+    {
+        float surfaceArea = 0.0f, uvArea = 0.0f;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            const Vertex& a = vertices[indices[i]];
+            const Vertex& b = vertices[indices[i + 1]];
+            const Vertex& c = vertices[indices[i + 2]];
+            surfaceArea += glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position)) * 0.5f;
+            glm::vec2 u = b.TexCoords - a.TexCoords, v = c.TexCoords - a.TexCoords;
+            uvArea += std::abs(u.x * v.y - u.y * v.x) * 0.5f;
+        }
+        uvDensity = surfaceArea > 0.0f ? std::sqrt(uvArea / surfaceArea) : 0.0f;
+    }
+
+    // the depth pre-pass only needs positions, so it reads them from a tightly packed copy
+    // (12 bytes per vertex instead of 56) in the position-only pool of the arena; the copy draws with
+    // the index range of the mesh, and a mesh stored with positions only is its own depth stream
+    void setupDepthStream()
+    {
+        vector<glm::vec3> positions;
+        positions.reserve(vertices.size());
+        boundsMin = boundsMax = vertices.empty() ? glm::vec3(0.0f) : vertices[0].Position;
+        for (const Vertex& vertex : vertices)
+        {
+            positions.push_back(vertex.Position);
+            boundsMin = glm::min(boundsMin, vertex.Position);
+            boundsMax = glm::max(boundsMax, vertex.Position);
+        }
+
+        if (attributeMask == PositionLayout::AttributeMask)
+            depthGeometry = geometry;
+        else
+            depthGeometry = rg::geometryArena().AllocateSharingIndices(positionVertexFormat(), positions.data(),
+                                                                       positions.size(), geometry);
+        depthVAO = rg::geometryArena().GetVAO(depthGeometry.pool);
     }
 };
 #endif
\ No newline at end of file
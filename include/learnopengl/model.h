@@ -12,53 +12,507 @@
 
 #include <learnopengl/mesh.h>
 #include <learnopengl/shader.h>
-
+#include <rg/CompressedTexture.h>
+#include <rg/ShaderInterface.h>
+#include <rg/TextureDecoder.h>
+#include <rg/TextureStreamer.h>
+#include <rg/TransformHierarchy.h>
+#include <rg/WorkerPool.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <functional>
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <queue>
+#include <utility>
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false, rg::TextureUsage usage = rg::TextureUsage::Color);
+
+
 
+// Per-mesh data of a model as a structure of arrays: entry i of every array belongs to mesh i. The
+// loops that run every frame (culling, texture detail) only touch the arrays they need, which are
+// contiguous, instead of walking Mesh objects that each own their vertices, indices and strings.
+struct MeshArrays {
+    vector<rg::GeometryAllocation> geometry;
+    vector<rg::GeometryAllocation> depthGeometry;
+    // index into the materials of the model
+    vector<unsigned int> material;
+    vector<glm::vec3> boundsMin;
+    vector<glm::vec3> boundsMax;
+    vector<float> uvDensity;
+    vector<unsigned int> triangleCount;
+    // node of the model the mesh hangs from
+    vector<unsigned int> node;
 
+    size_t Size() const { return material.size(); }
+};
+
+// the six clip planes of a model-view-projection matrix, in the model's local space (xyz . p + w >= 0 inside)
+inline void extractFrustumPlanes(const glm::mat4 &modelViewProjection, glm::vec4 planes[6])
+{
+    glm::mat4 m = glm::transpose(modelViewProjection);
+    planes[0] = m[3] + m[0];
+    planes[1] = m[3] - m[0];
+    planes[2] = m[3] + m[1];
+    planes[3] = m[3] - m[1];
+    planes[4] = m[3] + m[2];
+    planes[5] = m[3] - m[2];
+}
+
+// visible[i] = 1 when the bounds of mesh i intersect the frustum, returns how many do
+inline unsigned int cullMeshBounds(const glm::vec3 *boundsMin, const glm::vec3 *boundsMax, size_t count,
+                                   const glm::vec4 planes[6], unsigned char *visible)
+{
+    unsigned int visibleCount = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 center = (boundsMin[i] + boundsMax[i]) * 0.5f;
+        glm::vec3 extents = (boundsMax[i] - boundsMin[i]) * 0.5f;
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++)
+        {
+            glm::vec3 normal = glm::vec3(planes[p]);
+            inside = glm::dot(center, normal) + planes[p].w + glm::dot(extents, glm::abs(normal)) >= 0.0f;
+        }
+        visible[i] = inside ? 1 : 0;
+        visibleCount += inside ? 1 : 0;
+    }
+    return visibleCount;
+}
 
 class Model
 {
 public:
     // model data
-    vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
-    vector<Mesh>    meshes;
+    MeshArrays meshes;
+    // every texture loaded for the model once, with its path in the string table at the same index
+    // (relative to directory), so no texture is loaded twice
+    vector<Texture> textures_loaded;
+    vector<string> texturePaths;
     string directory;
     bool gammaCorrection;
+    // meshes per culling range on the worker pool, models with fewer are culled on the calling thread
+    size_t CullGrain = 2048;
+    // The node hierarchy of the file, breadth first, with the node names in the string table at the
+    // same index. Meshes are stored transformed by the world matrix their node had at load; moving a
+    // node later only affects the meshes below it.
+    rg::TransformHierarchy nodes;
+    vector<string> nodeNames;
+
+    // what the interface of the drawing program let the loader leave out
+    struct PruneStats {
+        unsigned int skippedTextures = 0;
+        unsigned long skippedTextureBytes = 0;
+        unsigned long skippedVertexBytes = 0;
+        double loadMilliseconds = 0.0;
+    };
+    PruneStats pruneStats;
+
+    // receives the vertices, indices, textures and stored attribute mask of every loaded mesh
+    typedef std::function<void(vector<Vertex>&, vector<unsigned int>&, vector<Texture>&, unsigned int)> MeshCallback;
+
+    // a model without a file, filled with AddMesh
+    Model() : gammaCorrection(false), shaderInterface(nullptr)
+    {
+        visibleBatch.Transient = true;
+        addNode(rg::TransformHierarchy::NoParent, glm::mat4(1.0f), "root");
+        nodes.Update();
+    }
 
-    // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // constructor, expects a filepath to a 3D model. With a shader interface, vertex attributes and
+    // material maps that program does not read are never decoded, uploaded or stored. With a mesh
+    // callback the meshes are handed to it instead of being uploaded, and the model stays empty.
+    Model(string const &path, bool gamma = false, const rg::ShaderInterface *shader = nullptr, MeshCallback meshCallback = nullptr)
+        : gammaCorrection(gamma), shaderInterface(shader), meshCallback(std::move(meshCallback))
     {
+        visibleBatch.Transient = true;
+        auto start = std::chrono::steady_clock::now();
         loadModel(path);
+        pruneStats.loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (shader)
+            cout << "MODEL:: " << path << " loaded in " << pruneStats.loadMilliseconds << " ms, pruned "
+                 << pruneStats.skippedVertexBytes / 1024 << " KB of vertex attributes and " << pruneStats.skippedTextures
+                 << " maps (" << pruneStats.skippedTextureBytes / 1024 << " KB)" << endl;
     }
 
-    // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    // Draws the meshes that passed the last Cull with modelMatrix: one multi-draw per material and
+    // vertex format, groups with nothing visible do not even bind their textures. Meshes below a node
+    // that was moved since load are drawn one by one with the node's offset.
+    void Draw(Shader &shader, const glm::mat4 &modelMatrix)
     {
-        for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+        shader.setMat4("model", modelMatrix);
+        for(DrawGroup& group: drawGroups)
+        {
+            unsigned int visibleCount = 0;
+            for(unsigned int mesh: group.meshes)
+                visibleCount += visible[mesh] && !meshMoved[mesh] ? 1 : 0;
+            if(visibleCount == 0)
+                continue;
+
+            bindMaterial(group.material, shader);
+            if(visibleCount == group.meshes.size())
+            {
+                group.batch.Submit();
+                continue;
+            }
+            visibleBatch.Clear();
+            for(unsigned int mesh: group.meshes)
+            {
+                if(visible[mesh] && !meshMoved[mesh])
+                    visibleBatch.Add(meshes.geometry[mesh]);
+            }
+            visibleBatch.Submit();
+        }
+
+        for(unsigned int mesh: movedMeshes)
+        {
+            bindMaterial(meshes.material[mesh], shader);
+            shader.setMat4("model", modelMatrix * nodeOffset[meshes.node[mesh]]);
+            rg::geometryArena().Draw(meshes.geometry[mesh]);
+        }
+        if(!movedMeshes.empty())
+            shader.setMat4("model", modelMatrix);
     }
 
-    void SetShaderTextureNamePrefix(std::string prefix) {
-        for (Mesh& mesh: meshes) {
-            mesh.glslIdentifierPrefix = prefix;
+    // draws the positions of all meshes with modelMatrix, in a single call while no node was moved;
+    // the caller binds the depth-only program
+    void DrawDepth(Shader &depthShader, const glm::mat4 &modelMatrix)
+    {
+        depthShader.setMat4("model", modelMatrix);
+        if(movedMeshes.empty())
+        {
+            for(rg::DrawBatch& batch: depthBatches)
+                batch.Submit();
+            return;
+        }
+        visibleBatch.Clear();
+        for(size_t mesh = 0; mesh < meshes.Size(); mesh++)
+        {
+            if(meshMoved[mesh] || visibleBatch.Add(meshes.depthGeometry[mesh]))
+                continue;
+            // stored in another pool, what was collected so far goes out first
+            visibleBatch.Submit();
+            visibleBatch.Clear();
+            visibleBatch.Add(meshes.depthGeometry[mesh]);
         }
+        if(!visibleBatch.Empty())
+            visibleBatch.Submit();
+        for(unsigned int mesh: movedMeshes)
+        {
+            depthShader.setMat4("model", modelMatrix * nodeOffset[meshes.node[mesh]]);
+            rg::geometryArena().Draw(meshes.depthGeometry[mesh]);
+        }
+        depthShader.setMat4("model", modelMatrix);
+    }
+
+    // marks the meshes whose bounds are inside the frustum of modelViewProjection for the next Draw,
+    // returns how many are; until the first call every mesh is drawn. Meshes below moved nodes are
+    // always drawn, their bounds are the ones from load. Models with more than CullGrain meshes are
+    // culled in ranges on the worker pool.
+    unsigned int Cull(const glm::mat4 &modelViewProjection)
+    {
+        glm::vec4 planes[6];
+        extractFrustumPlanes(modelViewProjection, planes);
+        std::atomic<unsigned int> culled(0);
+        rg::parallelFor(rg::workerPool(), meshes.Size(), CullGrain, [this, &planes, &culled](size_t begin, size_t end) {
+            culled += cullMeshBounds(meshes.boundsMin.data() + begin, meshes.boundsMax.data() + begin, end - begin,
+                                     planes, visible.data() + begin);
+        });
+        unsigned int visibleCount = culled;
+        for(unsigned int mesh: movedMeshes)
+        {
+            visibleCount += visible[mesh] ? 0 : 1;
+            visible[mesh] = 1;
+        }
+        return visibleCount;
+    }
+
+    // index of the first node called name, NoParent when there is none
+    unsigned int FindNode(const string &name) const
+    {
+        for(unsigned int node = 0; node < nodeNames.size(); node++)
+        {
+            if(nodeNames[node] == name)
+                return node;
+        }
+        return rg::TransformHierarchy::NoParent;
+    }
+
+    // moves a node, and everything below it, relative to its parent; applied by UpdateTransforms
+    void SetNodeTransform(unsigned int node, const glm::mat4 &local)
+    {
+        nodes.SetLocal(node, local);
+    }
+
+    // recomputes the world matrices of the nodes set since the last call and of their descendants,
+    // returns how many; nothing is done while no node was set
+    unsigned int UpdateTransforms()
+    {
+        unsigned int updated = nodes.Update();
+        if(updated == 0)
+            return 0;
+        for(unsigned int node = 0; node < nodes.Size(); node++)
+        {
+            if(!nodes.Changed(node))
+                continue;
+            // back where it was loaded, the meshes can join their batches again
+            nodeMoved[node] = nodes.World(node) != nodeBind[node];
+            nodeOffset[node] = nodeMoved[node] ? nodes.World(node) * glm::inverse(nodeBind[node]) : glm::mat4(1.0f);
+        }
+        movedMeshes.clear();
+        for(size_t mesh = 0; mesh < meshes.Size(); mesh++)
+        {
+            meshMoved[mesh] = nodeMoved[meshes.node[mesh]];
+            if(meshMoved[mesh])
+                movedMeshes.push_back((unsigned int)mesh);
+        }
+        return updated;
+    }
+
+    // deletes the indirect buffers of the draw batches, on the GL thread; the geometry stays in the
+    // arena, which releases it as a whole
+    void Release()
+    {
+        for(DrawGroup& group: drawGroups)
+            group.batch.Release();
+        for(rg::DrawBatch& batch: depthBatches)
+            batch.Release();
+        visibleBatch.Release();
+    }
+
+    // local space bounds of all meshes
+    void GetBounds(glm::vec3 &boundsMin, glm::vec3 &boundsMax) const
+    {
+        boundsMin = glm::vec3(0.0f);
+        boundsMax = glm::vec3(0.0f);
+        for(size_t i = 0; i < meshes.Size(); i++)
+        {
+            boundsMin = i == 0 ? meshes.boundsMin[i] : glm::min(boundsMin, meshes.boundsMin[i]);
+            boundsMax = i == 0 ? meshes.boundsMax[i] : glm::max(boundsMax, meshes.boundsMax[i]);
+        }
+    }
+
+    // Tells the texture streamer how fine the textures of every mesh have to be when drawn with
+    // modelMatrix. pixelsPerUnit is the size in pixels of one world unit at distance 1 from the camera,
+    // projection[1][1] * viewport height / 2. The nearest point of each mesh's bounding sphere is
+    // taken, so a mesh the camera is inside of asks for full detail.
+    void RequestTextureDetail(const glm::mat4 &modelMatrix, const glm::vec3 &cameraPosition, float pixelsPerUnit) const
+    {
+        float scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+                               std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+        for(size_t i = 0; i < meshes.Size(); i++)
+        {
+            if(meshes.uvDensity[i] <= 0.0f)
+                continue;
+            glm::vec3 center = glm::vec3(modelMatrix * glm::vec4((meshes.boundsMin[i] + meshes.boundsMax[i]) * 0.5f, 1.0f));
+            float radius = glm::length(meshes.boundsMax[i] - meshes.boundsMin[i]) * 0.5f * scale;
+            float distance = std::max(glm::length(center - cameraPosition) - radius, 0.1f);
+            // texture coordinate units per world unit, over world units per pixel at that distance
+            float uvPerPixel = meshes.uvDensity[i] / scale * distance / pixelsPerUnit;
+            unsigned int material = meshes.material[i];
+            for(unsigned int t = materialFirstTexture[material]; t < materialFirstTexture[material + 1]; t++)
+                rg::textureStreamer().Request(materialTextures[t].id, uvPerPixel);
+        }
+    }
+
+    unsigned int GetTriangleCount() const
+    {
+        unsigned int count = 0;
+        for(unsigned int triangles: meshes.triangleCount)
+            count += triangles;
+        return count;
+    }
+
+    // multi-draw calls Draw makes when every mesh is visible
+    unsigned int GetDrawGroupCount() const
+    {
+        return (unsigned int)drawGroups.size();
+    }
+
+    // appends what drawing needs of a freshly built mesh to the arrays, its vertices and indices are dropped with it
+    void AddMesh(const Mesh &mesh, unsigned int node = 0)
+    {
+        unsigned int index = (unsigned int)meshes.Size();
+        meshes.geometry.push_back(mesh.geometry);
+        meshes.depthGeometry.push_back(mesh.depthGeometry);
+        meshes.material.push_back(findOrAddMaterial(mesh.textures));
+        meshes.boundsMin.push_back(mesh.boundsMin);
+        meshes.boundsMax.push_back(mesh.boundsMax);
+        meshes.uvDensity.push_back(mesh.uvDensity);
+        meshes.triangleCount.push_back((unsigned int)mesh.indices.size() / 3);
+        meshes.node.push_back(node);
+        visible.push_back(1);
+        meshMoved.push_back(nodeMoved[node]);
+        if(meshMoved.back())
+            movedMeshes.push_back(index);
+
+        if(depthBatches.empty() || !depthBatches.back().Add(mesh.depthGeometry))
+        {
+            depthBatches.push_back(rg::DrawBatch());
+            depthBatches.back().Add(mesh.depthGeometry);
+        }
+        // a batch can only hold one vertex format, so meshes of a material stored with different
+        // layouts end up in separate groups
+        DrawGroup* group = nullptr;
+        for(DrawGroup& existing: drawGroups)
+        {
+            if(existing.material == meshes.material[index] && meshes.geometry[existing.meshes[0]].pool == mesh.geometry.pool)
+            {
+                group = &existing;
+                break;
+            }
+        }
+        if(!group)
+        {
+            drawGroups.push_back(DrawGroup());
+            group = &drawGroups.back();
+            group->material = meshes.material[index];
+        }
+        group->meshes.push_back(index);
+        group->batch.Add(mesh.geometry);
+    }
+
+    // sampler names depend on the prefix, so the resolved locations are dropped with it
+    void SetShaderTextureNamePrefix(std::string prefix) {
+        glslIdentifierPrefix = prefix;
+        materialBindings.clear();
     }
 private:
+    // only used while loading
+    const rg::ShaderInterface *shaderInterface;
+    MeshCallback meshCallback;
+    unsigned int attributeMask = AllMeshAttributes;
+    vector<string> skippedPaths;
+
+    // Materials are the distinct texture lists of the meshes; the textures of material m are
+    // materialTextures[materialFirstTexture[m]] up to materialTextures[materialFirstTexture[m + 1]].
+    vector<Texture> materialTextures;
+    vector<unsigned int> materialFirstTexture = {0};
+    std::string glslIdentifierPrefix;
+
+    // sampler locations of materialTextures for one program, -1 for unused samplers
+    struct MaterialBinding {
+        GLuint program;
+        vector<GLint> locations;
+    };
+    // a model is drawn with one or two programs, so a linear search beats any map
+    vector<MaterialBinding> materialBindings;
+
+    // meshes of one material and vertex format, submitted together
+    struct DrawGroup {
+        unsigned int material;
+        vector<unsigned int> meshes;
+        rg::DrawBatch batch;
+    };
+    vector<DrawGroup> drawGroups;
+    // the depth streams all live in the position-only pool, a new batch only starts when one does not
+    vector<rg::DrawBatch> depthBatches;
+    // scratch batch for groups that are only partly visible, rebuilt for every submit
+    rg::DrawBatch visibleBatch;
+    // one byte per mesh, written by Cull
+    vector<unsigned char> visible;
+
+    // world matrix of every node at load, the offset from it and whether there is one
+    vector<glm::mat4> nodeBind;
+    vector<glm::mat4> nodeOffset;
+    vector<unsigned char> nodeMoved;
+    // one byte per mesh set when its node is moved, and the list of those meshes
+    vector<unsigned char> meshMoved;
+    vector<unsigned int> movedMeshes;
+
+    unsigned int addNode(unsigned int parent, const glm::mat4 &local, const string &name)
+    {
+        unsigned int node = nodes.Add(parent, local);
+        nodeNames.push_back(name);
+        nodeBind.push_back(nodes.World(node));
+        nodeOffset.push_back(glm::mat4(1.0f));
+        nodeMoved.push_back(0);
+        return node;
+    }
+
+    // the index of the material with exactly these textures, added when it is new
+    unsigned int findOrAddMaterial(const vector<Texture> &textures)
+    {
+        for(unsigned int m = 0; m + 1 < materialFirstTexture.size(); m++)
+        {
+            unsigned int first = materialFirstTexture[m];
+            if(materialFirstTexture[m + 1] - first != textures.size())
+                continue;
+            bool same = true;
+            for(unsigned int t = 0; t < textures.size() && same; t++)
+                same = materialTextures[first + t].id == textures[t].id && materialTextures[first + t].slot == textures[t].slot;
+            if(same)
+                return m;
+        }
+        materialTextures.insert(materialTextures.end(), textures.begin(), textures.end());
+        materialFirstTexture.push_back((unsigned int)materialTextures.size());
+        return (unsigned int)materialFirstTexture.size() - 2;
+    }
+
+    // resolves the sampler names once per program, the draw path never touches a string
+    const vector<GLint>& samplerLocations(GLuint program)
+    {
+        for(const MaterialBinding& binding : materialBindings)
+        {
+            if(binding.program == program)
+                return binding.locations;
+        }
+
+        MaterialBinding binding;
+        binding.program = program;
+        for(unsigned int m = 0; m + 1 < materialFirstTexture.size(); m++)
+        {
+            unsigned int slotCount[(int)MaterialSlot::Count] = {};
+            for(unsigned int t = materialFirstTexture[m]; t < materialFirstTexture[m + 1]; t++)
+            {
+                // the N in texture_diffuseN counts the maps of the same slot
+                MaterialSlot slot = materialTextures[t].slot;
+                unsigned int number = ++slotCount[(int)slot];
+                string name = glslIdentifierPrefix + materialSlotName(slot) + std::to_string(number);
+                binding.locations.push_back(glGetUniformLocation(program, name.c_str()));
+            }
+        }
+        materialBindings.push_back(binding);
+        return materialBindings.back().locations;
+    }
+
+    // binds the textures of a material and points the samplers at them, texture i of the material on unit i
+    void bindMaterial(unsigned int material, Shader &shader)
+    {
+        const vector<GLint>& locations = samplerLocations(shader.ID);
+        unsigned int first = materialFirstTexture[material];
+        for(unsigned int t = first; t < materialFirstTexture[material + 1]; t++)
+        {
+            // the sampler is set every time because the caller may have pointed it elsewhere with setInt
+            if(locations[t] >= 0)
+                glUniform1i(locations[t], t - first);
+            rg::glState().BindTexture(t - first, GL_TEXTURE_2D, materialTextures[t].id);
+        }
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        unsigned int flags = aiProcess_Triangulate | aiProcess_FlipUVs;
+        if (shaderInterface)
+            attributeMask = shaderInterface->AttributeMask() & AllMeshAttributes;
+        // assimp only derives what the program reads
+        if (attributeMask & (1u << MeshNormal::Location))
+            flags |= aiProcess_GenSmoothNormals;
+        if (attributeMask & (1u << MeshTangent::Location | 1u << MeshBitangent::Location))
+            flags |= aiProcess_CalcTangentSpace;
+        const aiScene* scene = importer.ReadFile(path, flags);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
@@ -68,30 +522,43 @@ private:
         // retrieve the directory path of the filepath
         directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // process ASSIMP's nodes breadth first, so the hierarchy is ordered by depth
+        std::queue<std::pair<aiNode*, unsigned int>> pending;
+        pending.push(std::make_pair(scene->mRootNode, rg::TransformHierarchy::NoParent));
+        while(!pending.empty())
+        {
+            aiNode* node = pending.front().first;
+            unsigned int index = processNode(node, pending.front().second, scene);
+            pending.pop();
+            for(unsigned int i = 0; i < node->mNumChildren; i++)
+                pending.push(std::make_pair(node->mChildren[i], index));
+        }
+        // clears the dirty flags, the world matrices are already the ones from load
+        nodes.Update();
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    // adds a node to the hierarchy and processes each individual mesh located at it, returns the node's index
+    unsigned int processNode(aiNode *node, unsigned int parent, const aiScene *scene)
     {
+        // assimp stores matrices row major, glm column major
+        const aiMatrix4x4& m = node->mTransformation;
+        glm::mat4 local(m.a1, m.b1, m.c1, m.d1,
+                        m.a2, m.b2, m.c2, m.d2,
+                        m.a3, m.b3, m.c3, m.d3,
+                        m.a4, m.b4, m.c4, m.d4);
+        unsigned int index = addNode(parent, local, node->mName.C_Str());
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            processMesh(mesh, scene, index);
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
-        for(unsigned int i = 0; i < node->mNumChildren; i++)
-        {
-            processNode(node->mChildren[i], scene);
-        }
-
+        return index;
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    void processMesh(aiMesh *mesh, const aiScene *scene, unsigned int node)
     {
         // data to fill
         vector<Vertex> vertices;
@@ -125,23 +592,46 @@ private:
                 vec.x = mesh->mTextureCoords[0][i].x;
                 vec.y = mesh->mTextureCoords[0][i].y;
                 vertex.TexCoords = vec;
-                // tangent
+            }
+            else
+                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            // tangent and bitangent, only computed by assimp when the program reads them
+            if (mesh->HasTangentsAndBitangents())
+            {
                 vector.x = mesh->mTangents[i].x;
                 vector.y = mesh->mTangents[i].y;
                 vector.z = mesh->mTangents[i].z;
                 vertex.Tangent = vector;
-                // bitangent
                 vector.x = mesh->mBitangents[i].x;
                 vector.y = mesh->mBitangents[i].y;
                 vector.z = mesh->mBitangents[i].z;
                 vertex.Bitangent = vector;
             }
             else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+            {
+                vertex.Tangent = glm::vec3(0.0f);
+                vertex.Bitangent = glm::vec3(0.0f);
+            }
 
             vertices.push_back(vertex);
 
 
+        }
+        // into the space of the model, where the node was at load
+        const glm::mat4& transform = nodes.World(node);
+        if (transform != glm::mat4(1.0f))
+        {
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+            glm::mat3 tangentMatrix = glm::mat3(transform);
+            for (Vertex& vertex : vertices)
+            {
+                vertex.Position = glm::vec3(transform * glm::vec4(vertex.Position, 1.0f));
+                vertex.Normal = normalMatrix * vertex.Normal;
+                vertex.Tangent = tangentMatrix * vertex.Tangent;
+                vertex.Bitangent = tangentMatrix * vertex.Bitangent;
+                if (glm::length(vertex.Normal) > 0.0f)
+                    vertex.Normal = glm::normalize(vertex.Normal);
+            }
         }
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
@@ -164,38 +654,68 @@ private:
 
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
+        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, MaterialSlot::Diffuse);
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
         // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, MaterialSlot::Specular);
         textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
         // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
+        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, MaterialSlot::Normal);
         textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
         // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
+        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, MaterialSlot::Height);
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
 
 
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // only what both the data and the program have is stored
+        unsigned int dataMask = 1u << MeshPosition::Location;
+        if (mesh->HasNormals())
+            dataMask |= 1u << MeshNormal::Location;
+        if (mesh->mTextureCoords[0])
+            dataMask |= 1u << MeshTexCoords::Location;
+        if (mesh->HasTangentsAndBitangents())
+            dataMask |= 1u << MeshTangent::Location | 1u << MeshBitangent::Location;
+
+        if (meshCallback)
+        {
+            meshCallback(vertices, indices, textures, attributeMask & dataMask);
+            return;
+        }
+        // create a mesh object from the extracted mesh data
+        Mesh result(vertices, indices, textures, attributeMask & dataMask);
+        pruneStats.skippedVertexBytes += vertices.size() * (sizeof(Vertex) - result.vertexStride);
+        AddMesh(result, node);
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
     // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, MaterialSlot slot)
     {
         vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
+            // a map without an active sampler would only cost decoding time and VRAM
+            if(shaderInterface && !shaderInterface->UsesSampler(materialSlotName(slot) + std::to_string(i + 1)))
+            {
+                int width, height, components;
+                string filename = this->directory + '/' + str.C_Str();
+                if(std::find(skippedPaths.begin(), skippedPaths.end(), filename) == skippedPaths.end())
+                {
+                    skippedPaths.push_back(filename);
+                    pruneStats.skippedTextures++;
+                    if(stbi_info(filename.c_str(), &width, &height, &components))
+                        pruneStats.skippedTextureBytes += rg::textureMemory(width, height, components);
+                }
+                continue;
+            }
             // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
             bool skip = false;
             for(unsigned int j = 0; j < textures_loaded.size(); j++)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
+                if(texturePaths[j] == str.C_Str())
                 {
                     textures.push_back(textures_loaded[j]);
                     skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
@@ -205,11 +725,11 @@ private:
             if(!skip)
             {   // if texture hasn't been loaded already, load it
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
+                texture.id = TextureFromFile(str.C_Str(), this->directory, false, materialSlotUsage(slot));
+                texture.slot = slot;
                 textures.push_back(texture);
                 textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                texturePaths.push_back(str.C_Str());
             }
         }
         return textures;
@@ -217,7 +737,139 @@ private:
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+// Times the loops that run over every mesh each frame, frustum culling and the texture detail
+// requests, on a synthetic scene of meshCount meshes stored two ways: one object per mesh owning its
+// vertices, indices and texture paths, the way Model used to keep vector<Mesh>, and the MeshArrays the
+// model keeps now. Only the CPU side is measured, the requests go to a counter instead of the streamer.
+inline void benchmarkModelStorage(std::ostream &out, unsigned int meshCount = 10000, int runs = 20)
+{
+    struct MeshObject {
+        vector<Vertex> vertices;
+        vector<unsigned int> indices;
+        vector<Texture> textures;
+        vector<string> texturePaths;
+        std::string glslIdentifierPrefix;
+        rg::GeometryAllocation geometry;
+        rg::GeometryAllocation depthGeometry;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        float uvDensity;
+    };
+
+    vector<MeshObject> objects(meshCount);
+    MeshArrays arrays;
+    vector<unsigned int> materialFirstTexture;
+    vector<Texture> materialTextures;
+    const unsigned int materialCount = 64;
+    for(unsigned int m = 0; m <= materialCount; m++)
+        materialFirstTexture.push_back(m * 2);
+    for(unsigned int m = 0; m < materialCount; m++)
+    {
+        materialTextures.push_back({m * 2 + 1, MaterialSlot::Diffuse});
+        materialTextures.push_back({m * 2 + 2, MaterialSlot::Specular});
+    }
+
+    unsigned int seed = 1;
+    auto random = [&seed] {
+        seed = seed * 1664525u + 1013904223u;
+        return (float)(seed >> 8) / (float)(1u << 24);
+    };
+    for(unsigned int i = 0; i < meshCount; i++)
+    {
+        // meshes spread over a 200 unit cube around the camera, about a quarter of them in view
+        glm::vec3 center = glm::vec3(random(), random(), random()) * 200.0f - 100.0f;
+        glm::vec3 extents = glm::vec3(random(), random(), random()) * 2.0f + 0.1f;
+        unsigned int material = i % materialCount;
+        MeshObject& object = objects[i];
+        object.vertices.resize(24);
+        object.indices.resize(36);
+        for(unsigned int t = materialFirstTexture[material]; t < materialFirstTexture[material + 1]; t++)
+        {
+            object.textures.push_back(materialTextures[t]);
+            object.texturePaths.push_back("textures/material_" + std::to_string(material) + "_" + std::to_string(t) + ".png");
+        }
+        object.glslIdentifierPrefix = "material.";
+        object.boundsMin = center - extents;
+        object.boundsMax = center + extents;
+        object.uvDensity = 1.0f + random();
+
+        arrays.geometry.push_back(object.geometry);
+        arrays.depthGeometry.push_back(object.depthGeometry);
+        arrays.material.push_back(material);
+        arrays.boundsMin.push_back(object.boundsMin);
+        arrays.boundsMax.push_back(object.boundsMax);
+        arrays.uvDensity.push_back(object.uvDensity);
+        arrays.triangleCount.push_back(12);
+    }
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::vec4 planes[6];
+    extractFrustumPlanes(projection * view, planes);
+    glm::vec3 cameraPosition(0.0f);
+    const float pixelsPerUnit = 500.0f;
+
+    vector<unsigned char> visible(meshCount);
+    double objectCull = 0.0, arrayCull = 0.0, objectDetail = 0.0, arrayDetail = 0.0;
+    unsigned int objectVisible = 0, arrayVisible = 0;
+    // keeps the compiler from dropping the detail loops
+    double objectSum = 0.0, arraySum = 0.0;
+    for(int run = 0; run < runs; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        objectVisible = 0;
+        for(unsigned int i = 0; i < meshCount; i++)
+            objectVisible += cullMeshBounds(&objects[i].boundsMin, &objects[i].boundsMax, 1, planes, &visible[i]);
+        auto end = std::chrono::steady_clock::now();
+        objectCull += std::chrono::duration<double, std::milli>(end - start).count();
+
+        start = std::chrono::steady_clock::now();
+        arrayVisible = cullMeshBounds(arrays.boundsMin.data(), arrays.boundsMax.data(), arrays.Size(), planes, visible.data());
+        end = std::chrono::steady_clock::now();
+        arrayCull += std::chrono::duration<double, std::milli>(end - start).count();
+
+        start = std::chrono::steady_clock::now();
+        for(const MeshObject& object: objects)
+        {
+            glm::vec3 center = (object.boundsMin + object.boundsMax) * 0.5f;
+            float radius = glm::length(object.boundsMax - object.boundsMin) * 0.5f;
+            float distance = std::max(glm::length(center - cameraPosition) - radius, 0.1f);
+            float uvPerPixel = object.uvDensity * distance / pixelsPerUnit;
+            for(const Texture& texture: object.textures)
+                objectSum += uvPerPixel * texture.id;
+        }
+        end = std::chrono::steady_clock::now();
+        objectDetail += std::chrono::duration<double, std::milli>(end - start).count();
+
+        start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < arrays.Size(); i++)
+        {
+            glm::vec3 center = (arrays.boundsMin[i] + arrays.boundsMax[i]) * 0.5f;
+            float radius = glm::length(arrays.boundsMax[i] - arrays.boundsMin[i]) * 0.5f;
+            float distance = std::max(glm::length(center - cameraPosition) - radius, 0.1f);
+            float uvPerPixel = arrays.uvDensity[i] * distance / pixelsPerUnit;
+            unsigned int material = arrays.material[i];
+            for(unsigned int t = materialFirstTexture[material]; t < materialFirstTexture[material + 1]; t++)
+                arraySum += uvPerPixel * materialTextures[t].id;
+        }
+        end = std::chrono::steady_clock::now();
+        arrayDetail += std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    double toNanosecondsPerMesh = 1.0e6 / runs / meshCount;
+    out << "MODEL_STORAGE_BENCHMARK:: " << meshCount << " meshes, " << arrayVisible << " in view, average of " << runs << " runs\n"
+        << "  frustum cull     per mesh objects " << objectCull * toNanosecondsPerMesh << " ns, arrays "
+        << arrayCull * toNanosecondsPerMesh << " ns\n"
+        << "  texture detail   per mesh objects " << objectDetail * toNanosecondsPerMesh << " ns, arrays "
+        << arrayDetail * toNanosecondsPerMesh << " ns\n"
+        << "  bytes walked     per mesh objects " << sizeof(MeshObject) << " + heap, arrays "
+        << 2 * sizeof(glm::vec3) + sizeof(float) + sizeof(unsigned int) << std::endl;
+    if(objectVisible != arrayVisible || std::abs(objectSum - arraySum) > 1e-6 * std::abs(arraySum))
+        out << "ERROR::MODEL_STORAGE_BENCHMARK::RESULTS_DIFFER" << std::endl;
+}
+
+
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma, rg::TextureUsage usage)
 {
     string filename = string(path);
     filename = directory + '/' + filename;
@@ -225,34 +877,43 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-    if (data)
+    // only the coarse levels are uploaded here, the texture streamer brings in the finer ones once the
+    // model is drawn close enough to need them
+    rg::CookedTexture cooked;
+    if (rg::readCurrentCookedTexture(filename, cooked))
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        // the cooked version is already block compressed and carries its mip chain
+        vector<rg::MipLevel> levels(cooked.levels.size());
+        for(size_t i = 0; i < cooked.levels.size(); i++)
+        {
+            levels[i].width = (int)cooked.levels[i].width;
+            levels[i].height = (int)cooked.levels[i].height;
+            levels[i].data = std::move(cooked.levels[i].data);
+        }
+        rg::textureStreamer().Add(textureID, rg::glCompressedFormat(cooked.format), GL_NONE, true, std::move(levels), filename);
+        rg::glState().BindTexture(0, GL_TEXTURE_2D, textureID);
+        rg::applyCookedTextureSwizzle(GL_TEXTURE_2D, cooked.format);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
+        return textureID;
     }
-    else
+
+    // decoding and the mip chain happen on a worker, the streamer takes the levels once they are ready
+    rg::textureDecoder().Decode(textureID, filename, usage, [](GLuint texture, rg::DecodedTexture &decoded)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+        rg::textureStreamer().Add(texture, decoded.format.internalFormat, decoded.format.format, false,
+                                  std::move(decoded.levels), decoded.path);
+        rg::glState().BindTexture(0, GL_TEXTURE_2D, texture);
+        rg::applyTextureSwizzle(GL_TEXTURE_2D, decoded.format);
+    });
+    rg::glState().BindTexture(0, GL_TEXTURE_2D, textureID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     return textureID;
 }
@@ -0,0 +1,184 @@
+#ifndef PROJECT_BASE_BLOCKCOMPRESSION_H
+#define PROJECT_BASE_BLOCKCOMPRESSION_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+// CPU encoders for the block compressed formats every desktop GPU samples natively. Each 4x4 block of
+// texels is stored as two endpoints and a small index per texel into the palette interpolated between
+// them:
+//   BC1  RGB,           8 bytes per block (6:1 against RGB8)
+//   BC3  RGB + alpha,  16 bytes per block (BC4 style alpha followed by a BC1 colour block)
+//   BC4  one channel,   8 bytes per block
+//   BC5  two channels, 16 bytes per block (two BC4 blocks, for normal maps)
+//
+// The endpoints are the bounding box of the block, the indices pick the nearest palette entry. That is
+// far from what an offline optimiser reaches, but it runs at load-tool speed and has no dependencies.
+// Nothing here touches GL, so the cooker links it without a context.
+
+namespace rg {
+
+    enum class BlockFormat : uint32_t {
+        BC1 = 1,
+        BC3 = 3,
+        BC4 = 4,
+        BC5 = 5
+    };
+
+    inline unsigned int blockBytes(BlockFormat format) {
+        return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+    }
+
+    // size of one compressed mip level, partial blocks at the edges still take a whole block
+    inline unsigned int compressedLevelSize(BlockFormat format, int width, int height) {
+        unsigned int blocksX = (unsigned int)std::max(1, (width + 3) / 4);
+        unsigned int blocksY = (unsigned int)std::max(1, (height + 3) / 4);
+        return blocksX * blocksY * blockBytes(format);
+    }
+
+    namespace detail {
+
+        inline uint16_t packRGB565(const int rgb[3]) {
+            return (uint16_t)(((rgb[0] * 31 + 127) / 255) << 11 | ((rgb[1] * 63 + 127) / 255) << 5 | ((rgb[2] * 31 + 127) / 255));
+        }
+
+        inline void unpackRGB565(uint16_t packed, int rgb[3]) {
+            int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+            rgb[0] = (r << 3) | (r >> 2);
+            rgb[1] = (g << 2) | (g >> 4);
+            rgb[2] = (b << 3) | (b >> 2);
+        }
+
+        // block holds 16 RGBA texels
+        inline void encodeColorBlock(const uint8_t block[64], uint8_t *out) {
+            int low[3] = {255, 255, 255}, high[3] = {0, 0, 0};
+            for (int i = 0; i < 16; i++) {
+                for (int c = 0; c < 3; c++) {
+                    low[c] = std::min(low[c], (int)block[i * 4 + c]);
+                    high[c] = std::max(high[c], (int)block[i * 4 + c]);
+                }
+            }
+            // pull the endpoints in by 1/16 of the range, the extremes are rarely worth an exact match
+            for (int c = 0; c < 3; c++) {
+                int inset = (high[c] - low[c]) >> 4;
+                low[c] += inset;
+                high[c] -= inset;
+            }
+
+            uint16_t color0 = packRGB565(high), color1 = packRGB565(low);
+            if (color0 < color1)
+                std::swap(color0, color1);
+
+            uint32_t indices = 0;
+            if (color0 != color1) {
+                // color0 > color1 selects the four colour mode: c0, c1, 2/3 c0 + 1/3 c1, 1/3 c0 + 2/3 c1
+                int palette[4][3];
+                unpackRGB565(color0, palette[0]);
+                unpackRGB565(color1, palette[1]);
+                for (int c = 0; c < 3; c++) {
+                    palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                    palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+                }
+                for (int i = 0; i < 16; i++) {
+                    int best = 0, bestDistance = 1 << 30;
+                    for (int p = 0; p < 4; p++) {
+                        int distance = 0;
+                        for (int c = 0; c < 3; c++) {
+                            int d = (int)block[i * 4 + c] - palette[p][c];
+                            distance += d * d;
+                        }
+                        if (distance < bestDistance) {
+                            bestDistance = distance;
+                            best = p;
+                        }
+                    }
+                    indices |= (uint32_t)best << (i * 2);
+                }
+            }
+
+            out[0] = (uint8_t)(color0 & 0xff);
+            out[1] = (uint8_t)(color0 >> 8);
+            out[2] = (uint8_t)(color1 & 0xff);
+            out[3] = (uint8_t)(color1 >> 8);
+            for (int i = 0; i < 4; i++)
+                out[4 + i] = (uint8_t)(indices >> (i * 8));
+        }
+
+        // encodes channel `channel` of 16 RGBA texels as a BC4 block
+        inline void encodeChannelBlock(const uint8_t block[64], int channel, uint8_t *out) {
+            int low = 255, high = 0;
+            for (int i = 0; i < 16; i++) {
+                low = std::min(low, (int)block[i * 4 + channel]);
+                high = std::max(high, (int)block[i * 4 + channel]);
+            }
+
+            uint64_t indices = 0;
+            if (high != low) {
+                // high > low selects the eight value mode: the endpoints and six steps between them
+                int palette[8];
+                palette[0] = high;
+                palette[1] = low;
+                for (int p = 1; p < 7; p++)
+                    palette[p + 1] = ((7 - p) * high + p * low) / 7;
+                for (int i = 0; i < 16; i++) {
+                    int value = block[i * 4 + channel];
+                    int best = 0, bestDistance = 256;
+                    for (int p = 0; p < 8; p++) {
+                        int distance = std::abs(value - palette[p]);
+                        if (distance < bestDistance) {
+                            bestDistance = distance;
+                            best = p;
+                        }
+                    }
+                    indices |= (uint64_t)best << (i * 3);
+                }
+            }
+
+            out[0] = (uint8_t)high;
+            out[1] = (uint8_t)low;
+            for (int i = 0; i < 6; i++)
+                out[2 + i] = (uint8_t)(indices >> (i * 8));
+        }
+
+    }
+
+    // compresses one RGBA8 image, texels past the edge repeat the last row and column
+    inline std::vector<uint8_t> compressImage(BlockFormat format, const uint8_t *rgba, int width, int height) {
+        std::vector<uint8_t> result(compressedLevelSize(format, width, height));
+        uint8_t *out = result.data();
+        uint8_t block[64];
+        for (int by = 0; by < height; by += 4) {
+            for (int bx = 0; bx < width; bx += 4) {
+                for (int y = 0; y < 4; y++) {
+                    for (int x = 0; x < 4; x++) {
+                        int sx = std::min(bx + x, width - 1), sy = std::min(by + y, height - 1);
+                        std::copy(rgba + (sy * width + sx) * 4, rgba + (sy * width + sx) * 4 + 4, block + (y * 4 + x) * 4);
+                    }
+                }
+                switch (format) {
+                    case BlockFormat::BC1:
+                        detail::encodeColorBlock(block, out);
+                        break;
+                    case BlockFormat::BC3:
+                        detail::encodeChannelBlock(block, 3, out);
+                        detail::encodeColorBlock(block, out + 8);
+                        break;
+                    case BlockFormat::BC4:
+                        detail::encodeChannelBlock(block, 0, out);
+                        break;
+                    case BlockFormat::BC5:
+                        detail::encodeChannelBlock(block, 0, out);
+                        detail::encodeChannelBlock(block, 1, out + 8);
+                        break;
+                }
+                out += blockBytes(format);
+            }
+        }
+        return result;
+    }
+
+}
+
+#endif //PROJECT_BASE_BLOCKCOMPRESSION_H
@@ -0,0 +1,274 @@
+#ifndef PROJECT_BASE_COMMANDBUFFER_H
+#define PROJECT_BASE_COMMANDBUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <rg/GeometryArena.h>
+#include <rg/GLState.h>
+#include <rg/WorkerPool.h>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace rg {
+
+    enum class CommandType : unsigned char {
+        UseProgram,
+        BindTexture,
+        SetInt,
+        SetFloat,
+        SetVec3,
+        SetVec4,
+        SetMat4,
+        Draw,
+        DrawInstanced
+    };
+
+    // A recorded list of GL work as a compact byte stream: a one byte type followed by the packed
+    // arguments of each command. Recording touches no GL, so any thread can fill a buffer; Replay on
+    // the GL thread issues the calls in recorded order through the state cache. Uniforms are set by
+    // location, resolved once on the GL thread, since looking names up is a GL call of its own.
+    class CommandBuffer {
+    public:
+        void UseProgram(GLuint program) {
+            write(CommandType::UseProgram);
+            write(program);
+        }
+
+        void BindTexture(GLuint unit, GLenum target, GLuint texture) {
+            write(CommandType::BindTexture);
+            write(unit);
+            write(target);
+            write(texture);
+        }
+
+        void SetInt(GLint location, int value) {
+            write(CommandType::SetInt);
+            write(location);
+            write(value);
+        }
+
+        void SetFloat(GLint location, float value) {
+            write(CommandType::SetFloat);
+            write(location);
+            write(value);
+        }
+
+        void SetVec3(GLint location, const glm::vec3 &value) {
+            write(CommandType::SetVec3);
+            write(location);
+            write(value);
+        }
+
+        void SetVec4(GLint location, const glm::vec4 &value) {
+            write(CommandType::SetVec4);
+            write(location);
+            write(value);
+        }
+
+        void SetMat4(GLint location, const glm::mat4 &value) {
+            write(CommandType::SetMat4);
+            write(location);
+            write(value);
+        }
+
+        // the allocation is copied, it may be freed once the buffer was replayed
+        void Draw(const GeometryAllocation &allocation, GLenum mode = GL_TRIANGLES) {
+            write(CommandType::Draw);
+            write(allocation);
+            write(mode);
+        }
+
+        void DrawInstanced(const GeometryAllocation &allocation, GLsizei instanceCount, GLenum mode = GL_TRIANGLES) {
+            write(CommandType::DrawInstanced);
+            write(allocation);
+            write(instanceCount);
+            write(mode);
+        }
+
+        // keeps the memory for the next recording
+        void Clear() {
+            m_Data.clear();
+            m_CommandCount = 0;
+        }
+
+        // room for bytes of commands, recording up to that much does not grow the buffer
+        void Reserve(size_t bytes) {
+            m_Data.reserve(bytes);
+        }
+
+        bool Empty() const { return m_CommandCount == 0; }
+        unsigned int CommandCount() const { return m_CommandCount; }
+        size_t ByteSize() const { return m_Data.size(); }
+
+        // issues the recorded commands in order, on the GL thread only
+        void Replay(const GeometryArena &arena = geometryArena()) const {
+            size_t offset = 0;
+            while (offset < m_Data.size()) {
+                CommandType type = read<CommandType>(offset);
+                switch (type) {
+                    case CommandType::UseProgram:
+                        glState().UseProgram(read<GLuint>(offset));
+                        break;
+                    case CommandType::BindTexture: {
+                        GLuint unit = read<GLuint>(offset);
+                        GLenum target = read<GLenum>(offset);
+                        glState().BindTexture(unit, target, read<GLuint>(offset));
+                        break;
+                    }
+                    case CommandType::SetInt: {
+                        GLint location = read<GLint>(offset);
+                        glUniform1i(location, read<int>(offset));
+                        break;
+                    }
+                    case CommandType::SetFloat: {
+                        GLint location = read<GLint>(offset);
+                        glUniform1f(location, read<float>(offset));
+                        break;
+                    }
+                    case CommandType::SetVec3: {
+                        GLint location = read<GLint>(offset);
+                        glm::vec3 value = read<glm::vec3>(offset);
+                        glUniform3fv(location, 1, &value[0]);
+                        break;
+                    }
+                    case CommandType::SetVec4: {
+                        GLint location = read<GLint>(offset);
+                        glm::vec4 value = read<glm::vec4>(offset);
+                        glUniform4fv(location, 1, &value[0]);
+                        break;
+                    }
+                    case CommandType::SetMat4: {
+                        GLint location = read<GLint>(offset);
+                        glm::mat4 value = read<glm::mat4>(offset);
+                        glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
+                        break;
+                    }
+                    case CommandType::Draw: {
+                        GeometryAllocation allocation = read<GeometryAllocation>(offset);
+                        arena.Draw(allocation, read<GLenum>(offset));
+                        break;
+                    }
+                    case CommandType::DrawInstanced: {
+                        GeometryAllocation allocation = read<GeometryAllocation>(offset);
+                        GLsizei instanceCount = read<GLsizei>(offset);
+                        arena.DrawInstanced(allocation, instanceCount, read<GLenum>(offset));
+                        break;
+                    }
+                }
+            }
+        }
+
+    private:
+        std::vector<unsigned char> m_Data;
+        unsigned int m_CommandCount = 0;
+
+        void write(CommandType type) {
+            m_Data.push_back((unsigned char)type);
+            m_CommandCount++;
+        }
+
+        // arguments are copied byte for byte, unaligned
+        template<typename T>
+        void write(const T &value) {
+            size_t offset = m_Data.size();
+            m_Data.resize(offset + sizeof(T));
+            std::memcpy(m_Data.data() + offset, &value, sizeof(T));
+        }
+
+        template<typename T>
+        T read(size_t &offset) const {
+            T value;
+            std::memcpy(&value, m_Data.data() + offset, sizeof(T));
+            offset += sizeof(T);
+            return value;
+        }
+    };
+
+    // Records count objects into one buffer per partition of partitionSize objects, the partitions
+    // in parallel on the pool: record(buffer, begin, end) fills buffer with the commands of objects
+    // [begin, end). Partitions are fixed by index, so replaying buffers front to back gives the same
+    // order as recording everything on one thread. buffers grows to the partition count, ones past it
+    // are left empty, and all keep their memory from frame to frame.
+    template<typename Record>
+    void recordCommands(WorkerPool &pool, size_t count, size_t partitionSize, std::vector<CommandBuffer> &buffers,
+                        const Record &record) {
+        size_t partitions = (count + partitionSize - 1) / partitionSize;
+        if (buffers.size() < partitions)
+            buffers.resize(partitions);
+        for (size_t p = 0; p < buffers.size(); p++)
+            buffers[p].Clear();
+        parallelFor(pool, partitions, 1, [&](size_t begin, size_t end) {
+            for (size_t p = begin; p < end; p++)
+                record(buffers[p], p * partitionSize, std::min(count, (p + 1) * partitionSize));
+        });
+    }
+
+    // Sizes buffers for recordCommands of up to count objects of bytesPerObject each, so frames with
+    // more objects than the ones before do not grow them.
+    inline void reserveCommands(std::vector<CommandBuffer> &buffers, size_t count, size_t partitionSize,
+                                size_t bytesPerObject) {
+        size_t partitions = (count + partitionSize - 1) / partitionSize;
+        if (buffers.size() < partitions)
+            buffers.resize(partitions);
+        for (size_t p = 0; p < partitions; p++)
+            buffers[p].Reserve((std::min(count, (p + 1) * partitionSize) - p * partitionSize) * bytesPerObject);
+    }
+
+    inline void replayCommands(const std::vector<CommandBuffer> &buffers, const GeometryArena &arena = geometryArena()) {
+        for (const CommandBuffer &buffer : buffers)
+            buffer.Replay(arena);
+    }
+
+    // Times recording a model matrix, a colour and a draw for 1k to 100k objects into one buffer on
+    // the calling thread against partitions of 1024 objects on the worker pool. Recording is the part
+    // that scales with cores; the replay is bound by the driver and stays on the GL thread.
+    inline void benchmarkCommandRecording(std::ostream &out, int runs = 20) {
+        out << "COMMAND_BENCHMARK:: average of " << runs << " recordings, " << workerPool().ThreadCount() + 1
+            << " threads when parallel" << std::endl;
+        const size_t counts[] = {1000, 10000, 100000};
+        for (size_t count : counts) {
+            std::vector<glm::mat4> models(count);
+            std::vector<glm::vec3> colors(count);
+            for (size_t i = 0; i < count; i++) {
+                glm::vec4 column((float)(i % 100), 0.0f, (float)(i / 100), 1.0f);
+                models[i][3] = column;
+                colors[i] = glm::vec3((float)(i % 3) * 0.5f);
+            }
+            GeometryAllocation geometry;
+            geometry.pool = 0;
+            geometry.indexCount = 36;
+            auto record = [&](CommandBuffer &buffer, size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    buffer.SetMat4(0, models[i]);
+                    buffer.SetVec3(1, colors[i]);
+                    buffer.Draw(geometry);
+                }
+            };
+
+            std::vector<CommandBuffer> serialBuffers(1), parallelBuffers;
+            double serial = 0.0, parallel = 0.0;
+            for (int run = 0; run < runs; run++) {
+                auto start = std::chrono::steady_clock::now();
+                serialBuffers[0].Clear();
+                record(serialBuffers[0], 0, count);
+                auto end = std::chrono::steady_clock::now();
+                serial += std::chrono::duration<double, std::milli>(end - start).count();
+
+                start = std::chrono::steady_clock::now();
+                recordCommands(workerPool(), count, 1024, parallelBuffers, record);
+                end = std::chrono::steady_clock::now();
+                parallel += std::chrono::duration<double, std::milli>(end - start).count();
+            }
+            out << "  " << count << " objects, " << serialBuffers[0].CommandCount() << " commands in "
+                << serialBuffers[0].ByteSize() / 1024 << " KB: one thread " << serial / runs << " ms, "
+                << parallelBuffers.size() << " partitions " << parallel / runs << " ms, " << serial / parallel << "x"
+                << std::endl;
+        }
+    }
+
+}
+
+#endif //PROJECT_BASE_COMMANDBUFFER_H
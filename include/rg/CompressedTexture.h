@@ -0,0 +1,87 @@
+#ifndef PROJECT_BASE_COMPRESSEDTEXTURE_H
+#define PROJECT_BASE_COMPRESSEDTEXTURE_H
+
+#include <glad/glad.h>
+#include <rg/CookedTexture.h>
+#include <rg/GLExtensions.h>
+#include <rg/GLState.h>
+
+#include <iostream>
+#include <string>
+
+namespace rg {
+
+    inline GLenum glCompressedFormat(BlockFormat format) {
+        switch (format) {
+            case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+            case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+            case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+        }
+        return GL_NONE;
+    }
+
+    // the cooker only picks BC4 for grey images, they are sampled as grey and not red; shaders that
+    // read a single channel see the same value
+    inline void applyCookedTextureSwizzle(GLenum target, BlockFormat format) {
+        if (format != BlockFormat::BC4)
+            return;
+        GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+        glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+
+    // RGTC is core since 3.0, the S3TC formats still need the extension
+    inline bool isBlockFormatSupported(BlockFormat format) {
+        if (format == BlockFormat::BC4 || format == BlockFormat::BC5)
+            return true;
+        return glExtensions().TextureCompressionS3TC;
+    }
+
+    // uploads the whole mip chain to imageTarget (GL_TEXTURE_2D or a cube map face) of the bound texture
+    inline void uploadCookedTexture(const CookedTexture &texture, GLenum imageTarget) {
+        GLenum internalFormat = glCompressedFormat(texture.format);
+        for (size_t level = 0; level < texture.levels.size(); level++) {
+            const CookedLevel &mip = texture.levels[level];
+            glCompressedTexImage2D(imageTarget, (GLint)level, internalFormat, mip.width, mip.height, 0,
+                                   (GLsizei)mip.data.size(), mip.data.data());
+        }
+    }
+
+    // Reads the cooked <sourcePath>.rgtx when one exists, is current and the format is supported.
+    // Returns false otherwise and the caller decodes the source image as before, so a tree that was
+    // never cooked, or one with edited images, still renders correctly.
+    inline bool readCurrentCookedTexture(const std::string &sourcePath, CookedTexture &cooked) {
+        if (!readCookedTexture(cookedTexturePath(sourcePath), cooked))
+            return false;
+
+        // the source is only read again when its size or modification time changed
+        uint64_t sourceSize = 0;
+        int64_t sourceModified = 0;
+        if (cookedSourceStamp(sourcePath, sourceSize, sourceModified) &&
+            !cookedStampMatches(cooked, sourceSize, sourceModified)) {
+            uint64_t sourceHash = 0;
+            if (cookedSourceHash(sourcePath, sourceHash) && sourceHash != cooked.sourceHash) {
+                std::cout << "COMPRESSED_TEXTURE::STALE " << sourcePath << ", run the cook_textures target" << std::endl;
+                return false;
+            }
+        }
+        return isBlockFormatSupported(cooked.format);
+    }
+
+    // loads the whole cooked mip chain of sourcePath into texture, see readCurrentCookedTexture
+    inline bool loadCookedTexture(const std::string &sourcePath, GLenum target, GLenum imageTarget, GLuint texture) {
+        CookedTexture cooked;
+        if (!readCurrentCookedTexture(sourcePath, cooked))
+            return false;
+
+        glState().BindTexture(0, target, texture);
+        uploadCookedTexture(cooked, imageTarget);
+        glTexParameteri(target, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, (GLint)cooked.levels.size() - 1);
+        applyCookedTextureSwizzle(target, cooked.format);
+        return true;
+    }
+
+}
+
+#endif //PROJECT_BASE_COMPRESSEDTEXTURE_H
@@ -0,0 +1,179 @@
+#ifndef PROJECT_BASE_COOKEDTEXTURE_H
+#define PROJECT_BASE_COOKEDTEXTURE_H
+
+#include <rg/BlockCompression.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Container written by the texture cooker (tools/texture_cooker.cpp) next to every source image as
+// <image>.rgtx. Like KTX it stores the finished GPU format and the whole mip chain, so loading is a
+// file read and one glCompressedTexImage2D per level:
+//
+//   char[4]  "RGTX"
+//   uint32   version
+//   uint32   BlockFormat
+//   uint32   width, height of level 0
+//   uint32   level count
+//   uint64   hash of the source file, see cookedSourceHash
+//   uint64   size of the source file in bytes
+//   int64    modification time of the source file, seconds since the epoch
+//   per level: uint32 width, height, byte size, then the blocks
+//
+// All values are little endian. Size and modification time are compared first; only when they
+// differ is the source read and hashed, and the hash decides, so a file that was touched or checked
+// out again without changing is still current.
+
+namespace rg {
+
+    // 2: colour mips filtered in linear light
+    // 3: size and modification time of the source
+    const uint32_t CookedTextureVersion = 3;
+    // where the source size and modification time are in the file
+    const std::streamoff CookedSourceStampOffset = 32;
+
+    struct CookedLevel {
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> data;
+    };
+
+    struct CookedTexture {
+        BlockFormat format = BlockFormat::BC1;
+        uint64_t sourceHash = 0;
+        uint64_t sourceSize = 0;
+        int64_t sourceModified = 0;
+        std::vector<CookedLevel> levels;
+    };
+
+    inline std::string cookedTexturePath(const std::string &sourcePath) {
+        return sourcePath + ".rgtx";
+    }
+
+    // FNV-1a, plenty for telling edited files apart
+    inline uint64_t hashBytes(const uint8_t *data, size_t size, uint64_t hash = 14695981039346656037ull) {
+        for (size_t i = 0; i < size; i++) {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // hash of the source image and the container version, so a new encoder invalidates old files too
+    inline bool cookedSourceHash(const std::string &sourcePath, uint64_t &hash) {
+        std::ifstream file(sourcePath, std::ios::binary);
+        if (!file)
+            return false;
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        uint32_t version = CookedTextureVersion;
+        hash = hashBytes((const uint8_t *)&version, sizeof(version));
+        hash = hashBytes(bytes.data(), bytes.size(), hash);
+        return true;
+    }
+
+    // size and modification time of the source image, cheap enough to check on every load
+    inline bool cookedSourceStamp(const std::string &sourcePath, uint64_t &size, int64_t &modified) {
+        struct stat info;
+        if (stat(sourcePath.c_str(), &info) != 0)
+            return false;
+        size = (uint64_t)info.st_size;
+        modified = (int64_t)info.st_mtime;
+        return true;
+    }
+
+    // whether the cooked file was made from a source with this size and modification time
+    inline bool cookedStampMatches(const CookedTexture &texture, uint64_t size, int64_t modified) {
+        return texture.sourceSize == size && texture.sourceModified == modified;
+    }
+
+    namespace detail {
+
+        template<typename T>
+        bool readValue(std::istream &in, T &value) {
+            return (bool)in.read((char *)&value, sizeof(T));
+        }
+
+        template<typename T>
+        void writeValue(std::ostream &out, const T &value) {
+            out.write((const char *)&value, sizeof(T));
+        }
+
+    }
+
+    // headerOnly stops after the source stamp, enough for the cooker's up-to-date check
+    inline bool readCookedTexture(const std::string &path, CookedTexture &texture, bool headerOnly = false) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+
+        char magic[4];
+        uint32_t version, format, width, height, levelCount;
+        if (!file.read(magic, 4) || std::string(magic, 4) != "RGTX")
+            return false;
+        if (!detail::readValue(file, version) || version != CookedTextureVersion)
+            return false;
+        if (!detail::readValue(file, format) || !detail::readValue(file, width) || !detail::readValue(file, height) ||
+            !detail::readValue(file, levelCount) || !detail::readValue(file, texture.sourceHash) ||
+            !detail::readValue(file, texture.sourceSize) || !detail::readValue(file, texture.sourceModified))
+            return false;
+        texture.format = (BlockFormat)format;
+        if (headerOnly)
+            return true;
+
+        texture.levels.resize(levelCount);
+        for (CookedLevel &level : texture.levels) {
+            uint32_t size;
+            if (!detail::readValue(file, level.width) || !detail::readValue(file, level.height) || !detail::readValue(file, size))
+                return false;
+            if (size != compressedLevelSize(texture.format, level.width, level.height))
+                return false;
+            level.data.resize(size);
+            if (!file.read((char *)level.data.data(), size))
+                return false;
+        }
+        return !texture.levels.empty() && texture.levels[0].width == width && texture.levels[0].height == height;
+    }
+
+    inline bool writeCookedTexture(const std::string &path, const CookedTexture &texture) {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file || texture.levels.empty())
+            return false;
+
+        file.write("RGTX", 4);
+        detail::writeValue(file, CookedTextureVersion);
+        detail::writeValue(file, (uint32_t)texture.format);
+        detail::writeValue(file, texture.levels[0].width);
+        detail::writeValue(file, texture.levels[0].height);
+        detail::writeValue(file, (uint32_t)texture.levels.size());
+        detail::writeValue(file, texture.sourceHash);
+        detail::writeValue(file, texture.sourceSize);
+        detail::writeValue(file, texture.sourceModified);
+        for (const CookedLevel &level : texture.levels) {
+            detail::writeValue(file, level.width);
+            detail::writeValue(file, level.height);
+            detail::writeValue(file, (uint32_t)level.data.size());
+            file.write((const char *)level.data.data(), level.data.size());
+        }
+        return (bool)file;
+    }
+
+    // rewrites only the source size and modification time of a cooked file whose source hash still
+    // matches, so loads stop hashing a source that was touched without changing
+    inline bool writeCookedSourceStamp(const std::string &path, uint64_t size, int64_t modified) {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        if (!file || !file.seekp(CookedSourceStampOffset))
+            return false;
+        detail::writeValue(file, size);
+        detail::writeValue(file, modified);
+        return (bool)file;
+    }
+
+}
+
+#endif //PROJECT_BASE_COOKEDTEXTURE_H
@@ -0,0 +1,325 @@
+#ifndef PROJECT_BASE_DEPTHPREPASS_H
+#define PROJECT_BASE_DEPTHPREPASS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <imgui.h>
+#include <rg/GLState.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace rg {
+
+    enum class DepthPrepassMode {
+        Off,
+        On,
+        Auto
+    };
+
+    // Decides, per frame, whether laying down depth first and then shading with GL_EQUAL is cheaper
+    // than shading every overlapping fragment.
+    //
+    // The opaque objects are registered with their local bounds and triangle count. Each one is
+    // turned into a world space bounding sphere; spheres outside the view frustum are dropped, the
+    // others are projected to the screen and clipped to the viewport. The summed coverage divided by
+    // the covered area is the estimated depth complexity. Everything above one layer is overdraw that
+    // the pre-pass would save from the expensive fragment shader, while the pre-pass itself costs one
+    // more trip through the vertex stage for every triangle.
+    //
+    // What a fragment and a triangle cost is measured with GL_TIME_ELAPSED queries around the two
+    // passes, read back a few frames later without waiting: the depth pass gives the cost per
+    // triangle, the shading pass the rest per estimated fragment. Auto keeps the pre-pass on until
+    // CalibrationSamples frames were measured and only then starts comparing.
+    class DepthPrepass {
+    public:
+        // fraction of the estimate that has to flip before the decision changes, stops flickering
+        // between modes when the camera sits close to the break-even point
+        float Hysteresis = 0.15f;
+        // measured frames with the pre-pass on before Auto decides
+        unsigned int CalibrationSamples = 30;
+
+        DepthPrepassMode Mode = DepthPrepassMode::Auto;
+
+        // also collects the timer results that arrived since the last frame, on the GL thread
+        void BeginFrame(const glm::mat4 &projection, const glm::mat4 &view, int viewportWidth, int viewportHeight) {
+            m_Projection = projection;
+            m_View = view;
+            m_ViewportWidth = viewportWidth;
+            m_ViewportHeight = viewportHeight;
+            m_CoveredPixels = 0.0f;
+            m_MaxCoverage = 0.0f;
+            m_Triangles = 0.0f;
+
+            // planes of the view frustum, normalised so a sphere can be tested by its radius
+            glm::mat4 m = glm::transpose(projection * view);
+            glm::vec4 planes[6] = {m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[3] + m[2], m[3] - m[2]};
+            for (int p = 0; p < 6; p++)
+                m_Planes[p] = planes[p] / glm::length(glm::vec3(planes[p]));
+
+            collectTimers();
+            m_Timer = (m_Timer + 1) % TimerFrames;
+            // the GPU is more than TimerFrames behind, that frame goes unmeasured
+            m_Timers[m_Timer].pending = false;
+            m_Timers[m_Timer].depthTimed = false;
+        }
+
+        void AddOccluder(const glm::mat4 &model, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, unsigned int triangleCount) {
+            m_Triangles += (float)triangleCount;
+
+            glm::vec3 localCenter = (boundsMin + boundsMax) * 0.5f;
+            glm::vec3 worldCenter = glm::vec3(model * glm::vec4(localCenter, 1.0f));
+            float scale = std::max(glm::length(glm::vec3(model[0])),
+                                   std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+            float radius = glm::length(boundsMax - boundsMin) * 0.5f * scale;
+            for (int p = 0; p < 6; p++) {
+                if (glm::dot(glm::vec3(m_Planes[p]), worldCenter) + m_Planes[p].w < -radius)
+                    return;
+            }
+
+            float screenArea = (float)m_ViewportWidth * (float)m_ViewportHeight;
+            float depth = -(m_View * glm::vec4(worldCenter, 1.0f)).z;
+            float coverage;
+            if (depth <= radius) {
+                // the camera is inside or right against the sphere
+                coverage = screenArea;
+            } else {
+                // the square around the projected circle clipped to the viewport, the circle fills
+                // pi/4 of whatever part of the square is left
+                glm::vec4 clip = m_Projection * m_View * glm::vec4(worldCenter, 1.0f);
+                float centerX = (clip.x / clip.w * 0.5f + 0.5f) * (float)m_ViewportWidth;
+                float centerY = (clip.y / clip.w * 0.5f + 0.5f) * (float)m_ViewportHeight;
+                float pixelRadius = radius * m_Projection[1][1] * 0.5f * (float)m_ViewportHeight / depth;
+                float width = std::min(centerX + pixelRadius, (float)m_ViewportWidth) - std::max(centerX - pixelRadius, 0.0f);
+                float height = std::min(centerY + pixelRadius, (float)m_ViewportHeight) - std::max(centerY - pixelRadius, 0.0f);
+                coverage = width > 0.0f && height > 0.0f ? 0.78539816f * width * height : 0.0f;
+            }
+
+            m_CoveredPixels += coverage;
+            m_MaxCoverage = std::max(m_MaxCoverage, coverage);
+        }
+
+        // returns true when the opaque geometry should go through the depth pre-pass this frame
+        bool Decide() {
+            // the union of all objects covers at least the largest one and at most the screen,
+            // without per-pixel information the midpoint of the two is the estimate
+            float screenArea = (float)m_ViewportWidth * (float)m_ViewportHeight;
+            float unionPixels = 0.5f * (m_MaxCoverage + std::min(m_CoveredPixels, screenArea));
+            float overdrawPixels = std::max(m_CoveredPixels - unionPixels, 0.0f);
+            m_DepthComplexity = unionPixels > 0.0f ? m_CoveredPixels / unionPixels : 0.0f;
+
+            bool enabled = m_Enabled;
+            switch (Mode) {
+                case DepthPrepassMode::Off: enabled = false; break;
+                case DepthPrepassMode::On: enabled = true; break;
+                case DepthPrepassMode::Auto: {
+                    if (!Calibrated()) {
+                        enabled = true;
+                        break;
+                    }
+                    double saved = overdrawPixels * m_FragmentNanoseconds;
+                    double cost = m_Triangles * m_TriangleNanoseconds;
+                    if (m_Enabled)
+                        enabled = saved > cost * (1.0f - Hysteresis);
+                    else
+                        enabled = saved > cost * (1.0f + Hysteresis);
+                    m_AutoFrames++;
+                    m_DepthComplexitySum += m_DepthComplexity;
+                    m_DepthComplexityMax = std::max(m_DepthComplexityMax, m_DepthComplexity);
+                } break;
+            }
+
+            m_Frames++;
+            if (enabled)
+                m_EnabledFrames++;
+            if (enabled != m_Enabled)
+                m_Switches++;
+            m_Enabled = enabled;
+
+            TimerFrame &timer = m_Timers[m_Timer];
+            timer.enabled = m_Enabled;
+            timer.triangles = m_Triangles;
+            timer.coveredPixels = m_CoveredPixels;
+            timer.unionPixels = unionPixels;
+            return m_Enabled;
+        }
+
+        // around the draws of the depth pass, when Decide enabled it
+        void BeginDepthPass() {
+            createTimers();
+            glBeginQuery(GL_TIME_ELAPSED, m_Timers[m_Timer].depthQuery);
+        }
+
+        void EndDepthPass() {
+            glEndQuery(GL_TIME_ELAPSED);
+            m_Timers[m_Timer].depthTimed = true;
+        }
+
+        // state for the shading pass: only fragments that won the pre-pass are shaded
+        void BeginShadingPass() {
+            createTimers();
+            glBeginQuery(GL_TIME_ELAPSED, m_Timers[m_Timer].shadingQuery);
+            if (!m_Enabled)
+                return;
+            glState().DepthFunc(GL_EQUAL);
+            glState().DepthMask(GL_FALSE);
+        }
+
+        void EndShadingPass() {
+            glEndQuery(GL_TIME_ELAPSED);
+            TimerFrame &timer = m_Timers[m_Timer];
+            timer.pending = !timer.enabled || timer.depthTimed;
+            if (!m_Enabled)
+                return;
+            glState().DepthFunc(GL_LESS);
+            glState().DepthMask(GL_TRUE);
+        }
+
+        // once both costs were measured often enough for Auto to rely on them
+        bool Calibrated() const {
+            return m_TriangleSamples >= CalibrationSamples && m_FragmentSamples >= CalibrationSamples;
+        }
+
+        void Release() {
+            for (TimerFrame &timer : m_Timers) {
+                if (timer.depthQuery)
+                    glDeleteQueries(1, &timer.depthQuery);
+                if (timer.shadingQuery)
+                    glDeleteQueries(1, &timer.shadingQuery);
+                timer = TimerFrame();
+            }
+            m_TimersCreated = false;
+        }
+
+        bool IsEnabled() const {
+            return m_Enabled;
+        }
+
+        float GetDepthComplexity() const {
+            return m_DepthComplexity;
+        }
+
+        // the decision of the last frame, for the debug overlay
+        void DrawOverlay() const {
+            ImGui::SetNextWindowPos(ImVec2(10.0f, 320.0f), ImGuiCond_FirstUseEver);
+            if (!ImGui::Begin("Depth pre-pass")) {
+                ImGui::End();
+                return;
+            }
+            const char *mode = Mode == DepthPrepassMode::Off ? "off" : Mode == DepthPrepassMode::On ? "on" : "auto";
+            ImGui::Text("mode %s, %s, estimated depth complexity %.2f", mode, m_Enabled ? "enabled" : "disabled",
+                        m_DepthComplexity);
+            ImGui::Text("switched %llu times", m_Switches);
+            if (Calibrated())
+                ImGui::Text("measured %.3f ns per fragment, %.3f ns per triangle", m_FragmentNanoseconds, m_TriangleNanoseconds);
+            else
+                ImGui::Text("calibrating, %u and %u of %u samples", m_FragmentSamples, m_TriangleSamples, CalibrationSamples);
+            ImGui::End();
+        }
+
+        void PrintStats(std::ostream &out) const {
+            if (m_Frames == 0)
+                return;
+            out << "DEPTH_PREPASS:: enabled in " << m_EnabledFrames << " of " << m_Frames << " frames, switched "
+                << m_Switches << " times";
+            if (m_AutoFrames > 0)
+                out << ", estimated depth complexity " << m_DepthComplexitySum / m_AutoFrames << " on average, "
+                    << m_DepthComplexityMax << " at most";
+            out << std::endl;
+            if (m_FragmentSamples > 0 || m_TriangleSamples > 0)
+                out << "DEPTH_PREPASS:: measured " << m_FragmentNanoseconds << " ns per fragment over " << m_FragmentSamples
+                    << " frames, " << m_TriangleNanoseconds << " ns per triangle over " << m_TriangleSamples << " frames"
+                    << std::endl;
+        }
+
+    private:
+        // the queries and estimates of one frame, read back TimerFrames frames later at the latest
+        struct TimerFrame {
+            GLuint depthQuery = 0;
+            GLuint shadingQuery = 0;
+            bool pending = false;
+            bool depthTimed = false;
+            bool enabled = false;
+            float triangles = 0.0f;
+            float coveredPixels = 0.0f;
+            float unionPixels = 0.0f;
+        };
+        static const int TimerFrames = 4;
+
+        glm::mat4 m_Projection = glm::mat4(1.0f);
+        glm::mat4 m_View = glm::mat4(1.0f);
+        int m_ViewportWidth = 1;
+        int m_ViewportHeight = 1;
+
+        float m_CoveredPixels = 0.0f;
+        float m_MaxCoverage = 0.0f;
+        float m_Triangles = 0.0f;
+        float m_DepthComplexity = 0.0f;
+        bool m_Enabled = false;
+
+        unsigned long long m_Frames = 0;
+        unsigned long long m_EnabledFrames = 0;
+        unsigned long long m_Switches = 0;
+        // frames decided in Auto, the only ones with an estimate
+        unsigned long long m_AutoFrames = 0;
+        double m_DepthComplexitySum = 0.0;
+        float m_DepthComplexityMax = 0.0f;
+
+        glm::vec4 m_Planes[6];
+        TimerFrame m_Timers[TimerFrames];
+        int m_Timer = 0;
+        bool m_TimersCreated = false;
+        // running averages of the measured costs
+        double m_FragmentNanoseconds = 0.0;
+        double m_TriangleNanoseconds = 0.0;
+        unsigned int m_FragmentSamples = 0;
+        unsigned int m_TriangleSamples = 0;
+
+        void createTimers() {
+            if (m_TimersCreated)
+                return;
+            for (TimerFrame &timer : m_Timers) {
+                glGenQueries(1, &timer.depthQuery);
+                glGenQueries(1, &timer.shadingQuery);
+            }
+            m_TimersCreated = true;
+        }
+
+        static void average(double &value, unsigned int &samples, double sample) {
+            samples++;
+            value = samples == 1 ? sample : value + (sample - value) * 0.05;
+        }
+
+        // With the pre-pass the depth pass is the triangles alone, and the shading pass is the same
+        // triangles again plus one fragment per covered pixel. Without it the shading pass is the
+        // triangles plus every overlapping fragment, which needs the triangle cost to be known.
+        void collectTimers() {
+            for (TimerFrame &timer : m_Timers) {
+                if (!timer.pending)
+                    continue;
+                GLuint available = 0;
+                glGetQueryObjectuiv(timer.shadingQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                    continue;
+                timer.pending = false;
+                GLuint64 shading = 0, depth = 0;
+                glGetQueryObjectui64v(timer.shadingQuery, GL_QUERY_RESULT, &shading);
+                if (timer.enabled) {
+                    glGetQueryObjectui64v(timer.depthQuery, GL_QUERY_RESULT, &depth);
+                    if (timer.triangles > 0.0f)
+                        average(m_TriangleNanoseconds, m_TriangleSamples, (double)depth / timer.triangles);
+                    if (timer.unionPixels > 0.0f)
+                        average(m_FragmentNanoseconds, m_FragmentSamples,
+                                std::max((double)shading - (double)depth, 0.0) / timer.unionPixels);
+                } else if (m_TriangleSamples > 0 && timer.coveredPixels > 0.0f) {
+                    average(m_FragmentNanoseconds, m_FragmentSamples,
+                            std::max((double)shading - timer.triangles * m_TriangleNanoseconds, 0.0) / timer.coveredPixels);
+                }
+            }
+        }
+    };
+
+}
+
+#endif //PROJECT_BASE_DEPTHPREPASS_H
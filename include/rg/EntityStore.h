@@ -0,0 +1,478 @@
+#ifndef PROJECT_BASE_ENTITYSTORE_H
+#define PROJECT_BASE_ENTITYSTORE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <rg/GeometryArena.h>
+#include <rg/TransformKernel.h>
+#include <rg/WorkerPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace rg {
+
+    typedef unsigned int Entity;
+    const unsigned int NoComponent = ~0u;
+
+    // Maps entities to the dense index of their component in one pool and back. Components are
+    // packed: removing one moves the last into its slot, so systems always walk [0, Size()).
+    class ComponentIndex {
+    public:
+        unsigned int Find(Entity entity) const { return entity < m_Dense.size() ? m_Dense[entity] : NoComponent; }
+        bool Has(Entity entity) const { return Find(entity) != NoComponent; }
+        Entity EntityAt(unsigned int index) const { return m_Entities[index]; }
+        unsigned int Size() const { return (unsigned int)m_Entities.size(); }
+
+        unsigned int Insert(Entity entity) {
+            if (entity >= m_Dense.size())
+                m_Dense.resize(entity + 1, NoComponent);
+            m_Dense[entity] = (unsigned int)m_Entities.size();
+            m_Entities.push_back(entity);
+            return m_Dense[entity];
+        }
+
+        // returns the slot that was freed, the pool moves the data of its last component there
+        unsigned int Erase(Entity entity) {
+            unsigned int index = m_Dense[entity];
+            Entity last = m_Entities.back();
+            m_Entities[index] = last;
+            m_Dense[last] = index;
+            m_Dense[entity] = NoComponent;
+            m_Entities.pop_back();
+            return index;
+        }
+
+    private:
+        std::vector<unsigned int> m_Dense;
+        std::vector<Entity> m_Entities;
+    };
+
+    // moves the last element into index and drops the last, the data side of ComponentIndex::Erase
+    template<typename T>
+    void eraseSwap(std::vector<T> &values, unsigned int index) {
+        values[index] = values.back();
+        values.pop_back();
+    }
+
+    // procedural motion: a circle of radius around center in the xz plane at speed radians per
+    // second, bobbing height up and down with it, while spinning around spinAxis after baseRotation
+    struct Animation {
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+        float height = 0.0f;
+        float speed = 0.0f;
+        float phase = 0.0f;
+        glm::quat baseRotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+        glm::vec3 spinAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+        float spinSpeed = 0.0f;
+    };
+
+    enum class LightType {
+        Point,
+        Spot
+    };
+
+    // what the light system gathers every frame, in component order
+    struct LightInstance {
+        Entity entity;
+        LightType type;
+        glm::vec3 position;
+        glm::vec3 color;
+    };
+
+    // what the renderable system gathers every frame per batch, ready to be copied into instance buffers
+    struct RenderInstance {
+        glm::mat4 model;
+        NormalMatrix normal;
+        glm::vec4 material;
+    };
+
+    // Entities and their components, each kind in a pool of its own with one array per field.
+    //
+    // Update runs the systems in a fixed order, every one a linear walk over the arrays it needs:
+    // animation writes the transforms it drives, the transform system turns the dirty ones into world
+    // matrices, then lights and renderables are gathered from them. With Parallel the animation and
+    // transform systems are split into ranges of at least Grain components on the worker pool; pools
+    // smaller than that run on the calling thread.
+    //
+    // With a fixed simulation step, Update advances the scene by one step and Interpolate places the
+    // transforms the last step moved between where that step found and left them, for frames that
+    // fall between two steps. The next Update carries on from the stepped transforms.
+    //
+    // Animations are only run again when the time moves on, so a scene whose clock stands still and
+    // whose transforms nobody sets stops moving, which Moving and Version tell the renderer.
+    class EntityStore {
+    public:
+        bool Parallel = true;
+        size_t Grain = 4096;
+
+        Entity Create() { return m_NextEntity++; }
+
+        // removes every component of the entity; the id is not reused
+        void Destroy(Entity entity) {
+            if (m_Transforms.index.Has(entity)) {
+                unsigned int index = m_Transforms.index.Erase(entity);
+                m_Transforms.local.EraseSwap(index);
+                m_Transforms.previous.EraseSwap(index);
+                m_Transforms.blend.EraseSwap(index);
+                eraseSwap(m_Transforms.world, index);
+                eraseSwap(m_Transforms.normal, index);
+                eraseSwap(m_Transforms.dirty, index);
+                eraseSwap(m_Transforms.moved, index);
+                m_Touched = true;
+            }
+            if (m_Animations.index.Has(entity)) {
+                unsigned int index = m_Animations.index.Erase(entity);
+                eraseSwap(m_Animations.center, index);
+                eraseSwap(m_Animations.orbit, index);
+                eraseSwap(m_Animations.baseRotation, index);
+                eraseSwap(m_Animations.spin, index);
+            }
+            if (m_Lights.index.Has(entity)) {
+                unsigned int index = m_Lights.index.Erase(entity);
+                eraseSwap(m_Lights.type, index);
+                eraseSwap(m_Lights.color, index);
+            }
+            if (m_Renderables.index.Has(entity)) {
+                unsigned int index = m_Renderables.index.Erase(entity);
+                eraseSwap(m_Renderables.batch, index);
+                eraseSwap(m_Renderables.geometry, index);
+                eraseSwap(m_Renderables.material, index);
+            }
+        }
+
+        void AddTransform(Entity entity, const glm::vec3 &position,
+                          const glm::quat &rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                          const glm::vec3 &scale = glm::vec3(1.0f)) {
+            m_Transforms.index.Insert(entity);
+            m_Transforms.local.Push(position, rotation, scale);
+            m_Transforms.previous.Push(position, rotation, scale);
+            m_Transforms.blend.Push(position, rotation, scale);
+            m_Transforms.world.push_back(glm::mat4(1.0f));
+            m_Transforms.normal.push_back(NormalMatrix());
+            m_Transforms.dirty.push_back(Changed);
+            m_Transforms.moved.push_back(0);
+            m_Touched = true;
+        }
+
+        void SetTransform(Entity entity, const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale) {
+            unsigned int index = m_Transforms.index.Find(entity);
+            m_Transforms.local.SetPosition(index, position);
+            m_Transforms.local.SetRotation(index, rotation);
+            m_Transforms.local.SetScale(index, scale);
+            m_Transforms.dirty[index] = Changed;
+            m_Touched = true;
+        }
+
+        // the entity needs a transform, which the animation overwrites every Update
+        void AddAnimation(Entity entity, const Animation &animation) {
+            m_Animations.index.Insert(entity);
+            m_Animations.center.push_back(animation.center);
+            m_Animations.orbit.push_back(glm::vec4(animation.radius, animation.height, animation.speed, animation.phase));
+            m_Animations.baseRotation.push_back(animation.baseRotation);
+            m_Animations.spin.push_back(glm::vec4(animation.spinAxis, animation.spinSpeed));
+            m_Animated = false;
+        }
+
+        // the light sits at the position of the entity's transform
+        void AddLight(Entity entity, LightType type, const glm::vec3 &color) {
+            m_Lights.index.Insert(entity);
+            m_Lights.type.push_back(type);
+            m_Lights.color.push_back(color);
+        }
+
+        // batch groups renderables drawn together, material is passed through to the instance data
+        void AddRenderable(Entity entity, unsigned int batch, const GeometryAllocation &geometry,
+                           const glm::vec4 &material = glm::vec4(0.0f)) {
+            m_Renderables.index.Insert(entity);
+            m_Renderables.batch.push_back(batch);
+            m_Renderables.geometry.push_back(geometry);
+            m_Renderables.material.push_back(material);
+            if (batch >= m_Batches.size())
+                m_Batches.resize(batch + 1);
+        }
+
+        // world matrix as of the last Update or Interpolate
+        const glm::mat4 &World(Entity entity) const { return m_Transforms.world[m_Transforms.index.Find(entity)]; }
+        const NormalMatrix &Normal(Entity entity) const { return m_Transforms.normal[m_Transforms.index.Find(entity)]; }
+
+        // runs every system once, time in seconds drives the animations
+        void Update(double time) {
+            auto start = std::chrono::steady_clock::now();
+            beginStep();
+            bool wasMoving = m_Moving;
+            m_Moving = m_Touched;
+            m_Touched = false;
+            if (!m_Animated || time != m_AnimationTime) {
+                updateAnimations(time);
+                m_Animated = true;
+                m_AnimationTime = time;
+                m_Moving = m_Moving || m_Animations.index.Size() > 0;
+            }
+            // the Update after the last one that moved something still puts it where it came to rest
+            if (m_Moving || wasMoving)
+                m_Version++;
+            auto animated = std::chrono::steady_clock::now();
+            updateTransforms();
+            auto transformed = std::chrono::steady_clock::now();
+            gatherLights();
+            gatherRenderables();
+            auto gathered = std::chrono::steady_clock::now();
+
+            m_Stats.animationMilliseconds = std::chrono::duration<double, std::milli>(animated - start).count();
+            m_Stats.transformMilliseconds = std::chrono::duration<double, std::milli>(transformed - animated).count();
+            m_Stats.gatherMilliseconds = std::chrono::duration<double, std::milli>(gathered - transformed).count();
+        }
+
+        // alpha 0 puts the transforms the last Update moved back where they were before it, 1 where it
+        // left them; lights and renderables are gathered again
+        void Interpolate(float alpha) {
+            TransformPool &transforms = m_Transforms;
+            forRanges(transforms.index.Size(), [&transforms, alpha](size_t begin, size_t end) {
+                forEachRun(transforms.moved.data(), begin, end, [&transforms, alpha](size_t first, size_t last) {
+                    for (size_t i = first; i < last; i++) {
+                        if (transforms.moved[i])
+                            transforms.blend.Blend(i, transforms.previous, transforms.local, alpha);
+                        else
+                            transforms.blend.Copy(i, transforms.local);
+                    }
+                    composeTransforms(transforms.blend, first, last, transforms.world.data(), transforms.normal.data());
+                });
+            });
+            gatherLights();
+            gatherRenderables();
+        }
+
+        const std::vector<LightInstance> &Lights() const { return m_LightInstances; }
+        // renderables of one batch, in component order
+        const std::vector<RenderInstance> &Batch(unsigned int batch) const { return m_Batches[batch]; }
+
+        // the last Update moved a transform, every Interpolate until the next one places it elsewhere
+        bool Moving() const { return m_Moving; }
+        // counts the Updates that changed a world matrix, it stays put while the scene is at rest
+        unsigned long long Version() const { return m_Version; }
+
+        unsigned int EntityCount() const { return m_NextEntity; }
+        unsigned int TransformCount() const { return m_Transforms.index.Size(); }
+
+        // time each group of systems took in the last Update
+        struct Stats {
+            double animationMilliseconds = 0.0;
+            double transformMilliseconds = 0.0;
+            double gatherMilliseconds = 0.0;
+        };
+        const Stats &LastStats() const { return m_Stats; }
+
+    private:
+        // values of TransformPool::dirty: the local transform was set, or only the world matrix is stale
+        enum : unsigned char {
+            Changed = 1,
+            Rebuild = 2
+        };
+        static constexpr double TwoPi = 6.283185307179586;
+
+        struct TransformPool {
+            ComponentIndex index;
+            TransformArrays local;
+            // local as it was before the last Update, what the transforms it moved are blended from
+            TransformArrays previous;
+            TransformArrays blend;
+            std::vector<glm::mat4> world;
+            std::vector<NormalMatrix> normal;
+            std::vector<unsigned char> dirty;
+            // local was set during the last Update
+            std::vector<unsigned char> moved;
+        };
+
+        struct AnimationPool {
+            ComponentIndex index;
+            std::vector<glm::vec3> center;
+            // radius, height, speed, phase
+            std::vector<glm::vec4> orbit;
+            std::vector<glm::quat> baseRotation;
+            // axis and speed
+            std::vector<glm::vec4> spin;
+        };
+
+        struct LightPool {
+            ComponentIndex index;
+            std::vector<LightType> type;
+            std::vector<glm::vec3> color;
+        };
+
+        struct RenderablePool {
+            ComponentIndex index;
+            std::vector<unsigned int> batch;
+            std::vector<GeometryAllocation> geometry;
+            std::vector<glm::vec4> material;
+        };
+
+        Entity m_NextEntity = 0;
+        TransformPool m_Transforms;
+        AnimationPool m_Animations;
+        LightPool m_Lights;
+        RenderablePool m_Renderables;
+        std::vector<LightInstance> m_LightInstances;
+        std::vector<std::vector<RenderInstance>> m_Batches;
+        Stats m_Stats;
+
+        // a transform was added, set or removed since the last Update
+        bool m_Touched = false;
+        bool m_Moving = false;
+        unsigned long long m_Version = 0;
+        // the animations were run for m_AnimationTime and none were added since
+        bool m_Animated = false;
+        double m_AnimationTime = 0.0;
+
+        template<typename Function>
+        void forRanges(size_t count, const Function &function) {
+            if (Parallel)
+                parallelFor(workerPool(), count, Grain, function);
+            else if (count > 0)
+                function((size_t)0, count);
+        }
+
+        // the angles are taken in double and wrapped before they go to float, so they stay exact
+        // however long the scene has been running
+        void updateAnimations(double time) {
+            AnimationPool &animations = m_Animations;
+            TransformPool &transforms = m_Transforms;
+            forRanges(animations.index.Size(), [&animations, &transforms, time](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    unsigned int transform = transforms.index.Find(animations.index.EntityAt((unsigned int)i));
+                    const glm::vec4 &orbit = animations.orbit[i];
+                    const glm::vec4 &spin = animations.spin[i];
+                    float angle = (float)std::fmod((double)orbit.z * time + orbit.w, TwoPi);
+                    transforms.local.SetPosition(transform, animations.center[i] +
+                            glm::vec3(orbit.x * std::cos(angle), orbit.y * std::sin(angle), orbit.x * std::sin(angle)));
+                    transforms.local.SetRotation(transform, spin.w == 0.0f ? animations.baseRotation[i] :
+                            animations.baseRotation[i] * glm::angleAxis((float)std::fmod((double)spin.w * time, TwoPi), glm::vec3(spin)));
+                    transforms.dirty[transform] = Changed;
+                }
+            });
+        }
+
+        // what the last step moved starts this one where that step left it: previous catches up and
+        // the world matrix an Interpolate may have left is rebuilt from local
+        void beginStep() {
+            TransformPool &transforms = m_Transforms;
+            forRanges(transforms.index.Size(), [&transforms](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) {
+                    if (!transforms.moved[i])
+                        continue;
+                    transforms.previous.Copy(i, transforms.local);
+                    transforms.moved[i] = 0;
+                    if (!transforms.dirty[i])
+                        transforms.dirty[i] = Rebuild;
+                }
+            });
+        }
+
+        // Calls function(first, last) on the runs of set flags in [begin, end). Clean gaps shorter than
+        // a kernel step are taken into the run around them rather than splitting it.
+        template<typename Function>
+        static void forEachRun(const unsigned char *flags, size_t begin, size_t end, const Function &function) {
+            const size_t gap = 8;
+            size_t i = begin;
+            while (i < end) {
+                while (i < end && !flags[i])
+                    i++;
+                if (i == end)
+                    break;
+                size_t last = i;
+                for (size_t j = i + 1; j < end && j - last <= gap; j++)
+                    if (flags[j])
+                        last = j;
+                function(i, last + 1);
+                i = last + 1;
+            }
+        }
+
+        // runs of dirty transforms go through the batched kernel, the ones whose local transform was set
+        // count as moved for Interpolate
+        void updateTransforms() {
+            TransformPool &transforms = m_Transforms;
+            forRanges(transforms.index.Size(), [&transforms](size_t begin, size_t end) {
+                forEachRun(transforms.dirty.data(), begin, end, [&transforms](size_t first, size_t last) {
+                    composeTransforms(transforms.local, first, last, transforms.world.data(), transforms.normal.data());
+                    for (size_t i = first; i < last; i++) {
+                        transforms.moved[i] = transforms.dirty[i] == Changed ? 1 : 0;
+                        transforms.dirty[i] = 0;
+                    }
+                });
+            });
+        }
+
+        void gatherLights() {
+            m_LightInstances.clear();
+            for (unsigned int i = 0; i < m_Lights.index.Size(); i++) {
+                Entity entity = m_Lights.index.EntityAt(i);
+                unsigned int transform = m_Transforms.index.Find(entity);
+                glm::vec3 position = transform == NoComponent ? glm::vec3(0.0f) : glm::vec3(m_Transforms.world[transform][3]);
+                m_LightInstances.push_back({entity, m_Lights.type[i], position, m_Lights.color[i]});
+            }
+        }
+
+        void gatherRenderables() {
+            for (std::vector<RenderInstance> &batch : m_Batches)
+                batch.clear();
+            for (unsigned int i = 0; i < m_Renderables.index.Size(); i++) {
+                unsigned int transform = m_Transforms.index.Find(m_Renderables.index.EntityAt(i));
+                if (transform == NoComponent)
+                    continue;
+                m_Batches[m_Renderables.batch[i]].push_back({m_Transforms.world[transform], m_Transforms.normal[transform],
+                                                              m_Renderables.material[i]});
+            }
+        }
+    };
+
+    // Times EntityStore::Update on stores of growing size, every entity animated, one in ten
+    // renderable and one in a hundred a light, on one thread and on the worker pool. The time per
+    // entity staying flat as the count grows is what keeps 100k entities affordable.
+    inline void benchmarkEntityStore(std::ostream &out, int runs = 20) {
+        out << "ENTITY_BENCHMARK:: average of " << runs << " updates, " << workerPool().ThreadCount() + 1
+            << " threads when parallel" << std::endl;
+        const unsigned int counts[] = {1000, 10000, 100000};
+        for (unsigned int count : counts) {
+            for (int parallel = 0; parallel < 2; parallel++) {
+                EntityStore store;
+                store.Parallel = parallel != 0;
+                for (unsigned int i = 0; i < count; i++) {
+                    Entity entity = store.Create();
+                    store.AddTransform(entity, glm::vec3(0.0f));
+                    Animation animation;
+                    animation.center = glm::vec3((float)(i % 100), 0.0f, (float)(i / 100));
+                    animation.radius = 0.5f;
+                    animation.height = 0.25f;
+                    animation.speed = 1.0f + (float)(i % 7) * 0.1f;
+                    animation.phase = (float)i;
+                    animation.spinSpeed = 2.0f;
+                    store.AddAnimation(entity, animation);
+                    if (i % 10 == 0)
+                        store.AddRenderable(entity, i % 4, GeometryAllocation(), glm::vec4((float)(i % 3)));
+                    if (i % 100 == 0)
+                        store.AddLight(entity, LightType::Point, glm::vec3(1.0f));
+                }
+
+                double animation = 0.0, transform = 0.0, gather = 0.0;
+                for (int run = 0; run < runs; run++) {
+                    store.Update((float)run * 0.016f);
+                    animation += store.LastStats().animationMilliseconds;
+                    transform += store.LastStats().transformMilliseconds;
+                    gather += store.LastStats().gatherMilliseconds;
+                }
+                double total = (animation + transform + gather) / runs;
+                out << "  " << count << " entities, " << (parallel ? "parallel" : "serial  ") << "  " << total
+                    << " ms per update (animation " << animation / runs << ", transforms " << transform / runs
+                    << ", gather " << gather / runs << "), " << total * 1.0e6 / count << " ns per entity" << std::endl;
+            }
+        }
+    }
+
+}
+
+#endif //PROJECT_BASE_ENTITYSTORE_H
@@ -0,0 +1,194 @@
+#ifndef PROJECT_BASE_FRAMEARENA_H
+#define PROJECT_BASE_FRAMEARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace rg {
+
+    // A linear allocator for temporaries that live no longer than a frame: Allocate bumps an offset,
+    // nothing is freed one by one, and Reset hands all of it back at once. When a frame needs more
+    // than the block holds, further blocks are chained on, and the next Reset folds them into one
+    // block of the combined size, so after a few frames the arena stops touching the heap. Blocks
+    // come from malloc directly, apart from the operator new the rest of the program goes through.
+    // One arena belongs to one thread.
+    class FrameArena {
+    public:
+        // where Rewind goes back to
+        struct Marker {
+            size_t block;
+            size_t offset;
+            size_t base;
+        };
+
+        explicit FrameArena(size_t capacity = 256 * 1024) {
+            addBlock(capacity);
+        }
+
+        FrameArena(const FrameArena &) = delete;
+        FrameArena &operator=(const FrameArena &) = delete;
+
+        ~FrameArena() {
+            for (Block &block : m_Blocks)
+                std::free(block.data);
+        }
+
+        // alignment is a power of two
+        void *Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+            for (;;) {
+                Block &block = m_Blocks[m_Block];
+                uintptr_t address = (uintptr_t)block.data + m_Offset;
+                size_t start = m_Offset + (size_t)((alignment - address % alignment) % alignment);
+                if (start + size <= block.size) {
+                    m_Offset = start + size;
+                    if (m_Base + m_Offset > m_HighWater)
+                        m_HighWater = m_Base + m_Offset;
+                    return block.data + start;
+                }
+                if (m_Block + 1 == m_Blocks.size()) {
+                    addBlock(std::max(block.size * 2, size + alignment));
+                    m_Overflows++;
+                }
+                m_Base += m_Blocks[m_Block].size;
+                m_Block++;
+                m_Offset = 0;
+            }
+        }
+
+        template<typename T>
+        T *AllocateArray(size_t count) {
+            return (T *)Allocate(count * sizeof(T), alignof(T));
+        }
+
+        // everything allocated since the last Reset is gone, overflow blocks are merged
+        void Reset() {
+            if (m_Blocks.size() > 1) {
+                size_t capacity = Capacity();
+                for (Block &block : m_Blocks)
+                    std::free(block.data);
+                m_Blocks.clear();
+                addBlock(capacity);
+            }
+            m_Block = 0;
+            m_Offset = 0;
+            m_Base = 0;
+        }
+
+        Marker Mark() const {
+            return {m_Block, m_Offset, m_Base};
+        }
+
+        // gives back what was allocated after marker was taken
+        void Rewind(const Marker &marker) {
+            m_Block = marker.block;
+            m_Offset = marker.offset;
+            m_Base = marker.base;
+        }
+
+        size_t Used() const { return m_Base + m_Offset; }
+        // most bytes in use at once since the arena was created
+        size_t HighWater() const { return m_HighWater; }
+        // blocks chained on because the arena ran full, each one is a heap allocation
+        unsigned int Overflows() const { return m_Overflows; }
+
+        size_t Capacity() const {
+            size_t capacity = 0;
+            for (const Block &block : m_Blocks)
+                capacity += block.size;
+            return capacity;
+        }
+
+    private:
+        struct Block {
+            unsigned char *data;
+            size_t size;
+        };
+
+        std::vector<Block> m_Blocks;
+        size_t m_Block = 0;
+        size_t m_Offset = 0;
+        // bytes in the blocks before the current one
+        size_t m_Base = 0;
+        size_t m_HighWater = 0;
+        unsigned int m_Overflows = 0;
+
+        void addBlock(size_t size) {
+            unsigned char *data = (unsigned char *)std::malloc(size);
+            if (!data)
+                throw std::bad_alloc();
+            m_Blocks.push_back({data, size});
+        }
+    };
+
+    // Rewinds arena to where it was on construction, for temporaries of a task on a thread without
+    // frames of its own.
+    class ArenaScope {
+    public:
+        explicit ArenaScope(FrameArena &arena) : m_Arena(arena), m_Marker(arena.Mark()) {}
+        ArenaScope(const ArenaScope &) = delete;
+        ArenaScope &operator=(const ArenaScope &) = delete;
+        ~ArenaScope() { m_Arena.Rewind(m_Marker); }
+
+    private:
+        FrameArena &m_Arena;
+        FrameArena::Marker m_Marker;
+    };
+
+    // the renderer's arena, reset at the start of every frame; only the thread that draws uses it
+    inline FrameArena &frameArena() {
+        static FrameArena arena;
+        return arena;
+    }
+
+    // one arena per thread for worker tasks, used under an ArenaScope
+    inline FrameArena &threadArena() {
+        static thread_local FrameArena arena(64 * 1024);
+        return arena;
+    }
+
+    // Lets standard containers take their memory from an arena. deallocate does nothing, so memory a
+    // growing vector leaves behind stays used until the arena is reset; reserve up front where the
+    // size is known.
+    template<typename T>
+    class ArenaAllocator {
+    public:
+        typedef T value_type;
+
+        ArenaAllocator() noexcept : m_Arena(&frameArena()) {}
+        explicit ArenaAllocator(FrameArena &arena) noexcept : m_Arena(&arena) {}
+        template<typename U>
+        ArenaAllocator(const ArenaAllocator<U> &other) noexcept : m_Arena(other.Arena()) {}
+
+        T *allocate(size_t count) {
+            return m_Arena->AllocateArray<T>(count);
+        }
+
+        void deallocate(T *, size_t) noexcept {}
+
+        FrameArena *Arena() const noexcept { return m_Arena; }
+
+    private:
+        FrameArena *m_Arena;
+    };
+
+    template<typename T, typename U>
+    bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) noexcept {
+        return a.Arena() == b.Arena();
+    }
+
+    template<typename T, typename U>
+    bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) noexcept {
+        return a.Arena() != b.Arena();
+    }
+
+    // a vector in the frame arena unless given another one, valid until that arena is reset
+    template<typename T>
+    using FrameVector = std::vector<T, ArenaAllocator<T>>;
+
+}
+
+#endif //PROJECT_BASE_FRAMEARENA_H
@@ -0,0 +1,82 @@
+#ifndef PROJECT_BASE_FRAMECLOCK_H
+#define PROJECT_BASE_FRAMECLOCK_H
+
+#include <chrono>
+
+namespace rg {
+
+    // Time for the simulation side of the frame loop.
+    //
+    // Tick takes one monotonic snapshot per frame, in double seconds since the clock was made, which
+    // everything in the frame reads instead of asking for the time again. The simulation advances in
+    // fixed steps of Step seconds: Tick says how many are due, NextStep hands out their times, and
+    // Alpha is how far the frame is past the last one, for interpolating what is drawn. Step times
+    // are multiples of Step counted in integers, so they do not drift however long the clock runs,
+    // and the same input gives the same simulation whatever the frame rate.
+    class FrameClock {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        double Step;
+        // steps one Tick may ask for; time beyond that, after a stall, is dropped rather than caught up
+        unsigned int MaxSteps = 8;
+
+        explicit FrameClock(double step) : Step(step), m_Start(Clock::now()), m_Now(m_Start) {}
+
+        // snapshots the time for this frame, returns how many steps are due
+        unsigned int Tick() {
+            m_Now = Clock::now();
+            double time = std::chrono::duration<double>(m_Now - m_Start).count();
+            m_Delta = time - m_Time;
+            m_Time = time;
+
+            unsigned long long due = (unsigned long long)(m_Time / Step);
+            unsigned long long steps = due > m_Steps + m_DroppedSteps ? due - m_Steps - m_DroppedSteps : 0;
+            if (steps > MaxSteps) {
+                m_DroppedSteps += steps - MaxSteps;
+                steps = MaxSteps;
+            }
+            return (unsigned int)steps;
+        }
+
+        // runs one of the steps Tick asked for, returns the simulation time at its end; steps not run
+        // are asked for again by the next Tick
+        double NextStep() {
+            m_Steps++;
+            return SimulationTime();
+        }
+
+        Clock::time_point Now() const { return m_Now; }
+        // seconds since the clock was made, as of the last Tick
+        double Time() const { return m_Time; }
+        // seconds between the last two Ticks
+        double Delta() const { return m_Delta; }
+
+        // where the last step left the simulation
+        double SimulationTime() const { return (double)m_Steps * Step; }
+
+        // how far the frame is from the last step towards the next, 0 to 1
+        float Alpha() const {
+            double alpha = m_Time / Step - (double)(m_Steps + m_DroppedSteps);
+            return alpha < 0.0 ? 0.0f : alpha > 1.0 ? 1.0f : (float)alpha;
+        }
+
+        // the simulation time Alpha puts the frame at
+        double InterpolatedTime() const { return SimulationTime() - Step + Alpha() * Step; }
+
+        unsigned long long Steps() const { return m_Steps; }
+        unsigned long long DroppedSteps() const { return m_DroppedSteps; }
+
+    private:
+        Clock::time_point m_Start;
+        Clock::time_point m_Now;
+        double m_Time = 0.0;
+        double m_Delta = 0.0;
+        unsigned long long m_Steps = 0;
+        // given up after stalls, the simulation runs that many steps behind the wall clock
+        unsigned long long m_DroppedSteps = 0;
+    };
+
+}
+
+#endif //PROJECT_BASE_FRAMECLOCK_H
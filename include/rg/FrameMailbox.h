@@ -0,0 +1,63 @@
+#ifndef PROJECT_BASE_FRAMEMAILBOX_H
+#define PROJECT_BASE_FRAMEMAILBOX_H
+
+#include <atomic>
+
+namespace rg {
+
+    // Hands the newest value of one producer thread to one consumer thread without either of them
+    // ever waiting on the other or taking a lock.
+    //
+    // A double buffer both sides can use at any time: the producer fills its back slot and swaps it
+    // with a shared middle slot in one atomic exchange, the consumer swaps the middle slot with its
+    // front slot when something new was published. The third slot is what lets the producer go on
+    // writing while the consumer still reads. A value the consumer did not take in time is replaced
+    // by the next one, so it always gets the latest. Slots are reused, a T holding vectors keeps
+    // their capacity from one value to the next.
+    template<typename T>
+    class FrameMailbox {
+    public:
+        // the slot to fill next, only the producer touches it until Publish
+        T &Back() { return m_Slots[m_Back]; }
+
+        // makes the back slot the newest value and hands the producer a free slot to fill
+        void Publish() {
+            unsigned int previous = m_Middle.exchange(m_Back | Fresh, std::memory_order_acq_rel);
+            if (previous & Fresh)
+                m_Dropped++;
+            m_Back = previous & IndexMask;
+            m_Published++;
+        }
+
+        // takes the newest published value into the front slot, false when nothing new was published
+        bool Acquire() {
+            if (!(m_Middle.load(std::memory_order_acquire) & Fresh))
+                return false;
+            m_Front = m_Middle.exchange(m_Front, std::memory_order_acq_rel) & IndexMask;
+            return true;
+        }
+
+        // the value the consumer took last, valid until its next Acquire
+        const T &Front() const { return m_Slots[m_Front]; }
+
+        // values published, and how many of them were replaced before the consumer took them
+        unsigned long long Published() const { return m_Published; }
+        unsigned long long Dropped() const { return m_Dropped; }
+
+    private:
+        static const unsigned int IndexMask = 3;
+        static const unsigned int Fresh = 4;
+
+        T m_Slots[3];
+        unsigned int m_Back = 0;
+        unsigned int m_Front = 1;
+        // index of the middle slot, with Fresh set while it holds a value the consumer has not taken
+        std::atomic<unsigned int> m_Middle{2};
+        // producer side only
+        unsigned long long m_Published = 0;
+        unsigned long long m_Dropped = 0;
+    };
+
+}
+
+#endif //PROJECT_BASE_FRAMEMAILBOX_H
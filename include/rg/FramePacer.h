@@ -0,0 +1,183 @@
+#ifndef PROJECT_BASE_FRAMEPACER_H
+#define PROJECT_BASE_FRAMEPACER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+namespace rg {
+
+    enum class VSyncMode {
+        Off,
+        On,
+        // waits for vblank unless the frame is already late, then swaps right away and tears
+        Adaptive
+    };
+
+    inline const char *vsyncModeName(VSyncMode mode) {
+        switch (mode) {
+            case VSyncMode::Off: return "off";
+            case VSyncMode::Adaptive: return "adaptive";
+            default: return "on";
+        }
+    }
+
+    // When the thread that swaps starts its next frame.
+    //
+    // The swap interval follows VSync. With TargetFps the limiter holds frames to a fixed period:
+    // it sleeps until shortly before the deadline and spins for the last SpinMicroseconds, since a
+    // sleep wakes up late by about a scheduler tick. Missing a deadline by more than a period starts
+    // the schedule over rather than rushing frames to catch up. MaxFramesInFlight fences every frame
+    // and keeps the CPU at most that many frames ahead of the GPU, FinishAfterSwap is the strict
+    // form of it. Shallower queues trade throughput for latency: the input a frame is built from
+    // reaches the screen that much sooner.
+    //
+    // A frame goes BeginFrame, WaitForFrame, sample input, draw, swap, EndFrame; all of it on the
+    // thread that owns the context.
+    class FramePacer {
+    public:
+        typedef std::chrono::steady_clock Clock;
+        static const unsigned int MaxQueuedFrames = 8;
+
+        VSyncMode VSync = VSyncMode::On;
+        // frames per second the limiter holds, 0 leaves pacing to the swap
+        double TargetFps = 0.0;
+        double SpinMicroseconds = 1500.0;
+        // frames the GPU may still be working on when the next one starts, 0 leaves it to the driver
+        unsigned int MaxFramesInFlight = 0;
+        bool FinishAfterSwap = false;
+
+        FramePacer() = default;
+        FramePacer(const FramePacer &) = delete;
+        FramePacer &operator=(const FramePacer &) = delete;
+
+        // for glfwSwapInterval; adaptive needs EXT_swap_control_tear and falls back to on without it
+        int SwapInterval(bool tearControlSupported) const {
+            switch (VSync) {
+                case VSyncMode::Off: return 0;
+                case VSyncMode::Adaptive: return tearControlSupported ? -1 : 1;
+                default: return 1;
+            }
+        }
+
+        // waits until the GPU is done with the frames beyond MaxFramesInFlight
+        void BeginFrame() {
+            if (MaxFramesInFlight == 0)
+                return;
+            while (m_FenceCount >= queueLimit()) {
+                GLsync &fence = m_Fences[m_FenceHead];
+                GLenum status = glClientWaitSync(fence, 0, 0);
+                if (status == GL_TIMEOUT_EXPIRED) {
+                    auto start = Clock::now();
+                    m_QueueWaits++;
+                    while (status == GL_TIMEOUT_EXPIRED)
+                        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                    m_QueueWaitMilliseconds += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+                }
+                glDeleteSync(fence);
+                fence = nullptr;
+                m_FenceHead = (m_FenceHead + 1) % MaxQueuedFrames;
+                m_FenceCount--;
+            }
+        }
+
+        // blocks until the limiter lets the next frame start, then input is sampled as late as possible
+        void WaitForFrame() {
+            if (TargetFps <= 0.0)
+                return;
+            Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / TargetFps));
+            Clock::time_point now = Clock::now();
+            if (!m_Scheduled || now > m_Deadline + period) {
+                if (m_Scheduled)
+                    m_Resyncs++;
+                m_Scheduled = true;
+                m_Deadline = now + period;
+                return;
+            }
+
+            // a frame that is already late starts right away and the next one makes up for it
+            if (now < m_Deadline) {
+                Clock::duration spin = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::micro>(SpinMicroseconds));
+                if (m_Deadline - now > spin)
+                    std::this_thread::sleep_until(m_Deadline - spin);
+                while ((now = Clock::now()) < m_Deadline) {
+                }
+                double late = std::chrono::duration<double, std::micro>(now - m_Deadline).count();
+                m_LatenessSum += late;
+                m_LatenessMax = std::max(m_LatenessMax, late);
+                m_Waits++;
+            }
+            m_Deadline += period;
+        }
+
+        // call right after the swap, BeginFrame of this frame has made room for its fence
+        void EndFrame() {
+            if (FinishAfterSwap) {
+                glFinish();
+                return;
+            }
+            if (MaxFramesInFlight == 0)
+                return;
+            m_Fences[(m_FenceHead + m_FenceCount) % MaxQueuedFrames] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            m_FenceCount++;
+        }
+
+        void Release() {
+            for (GLsync &fence : m_Fences) {
+                if (fence)
+                    glDeleteSync(fence);
+                fence = nullptr;
+            }
+            m_FenceHead = 0;
+            m_FenceCount = 0;
+        }
+
+        void PrintSettings(std::ostream &out, int swapInterval) const {
+            out << "FRAME_PACING:: vsync " << vsyncModeName(VSync) << " (swap interval " << swapInterval << "), ";
+            if (TargetFps > 0.0)
+                out << "limited to " << TargetFps << " fps, ";
+            else
+                out << "no frame limit, ";
+            if (FinishAfterSwap)
+                out << "glFinish after every swap" << std::endl;
+            else if (MaxFramesInFlight > 0)
+                out << "at most " << queueLimit() << " frames in flight" << std::endl;
+            else
+                out << "queue depth left to the driver" << std::endl;
+        }
+
+        void PrintStats(std::ostream &out) const {
+            if (m_Waits > 0)
+                out << "FRAME_PACING:: limiter woke up " << m_LatenessSum / m_Waits << " us late on average, "
+                    << m_LatenessMax << " at worst, restarted the schedule " << m_Resyncs << " times" << std::endl;
+            if (MaxFramesInFlight > 0)
+                out << "FRAME_PACING:: waited for the GPU before " << m_QueueWaits << " frames, "
+                    << m_QueueWaitMilliseconds << " ms in total" << std::endl;
+        }
+
+    private:
+        GLsync m_Fences[MaxQueuedFrames] = {};
+        unsigned int m_FenceHead = 0;
+        unsigned int m_FenceCount = 0;
+
+        bool m_Scheduled = false;
+        Clock::time_point m_Deadline;
+
+        unsigned long long m_Waits = 0;
+        unsigned long long m_Resyncs = 0;
+        double m_LatenessSum = 0.0;
+        double m_LatenessMax = 0.0;
+        unsigned long long m_QueueWaits = 0;
+        double m_QueueWaitMilliseconds = 0.0;
+
+        unsigned int queueLimit() const {
+            return MaxFramesInFlight < MaxQueuedFrames ? MaxFramesInFlight : MaxQueuedFrames;
+        }
+    };
+
+}
+
+#endif //PROJECT_BASE_FRAMEPACER_H
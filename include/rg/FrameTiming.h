@@ -0,0 +1,93 @@
+#ifndef PROJECT_BASE_FRAMETIMING_H
+#define PROJECT_BASE_FRAMETIMING_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace rg {
+
+    // Frame pacing and input latency of the presented frames: the time between two buffer swaps, how
+    // much it changes from one frame to the next (jitter), and the time from sampling the input a
+    // frame was built from to its swap returning. Percentiles are over the last History frames, means
+    // over all of them.
+    class FrameTiming {
+    public:
+        typedef std::chrono::steady_clock Clock;
+        static const size_t History = 8192;
+
+        // the ring buffers get their full size here rather than growing in the middle of a run
+        FrameTiming() {
+            m_Intervals.reserve(History);
+            m_Jitters.reserve(History);
+            m_Latencies.reserve(History);
+        }
+
+        // call on the thread that swaps, right after the swap of the frame built from input sampled at inputTime
+        void Presented(Clock::time_point inputTime, Clock::time_point presentTime = Clock::now()) {
+            double latency = std::chrono::duration<double, std::milli>(presentTime - inputTime).count();
+            record(m_Latencies, latency);
+            m_LatencySum += latency;
+            if (m_Frames > 0) {
+                double interval = std::chrono::duration<double, std::milli>(presentTime - m_LastPresent).count();
+                record(m_Intervals, interval);
+                m_IntervalSum += interval;
+                m_IntervalMax = std::max(m_IntervalMax, interval);
+                if (m_Frames > 1)
+                    record(m_Jitters, std::abs(interval - m_LastInterval));
+                m_LastInterval = interval;
+            }
+            m_LastPresent = presentTime;
+            m_Frames++;
+        }
+
+        unsigned long long Frames() const { return m_Frames; }
+
+        void Print(std::ostream &out, const char *mode) const {
+            if (m_Frames < 2) {
+                out << "FRAME_TIMING:: " << mode << ", not enough frames presented" << std::endl;
+                return;
+            }
+            out << "FRAME_TIMING:: " << mode << ", " << m_Frames << " frames\n"
+                << "  frame interval      mean " << m_IntervalSum / (m_Frames - 1) << " ms, median "
+                << percentile(m_Intervals, 50) << ", 99th percentile " << percentile(m_Intervals, 99) << ", worst "
+                << m_IntervalMax << "\n"
+                << "  frame time jitter   median " << percentile(m_Jitters, 50) << " ms, 99th percentile "
+                << percentile(m_Jitters, 99) << "\n"
+                << "  input to present    mean " << m_LatencySum / m_Frames << " ms, median "
+                << percentile(m_Latencies, 50) << ", 99th percentile " << percentile(m_Latencies, 99) << std::endl;
+        }
+
+    private:
+        // ring buffers of the last History samples
+        std::vector<double> m_Intervals;
+        std::vector<double> m_Jitters;
+        std::vector<double> m_Latencies;
+        double m_IntervalSum = 0.0;
+        double m_IntervalMax = 0.0;
+        double m_LastInterval = 0.0;
+        double m_LatencySum = 0.0;
+        unsigned long long m_Frames = 0;
+        Clock::time_point m_LastPresent;
+
+        void record(std::vector<double> &samples, double value) {
+            if (samples.size() < History)
+                samples.push_back(value);
+            else
+                samples[m_Frames % History] = value;
+        }
+
+        static double percentile(std::vector<double> samples, int percent) {
+            if (samples.empty())
+                return 0.0;
+            size_t index = std::min(samples.size() - 1, samples.size() * percent / 100);
+            std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+            return samples[index];
+        }
+    };
+
+}
+
+#endif //PROJECT_BASE_FRAMETIMING_H
@@ -0,0 +1,93 @@
+#ifndef PROJECT_BASE_GLEXTENSIONS_H
+#define PROJECT_BASE_GLEXTENSIONS_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+
+// glad is generated for plain GL 3.3 core without extensions, so the entry points and enums of the
+// optional features used by the renderer are declared and loaded here. Every feature has a flag that
+// stays false when the driver does not expose it and callers fall back to the 3.3 path.
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+typedef void (APIENTRYP PFN_rgBufferStorage)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+typedef void (APIENTRYP PFN_rgMultiDrawElementsIndirect)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+
+namespace rg {
+
+    struct GLExtensions {
+        // ARB_multi_draw_indirect (core in 4.3)
+        bool MultiDrawIndirect = false;
+        PFN_rgMultiDrawElementsIndirect MultiDrawElementsIndirect = nullptr;
+
+        // ARB_buffer_storage (core in 4.4), immutable storage that can stay mapped
+        bool BufferStorage = false;
+        PFN_rgBufferStorage BufferStorageFunc = nullptr;
+
+        // EXT_texture_compression_s3tc, BC1-BC3 (BC4/BC5 are core as RGTC)
+        bool TextureCompressionS3TC = false;
+    };
+
+    inline GLExtensions &glExtensions() {
+        static GLExtensions extensions;
+        return extensions;
+    }
+
+    inline bool isGLExtensionSupported(const char *name) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++) {
+            const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+            if (extension && std::strcmp(extension, name) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    inline bool isGLVersionAtLeast(GLint major, GLint minor) {
+        GLint contextMajor = 0, contextMinor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+        glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+        return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+    }
+
+    // call once after gladLoadGLLoader, with the same loader
+    inline void loadGLExtensions(GLADloadproc load) {
+        GLExtensions &extensions = glExtensions();
+
+        if (isGLVersionAtLeast(4, 3) || isGLExtensionSupported("GL_ARB_multi_draw_indirect")) {
+            extensions.MultiDrawElementsIndirect = (PFN_rgMultiDrawElementsIndirect)load("glMultiDrawElementsIndirect");
+            extensions.MultiDrawIndirect = extensions.MultiDrawElementsIndirect != nullptr;
+        }
+
+        if (isGLVersionAtLeast(4, 4) || isGLExtensionSupported("GL_ARB_buffer_storage")) {
+            extensions.BufferStorageFunc = (PFN_rgBufferStorage)load("glBufferStorage");
+            extensions.BufferStorage = extensions.BufferStorageFunc != nullptr;
+        }
+
+        extensions.TextureCompressionS3TC = isGLExtensionSupported("GL_EXT_texture_compression_s3tc");
+    }
+
+}
+
+#endif //PROJECT_BASE_GLEXTENSIONS_H
@@ -0,0 +1,216 @@
+#ifndef PROJECT_BASE_GLSTATE_H
+#define PROJECT_BASE_GLSTATE_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+namespace rg {
+
+    // Shadow copy of the GL state the renderer touches most. Every bind goes through here and only
+    // reaches the driver when the value actually changes, so draw code can state what it needs without
+    // unbinding afterwards "to be safe". Code that changes the same state behind the cache's back has
+    // to call Invalidate().
+    class GLStateCache {
+    public:
+        static const unsigned int MaxTextureUnits = 32;
+
+        struct Stats {
+            unsigned long issued = 0;
+            unsigned long avoided = 0;
+        };
+
+        void UseProgram(GLuint program) {
+            if (m_Program == program) {
+                avoided();
+                return;
+            }
+            m_Program = program;
+            glUseProgram(program);
+            issued();
+        }
+
+        void BindVertexArray(GLuint vao) {
+            if (m_VertexArray == vao) {
+                avoided();
+                return;
+            }
+            m_VertexArray = vao;
+            glBindVertexArray(vao);
+            issued();
+        }
+
+        // binds the texture to the unit, switching the active unit only when something has to change
+        void BindTexture(GLuint unit, GLenum target, GLuint texture) {
+            GLuint *bound = binding(unit, target);
+            if (bound && *bound == texture) {
+                avoided();
+                return;
+            }
+            ActiveTexture(unit);
+            glBindTexture(target, texture);
+            issued();
+            if (bound)
+                *bound = texture;
+        }
+
+        void ActiveTexture(GLuint unit) {
+            if (m_ActiveUnit == unit) {
+                avoided();
+                return;
+            }
+            m_ActiveUnit = unit;
+            glActiveTexture(GL_TEXTURE0 + unit);
+            issued();
+        }
+
+        void DepthFunc(GLenum func) {
+            if (m_DepthFunc == func) {
+                avoided();
+                return;
+            }
+            m_DepthFunc = func;
+            glDepthFunc(func);
+            issued();
+        }
+
+        void DepthMask(GLboolean mask) {
+            if (m_DepthMask == mask) {
+                avoided();
+                return;
+            }
+            m_DepthMask = mask;
+            glDepthMask(mask);
+            issued();
+        }
+
+        void ColorMask(GLboolean mask) {
+            if (m_ColorMask == mask) {
+                avoided();
+                return;
+            }
+            m_ColorMask = mask;
+            glColorMask(mask, mask, mask, mask);
+            issued();
+        }
+
+        void BlendFunc(GLenum source, GLenum destination) {
+            if (m_BlendSource == source && m_BlendDestination == destination) {
+                avoided();
+                return;
+            }
+            m_BlendSource = source;
+            m_BlendDestination = destination;
+            glBlendFunc(source, destination);
+            issued();
+        }
+
+        // GL_DEPTH_TEST, GL_BLEND and GL_CULL_FACE are tracked, anything else is passed through
+        void SetEnabled(GLenum capability, bool enabled) {
+            int *state = capabilityState(capability);
+            if (state && *state == (int)enabled) {
+                avoided();
+                return;
+            }
+            if (enabled)
+                glEnable(capability);
+            else
+                glDisable(capability);
+            issued();
+            if (state)
+                *state = enabled;
+        }
+
+        // forgets the cached state, the next request of each kind reaches GL again; the statistics stay
+        void Invalidate() {
+            m_Program = m_VertexArray = 0xffffffffu;
+            m_ActiveUnit = 0xffffffffu;
+            for (auto &unit : m_Textures)
+                unit[0] = unit[1] = unit[2] = 0xffffffffu;
+            m_DepthFunc = m_BlendSource = m_BlendDestination = GL_NONE;
+            m_DepthMask = m_ColorMask = 0xff;
+            m_DepthTest = m_Blend = m_CullFace = Unknown;
+        }
+
+        void EndFrame() {
+            m_LastFrame = m_Frame;
+            m_Frame = Stats();
+            m_Frames++;
+        }
+
+        const Stats &LastFrame() const { return m_LastFrame; }
+        const Stats &Total() const { return m_Total; }
+
+        void PrintStats(std::ostream &out) const {
+            out << "GL_STATE:: last frame " << m_LastFrame.issued << " calls issued, " << m_LastFrame.avoided << " avoided";
+            if (m_Frames > 0) {
+                out << " | average " << m_Total.issued / m_Frames << " issued, " << m_Total.avoided / m_Frames
+                    << " avoided over " << m_Frames << " frames";
+            }
+            out << std::endl;
+        }
+
+        GLStateCache() = default;
+
+    private:
+        static const int Unknown = -1;
+
+        GLuint m_Program = 0;
+        GLuint m_VertexArray = 0;
+        GLuint m_ActiveUnit = 0;
+        // per unit: GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_2D_ARRAY
+        GLuint m_Textures[MaxTextureUnits][3] = {};
+
+        GLenum m_DepthFunc = GL_LESS;
+        GLboolean m_DepthMask = GL_TRUE;
+        GLboolean m_ColorMask = GL_TRUE;
+        GLenum m_BlendSource = GL_ONE;
+        GLenum m_BlendDestination = GL_ZERO;
+        int m_DepthTest = 0;
+        int m_Blend = 0;
+        int m_CullFace = 0;
+
+        Stats m_Total;
+        Stats m_Frame;
+        Stats m_LastFrame;
+        unsigned long m_Frames = 0;
+
+        void issued() {
+            m_Frame.issued++;
+            m_Total.issued++;
+        }
+
+        void avoided() {
+            m_Frame.avoided++;
+            m_Total.avoided++;
+        }
+
+        GLuint *binding(GLuint unit, GLenum target) {
+            if (unit >= MaxTextureUnits)
+                return nullptr;
+            switch (target) {
+                case GL_TEXTURE_2D: return &m_Textures[unit][0];
+                case GL_TEXTURE_CUBE_MAP: return &m_Textures[unit][1];
+                case GL_TEXTURE_2D_ARRAY: return &m_Textures[unit][2];
+                default: return nullptr;
+            }
+        }
+
+        int *capabilityState(GLenum capability) {
+            switch (capability) {
+                case GL_DEPTH_TEST: return &m_DepthTest;
+                case GL_BLEND: return &m_Blend;
+                case GL_CULL_FACE: return &m_CullFace;
+                default: return nullptr;
+            }
+        }
+    };
+
+    inline GLStateCache &glState() {
+        static GLStateCache state;
+        return state;
+    }
+
+}
+
+#endif //PROJECT_BASE_GLSTATE_H
@@ -0,0 +1,473 @@
+#ifndef PROJECT_BASE_GEOMETRYARENA_H
+#define PROJECT_BASE_GEOMETRYARENA_H
+
+#include <glad/glad.h>
+#include <rg/GLExtensions.h>
+#include <rg/GLState.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <vector>
+
+namespace rg {
+
+    struct VertexAttribute {
+        GLuint location;
+        GLint size;
+        GLenum type;
+        GLboolean normalized;
+        GLuint offset;
+    };
+
+    inline bool operator==(const VertexAttribute &a, const VertexAttribute &b) {
+        return a.location == b.location && a.size == b.size && a.type == b.type
+               && a.normalized == b.normalized && a.offset == b.offset;
+    }
+
+    // interleaved layout of one vertex, every distinct format gets its own pool and VAO in the arena
+    struct VertexFormat {
+        GLsizei stride = 0;
+        std::vector<VertexAttribute> attributes;
+
+        // appends a float attribute right after the previous one
+        VertexFormat &Add(GLuint location, GLint size) {
+            attributes.push_back({location, size, GL_FLOAT, GL_FALSE, (GLuint)stride});
+            stride += size * (GLsizei)sizeof(float);
+            return *this;
+        }
+
+        bool operator==(const VertexFormat &other) const {
+            return stride == other.stride && attributes == other.attributes;
+        }
+    };
+
+    // first-fit allocator over [0, capacity) in elements, free blocks are coalesced on release
+    class RangeAllocator {
+    public:
+        static const GLuint InvalidOffset = 0xffffffffu;
+
+        explicit RangeAllocator(GLuint capacity = 0) {
+            Grow(capacity);
+        }
+
+        GLuint Allocate(GLuint size) {
+            if (size == 0)
+                return 0;
+            for (auto it = m_Free.begin(); it != m_Free.end(); ++it) {
+                if (it->second < size)
+                    continue;
+                GLuint offset = it->first;
+                GLuint remaining = it->second - size;
+                m_Free.erase(it);
+                if (remaining > 0)
+                    m_Free[offset + size] = remaining;
+                m_Used += size;
+                return offset;
+            }
+            return InvalidOffset;
+        }
+
+        void Free(GLuint offset, GLuint size) {
+            if (size == 0)
+                return;
+            m_Used -= size;
+            auto next = m_Free.lower_bound(offset);
+            if (next != m_Free.end() && offset + size == next->first) {
+                size += next->second;
+                next = m_Free.erase(next);
+            }
+            if (next != m_Free.begin()) {
+                auto previous = std::prev(next);
+                if (previous->first + previous->second == offset) {
+                    previous->second += size;
+                    return;
+                }
+            }
+            m_Free[offset] = size;
+        }
+
+        // extends the range, the new tail is merged with a trailing free block
+        void Grow(GLuint newCapacity) {
+            if (newCapacity <= m_Capacity)
+                return;
+            GLuint oldCapacity = m_Capacity;
+            m_Capacity = newCapacity;
+            m_Used += newCapacity - oldCapacity;
+            Free(oldCapacity, newCapacity - oldCapacity);
+        }
+
+        GLuint Capacity() const { return m_Capacity; }
+        GLuint Used() const { return m_Used; }
+        GLuint FreeBlockCount() const { return (GLuint)m_Free.size(); }
+
+        GLuint LargestFreeBlock() const {
+            GLuint largest = 0;
+            for (const auto &block : m_Free)
+                largest = std::max(largest, block.second);
+            return largest;
+        }
+
+        // 0 when all free space is one block, approaches 1 as it splinters into small holes
+        float Fragmentation() const {
+            GLuint totalFree = m_Capacity - m_Used;
+            if (totalFree == 0)
+                return 0.0f;
+            return 1.0f - (float)LargestFreeBlock() / (float)totalFree;
+        }
+
+    private:
+        std::map<GLuint, GLuint> m_Free;
+        GLuint m_Capacity = 0;
+        GLuint m_Used = 0;
+    };
+
+    // a suballocated piece of static geometry, drawn with glDrawElementsBaseVertex from its pool
+    struct GeometryAllocation {
+        int pool = -1;
+        GLuint firstVertex = 0;
+        GLuint vertexCount = 0;
+        GLuint firstIndex = 0;
+        GLuint indexCount = 0;
+        // false when the index range belongs to another allocation with the same vertex order
+        bool ownsIndices = true;
+
+        bool IsValid() const { return pool >= 0; }
+        const void *IndexOffset() const { return (const void *)(size_t)(firstIndex * sizeof(GLuint)); }
+    };
+
+    // Static vertex and index data of the whole scene lives in a few large buffers, one vertex buffer
+    // and one VAO per vertex format and a single index buffer every VAO points at. Meshes only
+    // remember where their range starts, so consecutive draws of the same format never switch VAOs
+    // and whole models can be submitted with a single multi-draw call. Since the indices are shared
+    // across formats, a second stream of the same vertices in another format (the position-only copy
+    // for the depth pre-pass) reuses the index range of the first instead of storing it again.
+    class GeometryArena {
+    public:
+        GLuint InitialVertexCapacity = 64 * 1024;
+        GLuint InitialIndexCapacity = 192 * 1024;
+
+        // copies the data into the pool of the given format; when indices is null the vertices are
+        // treated as a plain triangle list and sequential indices are generated
+        GeometryAllocation Allocate(const VertexFormat &format, const void *vertices, GLuint vertexCount,
+                                    const GLuint *indices = nullptr, GLuint indexCount = 0) {
+            std::vector<GLuint> sequential;
+            if (!indices) {
+                sequential.resize(vertexCount);
+                for (GLuint i = 0; i < vertexCount; i++)
+                    sequential[i] = i;
+                indices = sequential.data();
+                indexCount = vertexCount;
+            }
+
+            GeometryAllocation allocation;
+            allocation.pool = findOrCreatePool(format);
+            Pool &pool = m_Pools[allocation.pool];
+
+            allocation.vertexCount = vertexCount;
+            allocation.indexCount = indexCount;
+            allocation.firstVertex = pool.vertices.Allocate(vertexCount);
+            while (allocation.firstVertex == RangeAllocator::InvalidOffset) {
+                growVertices(pool, std::max(pool.vertices.Capacity() * 2, pool.vertices.Capacity() + vertexCount));
+                allocation.firstVertex = pool.vertices.Allocate(vertexCount);
+            }
+            allocation.firstIndex = m_Indices.Allocate(indexCount);
+            while (allocation.firstIndex == RangeAllocator::InvalidOffset) {
+                growIndices(std::max(m_Indices.Capacity() * 2, m_Indices.Capacity() + indexCount));
+                allocation.firstIndex = m_Indices.Allocate(indexCount);
+            }
+
+            // uploads go through the copy target so neither the bound VAO nor its element buffer change
+            uploadVertices(pool, allocation.firstVertex, vertices, vertexCount);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_IndexBuffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)allocation.firstIndex * sizeof(GLuint),
+                            (GLsizeiptr)indexCount * sizeof(GLuint), indices);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            return allocation;
+        }
+
+        // copies the vertices into the pool of the given format and draws them with the index range of
+        // indexed, which has to hold the same vertices in the same order; only the vertices are stored
+        GeometryAllocation AllocateSharingIndices(const VertexFormat &format, const void *vertices, GLuint vertexCount,
+                                                  const GeometryAllocation &indexed) {
+            if (!indexed.IsValid() || indexed.vertexCount != vertexCount) {
+                std::cout << "ERROR::GEOMETRY_ARENA::SHARED_INDICES_DO_NOT_MATCH" << std::endl;
+                return GeometryAllocation();
+            }
+
+            GeometryAllocation allocation;
+            allocation.pool = findOrCreatePool(format);
+            Pool &pool = m_Pools[allocation.pool];
+
+            allocation.vertexCount = vertexCount;
+            allocation.firstIndex = indexed.firstIndex;
+            allocation.indexCount = indexed.indexCount;
+            allocation.ownsIndices = false;
+            allocation.firstVertex = pool.vertices.Allocate(vertexCount);
+            while (allocation.firstVertex == RangeAllocator::InvalidOffset) {
+                growVertices(pool, std::max(pool.vertices.Capacity() * 2, pool.vertices.Capacity() + vertexCount));
+                allocation.firstVertex = pool.vertices.Allocate(vertexCount);
+            }
+            uploadVertices(pool, allocation.firstVertex, vertices, vertexCount);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            m_SharedIndices += allocation.indexCount;
+            return allocation;
+        }
+
+        // an allocation sharing the indices of another has to be freed first
+        void Free(GeometryAllocation &allocation) {
+            if (!allocation.IsValid())
+                return;
+            Pool &pool = m_Pools[allocation.pool];
+            pool.vertices.Free(allocation.firstVertex, allocation.vertexCount);
+            if (allocation.ownsIndices)
+                m_Indices.Free(allocation.firstIndex, allocation.indexCount);
+            else
+                m_SharedIndices -= allocation.indexCount;
+            allocation = GeometryAllocation();
+        }
+
+        GLuint GetVAO(int pool) const {
+            return m_Pools[pool].vao;
+        }
+
+        void Draw(const GeometryAllocation &allocation, GLenum mode = GL_TRIANGLES) const {
+            glState().BindVertexArray(m_Pools[allocation.pool].vao);
+            glDrawElementsBaseVertex(mode, allocation.indexCount, GL_UNSIGNED_INT, allocation.IndexOffset(),
+                                     allocation.firstVertex);
+        }
+
+        // per-instance data is read by the shader from gl_InstanceID, the pool VAO has no instanced attributes
+        void DrawInstanced(const GeometryAllocation &allocation, GLsizei instanceCount, GLenum mode = GL_TRIANGLES) const {
+            glState().BindVertexArray(m_Pools[allocation.pool].vao);
+            glDrawElementsInstancedBaseVertex(mode, allocation.indexCount, GL_UNSIGNED_INT, allocation.IndexOffset(),
+                                              instanceCount, allocation.firstVertex);
+        }
+
+        void PrintStats(std::ostream &out) const {
+            out << "GEOMETRY_ARENA:: " << m_Pools.size() << " pools\n";
+            for (size_t i = 0; i < m_Pools.size(); i++) {
+                const Pool &pool = m_Pools[i];
+                out << "  pool " << i << " stride " << pool.format.stride
+                    << " | vertices " << pool.vertices.Used() << "/" << pool.vertices.Capacity()
+                    << " (" << occupancy(pool.vertices) << "%, " << pool.vertices.FreeBlockCount() << " free blocks, fragmentation "
+                    << pool.vertices.Fragmentation() << ")\n";
+            }
+            out << "  indices " << m_Indices.Used() << "/" << m_Indices.Capacity()
+                << " (" << occupancy(m_Indices) << "%, " << m_Indices.FreeBlockCount() << " free blocks, fragmentation "
+                << m_Indices.Fragmentation() << "), " << m_SharedIndices << " more drawn from shared ranges ("
+                << (unsigned long)m_SharedIndices * sizeof(GLuint) / 1024 << " KB not stored twice)\n";
+            out << std::flush;
+        }
+
+        // deletes all GL objects, must run while the context is still current
+        void Release() {
+            for (Pool &pool : m_Pools) {
+                glDeleteVertexArrays(1, &pool.vao);
+                glDeleteBuffers(1, &pool.vbo);
+            }
+            m_Pools.clear();
+            if (m_IndexBuffer)
+                glDeleteBuffers(1, &m_IndexBuffer);
+            m_IndexBuffer = 0;
+            m_Indices = RangeAllocator();
+            m_SharedIndices = 0;
+        }
+
+    private:
+        struct Pool {
+            VertexFormat format;
+            GLuint vao = 0, vbo = 0;
+            RangeAllocator vertices;
+        };
+
+        std::vector<Pool> m_Pools;
+        GLuint m_IndexBuffer = 0;
+        RangeAllocator m_Indices;
+        // indices drawn by allocations that share the range of another one
+        GLuint m_SharedIndices = 0;
+
+        static int occupancy(const RangeAllocator &allocator) {
+            return allocator.Capacity() ? (int)(100.0f * allocator.Used() / allocator.Capacity()) : 0;
+        }
+
+        int findOrCreatePool(const VertexFormat &format) {
+            for (size_t i = 0; i < m_Pools.size(); i++) {
+                if (m_Pools[i].format == format)
+                    return (int)i;
+            }
+
+            Pool pool;
+            pool.format = format;
+            glGenVertexArrays(1, &pool.vao);
+            glGenBuffers(1, &pool.vbo);
+            m_Pools.push_back(pool);
+
+            Pool &created = m_Pools.back();
+            growVertices(created, InitialVertexCapacity);
+            if (!m_IndexBuffer) {
+                glGenBuffers(1, &m_IndexBuffer);
+                growIndices(InitialIndexCapacity);
+            } else {
+                glState().BindVertexArray(created.vao);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer);
+            }
+            return (int)m_Pools.size() - 1;
+        }
+
+        // reallocates the buffer and copies the old contents, offsets of existing allocations stay valid
+        static GLuint reallocate(GLuint buffer, GLsizeiptr oldSize, GLsizeiptr newSize) {
+            GLuint resized;
+            glGenBuffers(1, &resized);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, resized);
+            glBufferData(GL_COPY_WRITE_BUFFER, newSize, nullptr, GL_STATIC_DRAW);
+            if (oldSize > 0) {
+                glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, oldSize);
+                glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            glDeleteBuffers(1, &buffer);
+            return resized;
+        }
+
+        void growVertices(Pool &pool, GLuint capacity) {
+            pool.vbo = reallocate(pool.vbo, (GLsizeiptr)pool.vertices.Capacity() * pool.format.stride,
+                                  (GLsizeiptr)capacity * pool.format.stride);
+            pool.vertices.Grow(capacity);
+
+            glState().BindVertexArray(pool.vao);
+            glBindBuffer(GL_ARRAY_BUFFER, pool.vbo);
+            for (const VertexAttribute &attribute : pool.format.attributes) {
+                glEnableVertexAttribArray(attribute.location);
+                glVertexAttribPointer(attribute.location, attribute.size, attribute.type, attribute.normalized,
+                                      pool.format.stride, (void *)(size_t)attribute.offset);
+            }
+        }
+
+        // the index buffer is replaced, so every VAO is pointed at the new one
+        void growIndices(GLuint capacity) {
+            m_IndexBuffer = reallocate(m_IndexBuffer, (GLsizeiptr)m_Indices.Capacity() * sizeof(GLuint),
+                                       (GLsizeiptr)capacity * sizeof(GLuint));
+            m_Indices.Grow(capacity);
+
+            for (const Pool &pool : m_Pools) {
+                glState().BindVertexArray(pool.vao);
+                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_IndexBuffer);
+            }
+        }
+
+        static void uploadVertices(const Pool &pool, GLuint firstVertex, const void *vertices, GLuint vertexCount) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, pool.vbo);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)firstVertex * pool.format.stride,
+                            (GLsizeiptr)vertexCount * pool.format.stride, vertices);
+        }
+    };
+
+    inline GeometryArena &geometryArena() {
+        static GeometryArena arena;
+        return arena;
+    }
+
+    // A list of allocations from one pool that is submitted with a single multi-draw call. Static
+    // batches are built once; with ARB_multi_draw_indirect the commands are kept in a GPU buffer so a
+    // submit is one bind and one call. Transient batches, rebuilt every frame, are always submitted
+    // from client memory: re-specifying a buffer the GPU may still read from for every submit costs
+    // more than the indirect call saves.
+    class DrawBatch {
+    public:
+        bool Transient = false;
+
+        // all allocations of a batch are drawn with the VAO of one pool; one from another pool is
+        // refused with false and the caller starts a new batch for it
+        bool Add(const GeometryAllocation &allocation) {
+            if (m_Pool < 0)
+                m_Pool = allocation.pool;
+            else if (allocation.pool != m_Pool)
+                return false;
+            m_Counts.push_back((GLsizei)allocation.indexCount);
+            m_Offsets.push_back(allocation.IndexOffset());
+            m_BaseVertices.push_back((GLint)allocation.firstVertex);
+            m_IndirectDirty = true;
+            return true;
+        }
+
+        void Clear() {
+            m_Pool = -1;
+            m_Counts.clear();
+            m_Offsets.clear();
+            m_BaseVertices.clear();
+            m_IndirectDirty = true;
+        }
+
+        bool Empty() const {
+            return m_Counts.empty();
+        }
+
+        GLsizei Size() const {
+            return (GLsizei)m_Counts.size();
+        }
+
+        void Submit(GLenum mode = GL_TRIANGLES) {
+            if (m_Counts.empty())
+                return;
+            glState().BindVertexArray(geometryArena().GetVAO(m_Pool));
+
+            if (glExtensions().MultiDrawIndirect && !Transient) {
+                if (m_IndirectDirty)
+                    uploadCommands();
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_IndirectBuffer);
+                glExtensions().MultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, nullptr, (GLsizei)m_Counts.size(), 0);
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            } else {
+                glMultiDrawElementsBaseVertex(mode, m_Counts.data(), GL_UNSIGNED_INT, m_Offsets.data(),
+                                              (GLsizei)m_Counts.size(), m_BaseVertices.data());
+            }
+        }
+
+        void Release() {
+            if (m_IndirectBuffer)
+                glDeleteBuffers(1, &m_IndirectBuffer);
+            m_IndirectBuffer = 0;
+            m_IndirectDirty = true;
+        }
+
+    private:
+        struct DrawElementsIndirectCommand {
+            GLuint count;
+            GLuint instanceCount;
+            GLuint firstIndex;
+            GLint baseVertex;
+            GLuint baseInstance;
+        };
+
+        int m_Pool = -1;
+        std::vector<GLsizei> m_Counts;
+        std::vector<const void *> m_Offsets;
+        std::vector<GLint> m_BaseVertices;
+
+        GLuint m_IndirectBuffer = 0;
+        bool m_IndirectDirty = true;
+
+        void uploadCommands() {
+            std::vector<DrawElementsIndirectCommand> commands(m_Counts.size());
+            for (size_t i = 0; i < m_Counts.size(); i++) {
+                commands[i].count = (GLuint)m_Counts[i];
+                commands[i].instanceCount = 1;
+                commands[i].firstIndex = (GLuint)((size_t)m_Offsets[i] / sizeof(GLuint));
+                commands[i].baseVertex = m_BaseVertices[i];
+                commands[i].baseInstance = 0;
+            }
+            if (!m_IndirectBuffer)
+                glGenBuffers(1, &m_IndirectBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_IndirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand),
+                         commands.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            m_IndirectDirty = false;
+        }
+    };
+
+}
+
+#endif //PROJECT_BASE_GEOMETRYARENA_H
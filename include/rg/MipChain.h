@@ -0,0 +1,150 @@
+#ifndef PROJECT_BASE_MIPCHAIN_H
+#define PROJECT_BASE_MIPCHAIN_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <rg/FrameArena.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RG_MIPCHAIN_SSE2 1
+#endif
+
+namespace rg {
+
+    struct MipLevel {
+        int width = 0;
+        int height = 0;
+        std::vector<unsigned char> data;
+    };
+
+    namespace detail {
+
+        // sRGB values are averaged as light, in 14 bit linear so four of them still add up within 16 bits
+        const int LinearBits = 14;
+        const int LinearMax = (1 << LinearBits) - 1;
+
+        inline const uint16_t *srgbToLinearTable() {
+            static const std::vector<uint16_t> table = [] {
+                std::vector<uint16_t> values(256);
+                for (int i = 0; i < 256; i++) {
+                    float c = i / 255.0f;
+                    float linear = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+                    values[i] = (uint16_t)(linear * LinearMax + 0.5f);
+                }
+                return values;
+            }();
+            return table.data();
+        }
+
+        inline const unsigned char *linearToSrgbTable() {
+            static const std::vector<unsigned char> table = [] {
+                std::vector<unsigned char> values(LinearMax + 1);
+                for (int i = 0; i <= LinearMax; i++) {
+                    float linear = (float)i / LinearMax;
+                    float c = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+                    values[i] = (unsigned char)(c * 255.0f + 0.5f);
+                }
+                return values;
+            }();
+            return table.data();
+        }
+
+        // sum[i] = a[i] + b[i] for count bytes, widened to 16 bits
+        inline void addRows(const unsigned char *a, const unsigned char *b, uint16_t *sum, int count) {
+            int i = 0;
+#ifdef RG_MIPCHAIN_SSE2
+            const __m128i zero = _mm_setzero_si128();
+            for (; i + 16 <= count; i += 16) {
+                __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+                __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+                __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+                __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+                _mm_storeu_si128((__m128i *)(sum + i), low);
+                _mm_storeu_si128((__m128i *)(sum + i + 8), high);
+            }
+#endif
+            for (; i < count; i++)
+                sum[i] = (uint16_t)(a[i] + b[i]);
+        }
+
+        // the same through the sRGB table, except for the alpha channel when there is one
+        inline void addRowsLinear(const unsigned char *a, const unsigned char *b, uint16_t *sum, int count, int channels,
+                                  bool hasAlpha) {
+            const uint16_t *toLinear = srgbToLinearTable();
+            for (int i = 0; i < count; i++) {
+                if (hasAlpha && i % channels == channels - 1)
+                    sum[i] = (uint16_t)((a[i] + b[i]) << (LinearBits - 8));
+                else
+                    sum[i] = (uint16_t)(toLinear[a[i]] + toLinear[b[i]]);
+            }
+        }
+
+    }
+
+    // Halves an 8 bit image with a 2x2 box filter, odd edges reuse the last texel.
+    //
+    // The two source rows are added first, 16 texels at a time with SSE2, then neighbouring columns.
+    // srgb averages the colour channels as linear light, like the hardware does for GL_SRGB8 textures,
+    // so bright details do not darken the smaller levels; a last channel of 2 or 4 is alpha and stays linear.
+    inline std::vector<unsigned char> downsampleImage(const unsigned char *pixels, int width, int height, int channels,
+                                                      int &mipWidth, int &mipHeight, bool srgb = false) {
+        mipWidth = std::max(1, width / 2);
+        mipHeight = std::max(1, height / 2);
+        std::vector<unsigned char> result((size_t)mipWidth * mipHeight * channels);
+        // the row sums are scratch, decoder workers take them from their own arena
+        ArenaScope scratch(threadArena());
+        FrameVector<uint16_t> sum((size_t)width * channels, 0, ArenaAllocator<uint16_t>(threadArena()));
+        bool hasAlpha = channels == 2 || channels == 4;
+        const unsigned char *toSrgb = detail::linearToSrgbTable();
+        const int alphaShift = detail::LinearBits - 8;
+
+        for (int y = 0; y < mipHeight; y++) {
+            const unsigned char *row0 = pixels + (size_t)std::min(y * 2, height - 1) * width * channels;
+            const unsigned char *row1 = pixels + (size_t)std::min(y * 2 + 1, height - 1) * width * channels;
+            if (srgb)
+                detail::addRowsLinear(row0, row1, sum.data(), width * channels, channels, hasAlpha);
+            else
+                detail::addRows(row0, row1, sum.data(), width * channels);
+
+            unsigned char *out = result.data() + (size_t)y * mipWidth * channels;
+            for (int x = 0; x < mipWidth; x++) {
+                const uint16_t *s0 = sum.data() + std::min(x * 2, width - 1) * channels;
+                const uint16_t *s1 = sum.data() + std::min(x * 2 + 1, width - 1) * channels;
+                for (int c = 0; c < channels; c++) {
+                    int total = s0[c] + s1[c];
+                    if (!srgb)
+                        out[x * channels + c] = (unsigned char)((total + 2) >> 2);
+                    else if (hasAlpha && c == channels - 1)
+                        out[x * channels + c] = (unsigned char)((total + (2 << alphaShift)) >> (2 + alphaShift));
+                    else
+                        out[x * channels + c] = toSrgb[(total + 2) >> 2];
+                }
+            }
+        }
+        return result;
+    }
+
+    // level 0 (a copy of pixels) down to 1x1, the sizes follow the GL rule max(1, size / 2)
+    inline std::vector<MipLevel> buildMipChain(const unsigned char *pixels, int width, int height, int channels,
+                                               bool srgb = false) {
+        std::vector<MipLevel> levels(1);
+        levels[0].width = width;
+        levels[0].height = height;
+        levels[0].data.assign(pixels, pixels + (size_t)width * height * channels);
+        while (levels.back().width > 1 || levels.back().height > 1) {
+            const MipLevel &previous = levels.back();
+            MipLevel level;
+            level.data = downsampleImage(previous.data.data(), previous.width, previous.height, channels,
+                                         level.width, level.height, srgb);
+            levels.push_back(std::move(level));
+        }
+        return levels;
+    }
+
+}
+
+#endif //PROJECT_BASE_MIPCHAIN_H
@@ -0,0 +1,188 @@
+#ifndef PROJECT_BASE_REDRAWTRACKER_H
+#define PROJECT_BASE_REDRAWTRACKER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <iostream>
+#include <mutex>
+
+namespace rg {
+
+    // what made a frame worth drawing, as a mask
+    enum RedrawReason : unsigned int {
+        RedrawCamera = 1,
+        RedrawAnimation = 2,
+        RedrawLights = 4,
+        RedrawAssets = 8,
+        RedrawWindow = 16,
+        RedrawOverlay = 32
+    };
+    const unsigned int RedrawReasonCount = 6;
+
+    inline const char *redrawReasonName(unsigned int reason) {
+        const char *names[RedrawReasonCount] = {"camera", "animation", "lights", "assets", "window", "overlay"};
+        return reason < RedrawReasonCount ? names[reason] : "unknown";
+    }
+
+    // Decides which frames get drawn.
+    //
+    // The simulation side passes every frame the reasons it found to draw it, anything else (window
+    // damage, assets still arriving on the render thread) calls Invalidate from wherever it notices.
+    // Continuously every frame is drawn. OnDemand draws only frames with a reason and lets the loop
+    // wait for events in between; the image last presented stays on screen. Out of focus it draws at
+    // most UnfocusedFps frames per second, iconified not at all, and what was held back is drawn once
+    // it may be. Either way the reasons are counted, so a continuous run reports how many of its
+    // frames showed nothing new, next to the CPU time the process spent.
+    //
+    // With a render thread, it waits in WaitForPublish for the simulation to hand it a frame instead
+    // of polling.
+    class RedrawTracker {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+        bool OnDemand = false;
+        // frames per second while the window is out of focus, on demand only
+        double UnfocusedFps = 10.0;
+        // longest the loop waits for events with nothing to draw, what goes unnoticed by GLFW is
+        // picked up then
+        double IdleSeconds = 0.5;
+
+        // from any thread
+        void Invalidate(unsigned int reasons) {
+            m_Invalidated.fetch_or(reasons, std::memory_order_relaxed);
+        }
+
+        // starts the clocks Print compares against
+        void Start() {
+            m_StartTime = Clock::now();
+            m_StartCpu = std::clock();
+        }
+
+        // on the simulation side once per frame, true when the frame is to be drawn
+        bool BeginFrame(unsigned int reasons, bool focused, bool iconified) {
+            reasons |= m_Invalidated.exchange(0, std::memory_order_relaxed) | m_Held;
+            m_Held = 0;
+            m_Frames++;
+            if (!OnDemand) {
+                if (!reasons)
+                    m_Unchanged++;
+                return draw(reasons);
+            }
+
+            m_Waiting = Busy;
+            if (!reasons) {
+                m_Waiting = Idle;
+                m_Unchanged++;
+                return false;
+            }
+            // restoring the window is an event of its own, the loop is woken up for it
+            if (iconified) {
+                m_Held = reasons;
+                m_Waiting = Idle;
+                m_Iconified++;
+                return false;
+            }
+            Clock::time_point now = Clock::now();
+            if (!focused && UnfocusedFps > 0.0) {
+                if (now < m_NextUnfocused) {
+                    m_Held = reasons;
+                    m_Waiting = Throttled;
+                    m_Throttled++;
+                    return false;
+                }
+                m_NextUnfocused = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / UnfocusedFps));
+            }
+            return draw(reasons);
+        }
+
+        // how long the loop may wait for events before the next frame, busy when something moves
+        double WaitSeconds(double busy) const {
+            if (!OnDemand || m_Waiting == Busy)
+                return busy;
+            if (m_Waiting == Idle)
+                return IdleSeconds;
+            double throttled = std::chrono::duration<double>(m_NextUnfocused - Clock::now()).count();
+            return throttled > busy ? throttled : busy;
+        }
+
+        // the simulation handed the render thread a frame
+        void NotifyPublished() {
+            {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_Publishes++;
+            }
+            m_Published.notify_one();
+        }
+
+        unsigned long long Publishes() {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            return m_Publishes;
+        }
+
+        // on the render thread, returns once there were more than seen publishes or after timeout
+        template<typename Duration>
+        void WaitForPublish(unsigned long long seen, Duration timeout) {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_Published.wait_for(lock, timeout, [this, seen] { return m_Publishes != seen; });
+        }
+
+        // the CPU time is what std::clock measures, for the whole process on POSIX systems
+        void Print(std::ostream &out) const {
+            double wall = std::chrono::duration<double>(Clock::now() - m_StartTime).count();
+            double cpu = (double)(std::clock() - m_StartCpu) / CLOCKS_PER_SEC;
+            if (OnDemand)
+                out << "REDRAW:: on demand, drew " << m_Drawn << " of " << m_Frames << " frames, skipped "
+                    << m_Unchanged << " with nothing new, held back " << m_Throttled << " out of focus and "
+                    << m_Iconified << " iconified" << std::endl;
+            else
+                out << "REDRAW:: continuous, drew " << m_Drawn << " frames, " << m_Unchanged
+                    << " of them with nothing new" << std::endl;
+            out << "REDRAW:: drawn for";
+            for (unsigned int i = 0; i < RedrawReasonCount; i++)
+                out << (i ? ", " : " ") << redrawReasonName(i) << " " << m_ReasonCounts[i];
+            out << std::endl;
+            if (wall > 0.0)
+                out << "REDRAW:: " << m_Drawn / wall << " frames per second, " << cpu << " s of CPU time in "
+                    << wall << " s, " << cpu / wall * 100.0 << "% of one core" << std::endl;
+        }
+
+    private:
+        enum Waiting {
+            Busy,
+            Idle,
+            Throttled
+        };
+
+        std::atomic<unsigned int> m_Invalidated{0};
+        // reasons of frames held back, drawn with the next one that may be
+        unsigned int m_Held = 0;
+        Waiting m_Waiting = Busy;
+        Clock::time_point m_NextUnfocused;
+
+        std::mutex m_Mutex;
+        std::condition_variable m_Published;
+        unsigned long long m_Publishes = 0;
+
+        Clock::time_point m_StartTime = Clock::now();
+        std::clock_t m_StartCpu = std::clock();
+        unsigned long long m_Frames = 0;
+        unsigned long long m_Drawn = 0;
+        unsigned long long m_Unchanged = 0;
+        unsigned long long m_Throttled = 0;
+        unsigned long long m_Iconified = 0;
+        unsigned long long m_ReasonCounts[RedrawReasonCount] = {};
+
+        bool draw(unsigned int reasons) {
+            for (unsigned int i = 0; i < RedrawReasonCount; i++)
+                if (reasons & (1u << i))
+                    m_ReasonCounts[i]++;
+            m_Drawn++;
+            return true;
+        }
+    };
+
+}
+
+#endif //PROJECT_BASE_REDRAWTRACKER_H
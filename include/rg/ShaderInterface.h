@@ -0,0 +1,81 @@
+#ifndef PROJECT_BASE_SHADERINTERFACE_H
+#define PROJECT_BASE_SHADERINTERFACE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+    // What a linked program actually reads, as reported by the driver: the locations of its active
+    // vertex attributes and the names of its active samplers. Inputs the compiler optimised away are
+    // not active, so a loader can leave out the data for them.
+    class ShaderInterface {
+    public:
+        // samplerPrefix is put in front of the names passed to UsesSampler, e.g. "material."
+        ShaderInterface(GLuint program, const std::string &samplerPrefix = "") : m_SamplerPrefix(samplerPrefix) {
+            GLint count = 0, maxLength = 0;
+            glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+            glGetProgramiv(program, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+            std::vector<GLchar> name(std::max(maxLength, 1));
+            for (GLint i = 0; i < count; i++) {
+                GLint size;
+                GLenum type;
+                glGetActiveAttrib(program, (GLuint)i, (GLsizei)name.size(), nullptr, &size, &type, name.data());
+                GLint location = glGetAttribLocation(program, name.data());
+                // built-ins like gl_VertexID have no location
+                if (location >= 0 && location < 32)
+                    m_AttributeMask |= 1u << location;
+            }
+
+            glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+            glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+            name.resize(std::max(maxLength, 1));
+            for (GLint i = 0; i < count; i++) {
+                GLint size;
+                GLenum type;
+                glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), nullptr, &size, &type, name.data());
+                if (isSamplerType(type))
+                    m_Samplers.insert(name.data());
+            }
+        }
+
+        bool UsesAttribute(GLuint location) const { return location < 32 && (m_AttributeMask & (1u << location)) != 0; }
+        // bit n set when the attribute at location n is read
+        unsigned int AttributeMask() const { return m_AttributeMask; }
+        bool UsesSampler(const std::string &name) const { return m_Samplers.count(m_SamplerPrefix + name) != 0; }
+
+    private:
+        unsigned int m_AttributeMask = 0;
+        std::set<std::string> m_Samplers;
+        std::string m_SamplerPrefix;
+
+        static bool isSamplerType(GLenum type) {
+            switch (type) {
+                case GL_SAMPLER_1D:
+                case GL_SAMPLER_2D:
+                case GL_SAMPLER_3D:
+                case GL_SAMPLER_CUBE:
+                case GL_SAMPLER_2D_SHADOW:
+                case GL_SAMPLER_1D_ARRAY:
+                case GL_SAMPLER_2D_ARRAY:
+                case GL_SAMPLER_2D_ARRAY_SHADOW:
+                case GL_SAMPLER_CUBE_SHADOW:
+                case GL_SAMPLER_2D_RECT:
+                case GL_SAMPLER_BUFFER:
+                case GL_SAMPLER_2D_MULTISAMPLE:
+                case GL_INT_SAMPLER_2D:
+                case GL_UNSIGNED_INT_SAMPLER_2D:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+    };
+
+}
+
+#endif //PROJECT_BASE_SHADERINTERFACE_H
@@ -0,0 +1,180 @@
+#ifndef PROJECT_BASE_STATICBATCH_H
+#define PROJECT_BASE_STATICBATCH_H
+
+#include <glm/glm.hpp>
+#include <learnopengl/model.h>
+#include <rg/ShaderInterface.h>
+#include <rg/WorkerPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace rg {
+
+    // Scene objects that never move, transformed into world space once at load and merged.
+    //
+    // Every mesh of the added models is baked with its model matrix, then Build() concatenates the
+    // meshes that share a material and vertex format and lie in the same world space chunk into one
+    // mesh. The result is a single Model drawn with an identity model matrix: one multi-draw per
+    // material and format instead of one per model, and one draw command per chunk instead of one per
+    // source mesh. Chunking keeps the merged meshes small enough for Model::Cull to still drop what
+    // is off screen.
+    class StaticBatch {
+    public:
+        // edge of the cubic world space chunks meshes are merged within
+        float ChunkSize = 4.0f;
+        // false keeps every baked mesh on its own, for comparing the draw counts and frame times
+        bool Merge = true;
+
+        // loads the model at path and keeps its meshes transformed by model. Meshes that come without
+        // textures get fallbackTextures, for models whose maps are bound by hand.
+        void Add(const std::string &path, const glm::mat4 &model, const ShaderInterface *shader = nullptr,
+                 const std::vector<Texture> &fallbackTextures = std::vector<Texture>()) {
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+            glm::mat3 tangentMatrix = glm::mat3(model);
+            std::vector<std::pair<unsigned int, unsigned int>> modelGroups;
+
+            Model source(path, false, shader, [&](std::vector<Vertex> &vertices, std::vector<unsigned int> &indices,
+                                                  std::vector<Texture> &textures, unsigned int attributeMask) {
+                Piece piece;
+                piece.vertices = std::move(vertices);
+                piece.indices = std::move(indices);
+                piece.attributeMask = attributeMask;
+                piece.material = findOrAddMaterial(textures.empty() ? fallbackTextures : textures);
+
+                // large meshes are baked in ranges on the worker pool
+                std::vector<Vertex> &baked = piece.vertices;
+                parallelFor(workerPool(), baked.size(), 16384, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; i++) {
+                        Vertex &vertex = baked[i];
+                        vertex.Position = glm::vec3(model * glm::vec4(vertex.Position, 1.0f));
+                        vertex.Normal = safeNormalize(normalMatrix * vertex.Normal);
+                        vertex.Tangent = safeNormalize(tangentMatrix * vertex.Tangent);
+                        vertex.Bitangent = safeNormalize(tangentMatrix * vertex.Bitangent);
+                    }
+                });
+                glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+                for (size_t i = 0; i < piece.vertices.size(); i++) {
+                    const Vertex &vertex = piece.vertices[i];
+                    boundsMin = i == 0 ? vertex.Position : glm::min(boundsMin, vertex.Position);
+                    boundsMax = i == 0 ? vertex.Position : glm::max(boundsMax, vertex.Position);
+                }
+                glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+                piece.chunkX = (int)std::floor(center.x / ChunkSize);
+                piece.chunkY = (int)std::floor(center.y / ChunkSize);
+                piece.chunkZ = (int)std::floor(center.z / ChunkSize);
+
+                // the model on its own would have drawn each material and format with a multi-draw of its own
+                std::pair<unsigned int, unsigned int> group(piece.material, piece.attributeMask);
+                if (std::find(modelGroups.begin(), modelGroups.end(), group) == modelGroups.end())
+                    modelGroups.push_back(group);
+                m_Pieces.push_back(std::move(piece));
+                m_SourceMeshes++;
+            });
+
+            m_SourceModels++;
+            m_SourceDraws += (unsigned int)modelGroups.size();
+            m_PruneStats.skippedTextures += source.pruneStats.skippedTextures;
+            m_PruneStats.skippedTextureBytes += source.pruneStats.skippedTextureBytes;
+            m_PruneStats.loadMilliseconds += source.pruneStats.loadMilliseconds;
+        }
+
+        // merges and uploads everything added so far; the baked vertices are released afterwards
+        Model Build() {
+            auto start = std::chrono::steady_clock::now();
+            Model result;
+            result.pruneStats = m_PruneStats;
+
+            // material, vertex format and chunk of each merged mesh, map order keeps the build deterministic
+            typedef std::tuple<unsigned int, unsigned int, int, int, int> Key;
+            std::map<Key, std::vector<size_t>> merged;
+            for (size_t i = 0; i < m_Pieces.size(); i++) {
+                const Piece &piece = m_Pieces[i];
+                if (Merge)
+                    merged[Key(piece.material, piece.attributeMask, piece.chunkX, piece.chunkY, piece.chunkZ)].push_back(i);
+                else
+                    merged[Key(piece.material, piece.attributeMask, 0, 0, (int)i)].push_back(i);
+            }
+
+            for (const auto &entry : merged) {
+                std::vector<Vertex> vertices;
+                std::vector<unsigned int> indices;
+                for (size_t i : entry.second) {
+                    const Piece &piece = m_Pieces[i];
+                    unsigned int baseVertex = (unsigned int)vertices.size();
+                    vertices.insert(vertices.end(), piece.vertices.begin(), piece.vertices.end());
+                    for (unsigned int index : piece.indices)
+                        indices.push_back(baseVertex + index);
+                }
+                Mesh mesh(vertices, indices, m_Materials[std::get<0>(entry.first)], std::get<1>(entry.first));
+                result.pruneStats.skippedVertexBytes += vertices.size() * (sizeof(Vertex) - mesh.vertexStride);
+                result.AddMesh(mesh);
+            }
+
+            m_BuildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            m_MergedMeshes = (unsigned int)result.meshes.Size();
+            m_MergedDraws = result.GetDrawGroupCount();
+            m_Pieces.clear();
+            m_Pieces.shrink_to_fit();
+            return result;
+        }
+
+        void PrintStats(std::ostream &out) const {
+            out << "STATIC_BATCH:: " << m_SourceModels << " models, " << m_SourceMeshes << " meshes in " << m_SourceDraws
+                << " multi-draws baked into " << m_MergedMeshes << " meshes in " << m_MergedDraws << " multi-draws ("
+                << (Merge ? "merged" : "not merged") << ", " << ChunkSize << " unit chunks), built in "
+                << m_BuildMilliseconds << " ms" << std::endl;
+        }
+
+    private:
+        // a baked mesh waiting for Build
+        struct Piece {
+            std::vector<Vertex> vertices;
+            std::vector<unsigned int> indices;
+            unsigned int material = 0;
+            unsigned int attributeMask = 0;
+            int chunkX = 0, chunkY = 0, chunkZ = 0;
+        };
+
+        std::vector<Piece> m_Pieces;
+        // distinct texture lists, shared by every model that uses the same textures
+        std::vector<std::vector<Texture>> m_Materials;
+        Model::PruneStats m_PruneStats;
+        unsigned int m_SourceModels = 0;
+        unsigned int m_SourceMeshes = 0;
+        unsigned int m_SourceDraws = 0;
+        unsigned int m_MergedMeshes = 0;
+        unsigned int m_MergedDraws = 0;
+        double m_BuildMilliseconds = 0.0;
+
+        unsigned int findOrAddMaterial(const std::vector<Texture> &textures) {
+            for (unsigned int m = 0; m < m_Materials.size(); m++) {
+                const std::vector<Texture> &material = m_Materials[m];
+                if (material.size() != textures.size())
+                    continue;
+                bool same = true;
+                for (size_t t = 0; t < textures.size() && same; t++)
+                    same = material[t].id == textures[t].id && material[t].slot == textures[t].slot;
+                if (same)
+                    return m;
+            }
+            m_Materials.push_back(textures);
+            return (unsigned int)m_Materials.size() - 1;
+        }
+
+        // attributes a mesh does not have are zero and stay zero
+        static glm::vec3 safeNormalize(const glm::vec3 &v) {
+            float length = glm::length(v);
+            return length > 0.0f ? v / length : v;
+        }
+    };
+
+}
+
+#endif //PROJECT_BASE_STATICBATCH_H
@@ -0,0 +1,174 @@
+#ifndef PROJECT_BASE_STREAMBUFFER_H
+#define PROJECT_BASE_STREAMBUFFER_H
+
+#include <glad/glad.h>
+#include <rg/GLExtensions.h>
+
+#include <iostream>
+
+namespace rg {
+
+    // Ring buffer for data that is rewritten every frame (camera, lights, instance attributes).
+    //
+    // The buffer is split into one region per frame in flight. A frame only writes into its own
+    // region and puts a fence behind the draw calls that read it; before the region comes around
+    // again the fence is waited on, so the GPU is never reading what the CPU writes and the driver
+    // never has to synchronise or orphan the buffer on our behalf.
+    //
+    // With ARB_buffer_storage the whole buffer is mapped once, persistently and coherently. On plain
+    // 3.3 the free part of the current region is mapped with GL_MAP_UNSYNCHRONIZED_BIT (the fence
+    // already guarantees it is idle) and unmapped again by Commit() before it is drawn from.
+    class StreamBuffer {
+    public:
+        static const unsigned int DefaultFramesInFlight = 3;
+
+        StreamBuffer(GLsizeiptr bytesPerFrame, unsigned int framesInFlight = DefaultFramesInFlight)
+                : m_FrameSize(bytesPerFrame), m_FrameCount(framesInFlight) {
+            m_Fences = new GLsync[m_FrameCount]();
+            glGenBuffers(1, &m_Buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+
+            m_Persistent = glExtensions().BufferStorage;
+            if (m_Persistent) {
+                GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glExtensions().BufferStorageFunc(GL_COPY_WRITE_BUFFER, Size(), nullptr, flags);
+                m_PersistentPointer = (char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, Size(), flags);
+                if (!m_PersistentPointer) {
+                    std::cout << "ERROR::STREAM_BUFFER::PERSISTENT_MAP_FAILED, falling back to unsynchronized mapping" << std::endl;
+                    glDeleteBuffers(1, &m_Buffer);
+                    glGenBuffers(1, &m_Buffer);
+                    glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+                    m_Persistent = false;
+                }
+            }
+            if (!m_Persistent)
+                glBufferData(GL_COPY_WRITE_BUFFER, Size(), nullptr, GL_STREAM_DRAW);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &m_UniformAlignment);
+        }
+
+        StreamBuffer(const StreamBuffer &) = delete;
+        StreamBuffer &operator=(const StreamBuffer &) = delete;
+
+        ~StreamBuffer() {
+            delete[] m_Fences;
+        }
+
+        // waits until the GPU is done with the region this frame is about to overwrite
+        void BeginFrame() {
+            m_Frame = (m_Frame + 1) % m_FrameCount;
+            m_Head = 0;
+
+            GLsync &fence = m_Fences[m_Frame];
+            if (fence) {
+                GLenum status = glClientWaitSync(fence, 0, 0);
+                if (status == GL_TIMEOUT_EXPIRED) {
+                    m_Stalls++;
+                    while (status == GL_TIMEOUT_EXPIRED)
+                        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+                }
+                glDeleteSync(fence);
+                fence = nullptr;
+            }
+        }
+
+        // reserves size bytes in the current frame region and returns where to write them,
+        // offset receives the position inside Buffer() for glBindBufferRange/glVertexAttribPointer
+        void *Allocate(GLsizeiptr size, GLintptr alignment, GLintptr &offset) {
+            GLintptr start = (m_Head + alignment - 1) / alignment * alignment;
+            if (start + size > m_FrameSize) {
+                std::cout << "ERROR::STREAM_BUFFER::FRAME_BUDGET_EXCEEDED " << start + size << " > " << m_FrameSize << std::endl;
+                return nullptr;
+            }
+            if (!m_Persistent && !m_MappedPointer && !mapFrom(start))
+                return nullptr;
+
+            m_Head = start + size;
+            offset = FrameOffset() + start;
+            char *base = m_Persistent ? m_PersistentPointer + FrameOffset() : m_MappedPointer - m_MappedStart;
+            return base + start;
+        }
+
+        // uniform blocks must start at GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+        void *AllocateUniform(GLsizeiptr size, GLintptr &offset) {
+            return Allocate(size, m_UniformAlignment, offset);
+        }
+
+        // makes everything written so far visible to GL, must be called before drawing from it
+        void Commit() {
+            if (m_Persistent || !m_MappedPointer)
+                return;
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+            if (m_Head > m_MappedStart)
+                glFlushMappedBufferRange(GL_COPY_WRITE_BUFFER, 0, m_Head - m_MappedStart);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            m_MappedPointer = nullptr;
+        }
+
+        // fences the draw calls issued this frame, call after the last draw that reads the region
+        void EndFrame() {
+            Commit();
+            m_Fences[m_Frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        GLuint Buffer() const { return m_Buffer; }
+        GLsizeiptr Size() const { return m_FrameSize * m_FrameCount; }
+        GLsizeiptr FrameSize() const { return m_FrameSize; }
+        GLintptr FrameOffset() const { return m_FrameSize * m_Frame; }
+        bool IsPersistent() const { return m_Persistent; }
+        // number of frames that had to wait for the GPU before writing
+        unsigned long Stalls() const { return m_Stalls; }
+
+        void Release() {
+            for (unsigned int i = 0; i < m_FrameCount; i++) {
+                if (m_Fences[i])
+                    glDeleteSync(m_Fences[i]);
+                m_Fences[i] = nullptr;
+            }
+            if (m_Persistent) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+                glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            } else {
+                Commit();
+            }
+            glDeleteBuffers(1, &m_Buffer);
+            m_Buffer = 0;
+        }
+
+    private:
+        GLsizeiptr m_FrameSize;
+        unsigned int m_FrameCount;
+        GLsync *m_Fences = nullptr;
+        GLuint m_Buffer = 0;
+        GLint m_UniformAlignment = 256;
+
+        unsigned int m_Frame = 0;
+        GLintptr m_Head = 0;
+
+        bool m_Persistent = false;
+        char *m_PersistentPointer = nullptr;
+        char *m_MappedPointer = nullptr;
+        GLintptr m_MappedStart = 0;
+
+        unsigned long m_Stalls = 0;
+
+        // maps the rest of the current region, the fence waited on in BeginFrame makes it safe to skip
+        // the driver's own synchronisation
+        bool mapFrom(GLintptr start) {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, m_Buffer);
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT;
+            m_MappedPointer = (char *)glMapBufferRange(GL_COPY_WRITE_BUFFER, FrameOffset() + start, m_FrameSize - start, flags);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+            m_MappedStart = start;
+            if (!m_MappedPointer)
+                std::cout << "ERROR::STREAM_BUFFER::MAP_FAILED" << std::endl;
+            return m_MappedPointer != nullptr;
+        }
+    };
+
+}
+
+#endif //PROJECT_BASE_STREAMBUFFER_H
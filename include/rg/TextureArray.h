@@ -0,0 +1,184 @@
+#ifndef PROJECT_BASE_TEXTUREARRAY_H
+#define PROJECT_BASE_TEXTUREARRAY_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+#include <rg/GLState.h>
+#include <rg/TextureFormat.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+    // bilinear resample of a tightly packed RGBA8 image, texel centres are mapped onto each other
+    // so the edges stay put for any scale factor
+    inline void resizeImageRGBA8(const unsigned char *source, int sourceWidth, int sourceHeight,
+                                 unsigned char *destination, int width, int height) {
+        float scaleX = (float)sourceWidth / (float)width;
+        float scaleY = (float)sourceHeight / (float)height;
+        for (int y = 0; y < height; y++) {
+            float sy = std::max((y + 0.5f) * scaleY - 0.5f, 0.0f);
+            int y0 = std::min((int)sy, sourceHeight - 1);
+            int y1 = std::min(y0 + 1, sourceHeight - 1);
+            float fy = sy - (float)y0;
+            for (int x = 0; x < width; x++) {
+                float sx = std::max((x + 0.5f) * scaleX - 0.5f, 0.0f);
+                int x0 = std::min((int)sx, sourceWidth - 1);
+                int x1 = std::min(x0 + 1, sourceWidth - 1);
+                float fx = sx - (float)x0;
+
+                const unsigned char *p00 = source + (y0 * sourceWidth + x0) * 4;
+                const unsigned char *p10 = source + (y0 * sourceWidth + x1) * 4;
+                const unsigned char *p01 = source + (y1 * sourceWidth + x0) * 4;
+                const unsigned char *p11 = source + (y1 * sourceWidth + x1) * 4;
+                unsigned char *out = destination + (y * width + x) * 4;
+                for (int c = 0; c < 4; c++) {
+                    float top = p00[c] + (p10[c] - p00[c]) * fx;
+                    float bottom = p01[c] + (p11[c] - p01[c]) * fx;
+                    out[c] = (unsigned char)(top + (bottom - top) * fy + 0.5f);
+                }
+            }
+        }
+    }
+
+    // copies a tightly packed RGBA8 image into the top left corner of a larger one and fills the rest
+    // with its last column and row, so filtering and mipmaps at its edges see no foreign texels
+    inline void padImageRGBA8(const unsigned char *source, int sourceWidth, int sourceHeight,
+                              unsigned char *destination, int width, int height) {
+        for (int y = 0; y < height; y++) {
+            const unsigned char *row = source + (size_t)std::min(y, sourceHeight - 1) * sourceWidth * 4;
+            unsigned char *out = destination + (size_t)y * width * 4;
+            std::copy(row, row + (size_t)sourceWidth * 4, out);
+            for (int x = sourceWidth; x < width; x++)
+                std::copy(row + (size_t)(sourceWidth - 1) * 4, row + (size_t)sourceWidth * 4, out + (size_t)x * 4);
+        }
+    }
+
+    // A GL_TEXTURE_2D_ARRAY built from separate image files, so a set of materials can be bound once
+    // and picked per instance by layer instead of rebinding a texture for every draw.
+    //
+    // Every layer has to have the same size. Smaller images are not resampled but padded, they keep
+    // their texels in the top left corner and LayerScale gives the part of the layer they cover, to be
+    // multiplied into texture coordinates that span 0..1; past that the padding shows, so they cannot
+    // repeat. Only images larger than an explicitly given size are scaled down. Arrays are best kept
+    // to images of about the same size, everything else is wasted on padding.
+    // A file that fails to load leaves a white layer so the indices of the others do not shift.
+    // The usage picks the stored channels like for single textures, alpha is only dropped when it is
+    // opaque in every layer.
+    class TextureArray {
+    public:
+        // width and height 0 take the size of the largest image
+        bool Load(const std::vector<std::string> &paths, int width = 0, int height = 0, TextureUsage usage = TextureUsage::Color) {
+            std::vector<unsigned char *> images(paths.size(), nullptr);
+            std::vector<int> widths(paths.size(), 0), heights(paths.size(), 0);
+            // what the images would have taken as separate textures, at their own size and components
+            unsigned long decoded = 0;
+            bool loaded = true;
+            for (size_t i = 0; i < paths.size(); i++) {
+                int components = 0;
+                images[i] = stbi_load(paths[i].c_str(), &widths[i], &heights[i], &components, 4);
+                if (!images[i]) {
+                    std::cout << "ERROR::TEXTURE_ARRAY::LOAD_FAILED " << paths[i] << std::endl;
+                    loaded = false;
+                    continue;
+                }
+                decoded += textureMemory(widths[i], heights[i], components);
+                if (width == 0 || height == 0) {
+                    m_Width = std::max(m_Width, widths[i]);
+                    m_Height = std::max(m_Height, heights[i]);
+                }
+            }
+            if (width != 0 && height != 0) {
+                m_Width = width;
+                m_Height = height;
+            }
+            m_Width = std::max(m_Width, 1);
+            m_Height = std::max(m_Height, 1);
+            m_Layers = (int)paths.size();
+            m_Scales.assign(paths.size(), glm::vec2(1.0f));
+
+            int channels = 4;
+            if (usage == TextureUsage::Mask) {
+                channels = 1;
+            } else if (usage == TextureUsage::Normal) {
+                channels = 2;
+            } else {
+                bool opaque = true;
+                for (size_t i = 0; i < images.size() && opaque; i++)
+                    opaque = !images[i] || isAlphaOpaque(images[i], widths[i], heights[i], 4);
+                channels = opaque ? 3 : 4;
+            }
+            TextureFormat format = textureFormatForChannels(channels);
+
+            glGenTextures(1, &m_Texture);
+            glState().BindTexture(0, GL_TEXTURE_2D_ARRAY, m_Texture);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format.internalFormat, m_Width, m_Height, m_Layers, 0, format.format, GL_UNSIGNED_BYTE, nullptr);
+
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            std::vector<unsigned char> layer((size_t)m_Width * m_Height * 4);
+            for (int i = 0; i < m_Layers; i++) {
+                if (!images[i])
+                    std::fill(layer.begin(), layer.end(), (unsigned char)255);
+                else if (widths[i] > m_Width || heights[i] > m_Height)
+                    resizeImageRGBA8(images[i], widths[i], heights[i], layer.data(), m_Width, m_Height);
+                else if (widths[i] != m_Width || heights[i] != m_Height) {
+                    padImageRGBA8(images[i], widths[i], heights[i], layer.data(), m_Width, m_Height);
+                    m_Scales[i] = glm::vec2((float)widths[i] / (float)m_Width, (float)heights[i] / (float)m_Height);
+                } else
+                    std::copy(images[i], images[i] + layer.size(), layer.begin());
+                repackChannels(layer.data(), (long)m_Width * m_Height, 4, channels);
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, m_Width, m_Height, 1, format.format, GL_UNSIGNED_BYTE, layer.data());
+                if (images[i])
+                    stbi_image_free(images[i]);
+            }
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+            // padding and the shared channel count can make the array larger than the separate textures
+            unsigned long stored = textureMemory(m_Width, m_Height, channels) * m_Layers;
+            if (stored < decoded) {
+                textureMemorySaved() += decoded - stored;
+                std::cout << "TEXTURE_FORMAT:: array of " << m_Layers << " layers, " << channels
+                          << " channels, saved " << (decoded - stored) / 1024 << " KB" << std::endl;
+            } else if (stored > decoded) {
+                std::cout << "TEXTURE_FORMAT:: array of " << m_Layers << " layers, " << channels
+                          << " channels, " << (stored - decoded) / 1024 << " KB more than separate textures" << std::endl;
+            }
+
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            return loaded;
+        }
+
+        GLuint Id() const { return m_Texture; }
+        int Layers() const { return m_Layers; }
+        int Width() const { return m_Width; }
+        int Height() const { return m_Height; }
+        // the part of the layer its image covers, (1, 1) unless it was padded
+        glm::vec2 LayerScale(int layer) const {
+            return layer >= 0 && layer < (int)m_Scales.size() ? m_Scales[layer] : glm::vec2(1.0f);
+        }
+
+        void Release() {
+            if (m_Texture)
+                glDeleteTextures(1, &m_Texture);
+            m_Texture = 0;
+        }
+
+    private:
+        GLuint m_Texture = 0;
+        int m_Width = 0;
+        int m_Height = 0;
+        int m_Layers = 0;
+        std::vector<glm::vec2> m_Scales;
+    };
+
+}
+
+#endif //PROJECT_BASE_TEXTUREARRAY_H
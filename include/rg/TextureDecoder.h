@@ -0,0 +1,174 @@
+#ifndef PROJECT_BASE_TEXTUREDECODER_H
+#define PROJECT_BASE_TEXTUREDECODER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+#include <rg/GLState.h>
+#include <rg/MipChain.h>
+#include <rg/TextureFormat.h>
+#include <rg/WorkerPool.h>
+
+#include <chrono>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rg {
+
+    // an image decoded, repacked to the channels its usage needs and with its whole mip chain
+    struct DecodedTexture {
+        std::string path;
+        int components = 0;
+        TextureFormat format = {GL_RGBA8, GL_RGBA, 4};
+        // empty when the image failed to load
+        std::vector<MipLevel> levels;
+        double milliseconds = 0.0;
+    };
+
+    // the CPU half of loading a texture, safe to run on any thread; colour maps are filtered in linear light
+    inline DecodedTexture decodeTexture(const std::string &path, TextureUsage usage) {
+        auto start = std::chrono::steady_clock::now();
+        DecodedTexture decoded;
+        decoded.path = path;
+        int width, height;
+        unsigned char *data = stbi_load(path.c_str(), &width, &height, &decoded.components, 0);
+        if (data) {
+            decoded.format = selectTextureFormat(usage, data, width, height, decoded.components);
+            decoded.levels = buildMipChain(data, width, height, decoded.format.channels, usage == TextureUsage::Color);
+            stbi_image_free(data);
+        }
+        decoded.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        return decoded;
+    }
+
+    // Decodes images and builds their mip chains on the worker pool while the GL thread keeps rendering.
+    // Poll() hands every finished image to its callback on the GL thread, which does the uploads.
+    class TextureDecoder {
+    public:
+        typedef std::function<void(GLuint, DecodedTexture &)> Callback;
+
+        void Decode(GLuint texture, const std::string &path, TextureUsage usage, Callback done) {
+            Job job;
+            job.texture = texture;
+            job.done = std::move(done);
+            job.result = workerPool().Submit([path, usage] { return decodeTexture(path, usage); });
+            m_Jobs.push_back(std::move(job));
+        }
+
+        // runs the callbacks of the images that are ready, call once per frame on the GL thread
+        void Poll() {
+            for (size_t i = 0; i < m_Jobs.size();) {
+                if (m_Jobs[i].result.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+                    Job job = std::move(m_Jobs[i]);
+                    m_Jobs.erase(m_Jobs.begin() + i);
+                    finish(job);
+                } else {
+                    i++;
+                }
+            }
+        }
+
+        // blocks until everything submitted so far is decoded and handed over, for startup
+        void Wait() {
+            for (Job &job : m_Jobs)
+                finish(job);
+            m_Jobs.clear();
+        }
+
+        size_t Pending() const { return m_Jobs.size(); }
+        // images handed over so far and the worker time spent on them
+        unsigned int Decoded() const { return m_Decoded; }
+        double Milliseconds() const { return m_Milliseconds; }
+
+    private:
+        struct Job {
+            GLuint texture = 0;
+            Callback done;
+            std::future<DecodedTexture> result;
+        };
+
+        std::vector<Job> m_Jobs;
+        unsigned int m_Decoded = 0;
+        double m_Milliseconds = 0.0;
+
+        void finish(Job &job) {
+            DecodedTexture decoded = job.result.get();
+            m_Decoded++;
+            m_Milliseconds += decoded.milliseconds;
+            if (decoded.levels.empty()) {
+                std::cout << "Texture failed to load at path: " << decoded.path << std::endl;
+                return;
+            }
+            const MipLevel &top = decoded.levels[0];
+            reportTextureFormat(decoded.path, top.width, top.height, decoded.components, decoded.format);
+            job.done(job.texture, decoded);
+        }
+    };
+
+    inline TextureDecoder &textureDecoder() {
+        static TextureDecoder decoder;
+        return decoder;
+    }
+
+    // Times building the mip chain of a size x size RGB image on the CPU against glGenerateMipmap on the
+    // current context, both from level 0 already in memory. glFinish waits for the GPU (or llvmpipe)
+    // so the driver's deferred work is counted too.
+    inline void benchmarkMipmapGeneration(std::ostream &out, int size = 2048, int runs = 5) {
+        std::vector<unsigned char> image((size_t)size * size * 3);
+        unsigned int seed = 1;
+        for (unsigned char &value : image) {
+            seed = seed * 1664525u + 1013904223u;
+            value = (unsigned char)(seed >> 24);
+        }
+
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glState().BindTexture(0, GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, size, size, 0, GL_RGB, GL_UNSIGNED_BYTE, image.data());
+        glFinish();
+
+        double gpu = 0.0, cpu = 0.0, cpuSrgb = 0.0, upload = 0.0;
+        for (int run = 0; run < runs; run++) {
+            auto start = std::chrono::steady_clock::now();
+            glGenerateMipmap(GL_TEXTURE_2D);
+            glFinish();
+            auto end = std::chrono::steady_clock::now();
+            gpu += std::chrono::duration<double, std::milli>(end - start).count();
+
+            start = std::chrono::steady_clock::now();
+            std::vector<MipLevel> levels = buildMipChain(image.data(), size, size, 3);
+            end = std::chrono::steady_clock::now();
+            cpu += std::chrono::duration<double, std::milli>(end - start).count();
+
+            start = std::chrono::steady_clock::now();
+            buildMipChain(image.data(), size, size, 3, true);
+            end = std::chrono::steady_clock::now();
+            cpuSrgb += std::chrono::duration<double, std::milli>(end - start).count();
+
+            // what the GL thread still pays when the chain comes from a worker
+            start = std::chrono::steady_clock::now();
+            for (size_t level = 1; level < levels.size(); level++)
+                glTexImage2D(GL_TEXTURE_2D, (GLint)level, GL_RGB8, levels[level].width, levels[level].height, 0, GL_RGB,
+                             GL_UNSIGNED_BYTE, levels[level].data.data());
+            glFinish();
+            end = std::chrono::steady_clock::now();
+            upload += std::chrono::duration<double, std::milli>(end - start).count();
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glDeleteTextures(1, &texture);
+
+        out << "MIPMAP_BENCHMARK:: " << size << "x" << size << " RGB8, average of " << runs << " runs on "
+            << glGetString(GL_RENDERER) << "\n"
+            << "  glGenerateMipmap         " << gpu / runs << " ms on the GL thread\n"
+            << "  CPU box filter           " << cpu / runs << " ms on a worker\n"
+            << "  CPU box filter, sRGB     " << cpuSrgb / runs << " ms on a worker\n"
+            << "  upload of levels 1..n    " << upload / runs << " ms on the GL thread\n"
+            << "  " << workerPool().ThreadCount() << " workers build that many chains at once" << std::endl;
+    }
+
+}
+
+#endif //PROJECT_BASE_TEXTUREDECODER_H
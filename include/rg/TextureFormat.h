@@ -0,0 +1,117 @@
+#ifndef PROJECT_BASE_TEXTUREFORMAT_H
+#define PROJECT_BASE_TEXTUREFORMAT_H
+
+#include <glad/glad.h>
+
+#include <iostream>
+#include <string>
+
+namespace rg {
+
+    // what the shaders read from a texture, decides how many channels are worth storing
+    enum class TextureUsage {
+        // diffuse and other colour maps, alpha only when the image has any
+        Color,
+        // specular, height and AO maps, the shaders read a single channel (.xxx)
+        Mask,
+        // tangent space normal maps, only xy are kept and z has to be rebuilt from them
+        Normal
+    };
+
+    struct TextureFormat {
+        GLint internalFormat;
+        GLenum format;
+        int channels;
+        // a colour map kept as grey in R, and alpha in G when there are two channels
+        bool grey = false;
+    };
+
+    inline TextureFormat textureFormatForChannels(int channels) {
+        switch (channels) {
+            case 1: return {GL_R8, GL_RED, 1};
+            case 2: return {GL_RG8, GL_RG, 2};
+            case 3: return {GL_RGB8, GL_RGB, 3};
+            default: return {GL_RGBA8, GL_RGBA, 4};
+        }
+    }
+
+    // keeps the first `channels` of every texel, in place
+    inline void repackChannels(unsigned char *pixels, long count, int components, int channels) {
+        if (channels >= components)
+            return;
+        for (long i = 0; i < count; i++) {
+            for (int c = 0; c < channels; c++)
+                pixels[i * channels + c] = pixels[i * components + c];
+        }
+    }
+
+    inline bool isAlphaOpaque(const unsigned char *pixels, int width, int height, int components) {
+        if (components != 2 && components != 4)
+            return true;
+        for (long i = 0; i < (long)width * height; i++) {
+            if (pixels[i * components + components - 1] != 255)
+                return false;
+        }
+        return true;
+    }
+
+    // Picks the smallest uncompressed format that keeps everything the shader reads and repacks the
+    // stb_image pixels in place to match, the result is never more channels than the image has:
+    //   Mask   -> R8, the first channel
+    //   Normal -> RG8
+    //   Color  -> RGB8 when alpha is missing or opaque, RGBA8 otherwise; grey images stay R8 (or RG8
+    //             with alpha) and are marked grey, applyTextureSwizzle makes them sample as grey
+    inline TextureFormat selectTextureFormat(TextureUsage usage, unsigned char *pixels, int width, int height, int components) {
+        int channels = components;
+        switch (usage) {
+            case TextureUsage::Mask:
+                channels = 1;
+                break;
+            case TextureUsage::Normal:
+                channels = components >= 2 ? 2 : components;
+                break;
+            case TextureUsage::Color:
+                if (components == 4 && isAlphaOpaque(pixels, width, height, components))
+                    channels = 3;
+                else if (components == 2 && isAlphaOpaque(pixels, width, height, components))
+                    channels = 1;
+                break;
+        }
+
+        repackChannels(pixels, (long)width * height, components, channels);
+        TextureFormat format = textureFormatForChannels(channels);
+        format.grey = usage == TextureUsage::Color && channels <= 2;
+        return format;
+    }
+
+    // on the texture bound to target; grey colour maps would otherwise sample as red (and green)
+    inline void applyTextureSwizzle(GLenum target, const TextureFormat &format) {
+        if (!format.grey)
+            return;
+        GLint swizzle[4] = {GL_RED, GL_RED, GL_RED, format.channels == 2 ? GL_GREEN : GL_ONE};
+        glTexParameteriv(target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+
+    // level 0 plus a full mip chain
+    inline unsigned long textureMemory(int width, int height, int channels) {
+        return (unsigned long)width * height * channels * 4 / 3;
+    }
+
+    // total bytes the format selection kept out of VRAM, compared to storing every image as decoded
+    inline unsigned long &textureMemorySaved() {
+        static unsigned long saved = 0;
+        return saved;
+    }
+
+    inline void reportTextureFormat(const std::string &path, int width, int height, int components, const TextureFormat &format) {
+        if (format.channels >= components)
+            return;
+        unsigned long saved = textureMemory(width, height, components) - textureMemory(width, height, format.channels);
+        textureMemorySaved() += saved;
+        std::cout << "TEXTURE_FORMAT:: " << path << " " << components << " -> " << format.channels
+                  << " channels, saved " << saved / 1024 << " KB" << std::endl;
+    }
+
+}
+
+#endif //PROJECT_BASE_TEXTUREFORMAT_H
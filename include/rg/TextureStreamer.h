@@ -0,0 +1,268 @@
+#ifndef PROJECT_BASE_TEXTURESTREAMER_H
+#define PROJECT_BASE_TEXTURESTREAMER_H
+
+#include <glad/glad.h>
+#include <imgui.h>
+#include <rg/GLState.h>
+#include <rg/MipChain.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace rg {
+
+    // Keeps only the mip levels of a texture that are actually visible in VRAM.
+    //
+    // Add() takes the whole chain on the CPU but only uploads the levels no larger than ResidentSize,
+    // the texture is clamped to them with GL_TEXTURE_BASE_LEVEL. Every frame the renderer reports how
+    // much of each texture lands on one pixel (Request), which gives the finest level the sampler can
+    // pick. Update() then streams the missing levels in, one whole level at a time and coarse to fine,
+    // within BytesPerFrame, and lowers BASE_LEVEL as each arrives. When the resident levels exceed
+    // MemoryBudget the finest ones that nothing asked for are evicted first.
+    //
+    // A texture that was not requested in a frame keeps what it has until the budget needs the memory.
+    class TextureStreamer {
+    public:
+        size_t MemoryBudget;
+        size_t BytesPerFrame;
+        // levels with both sides at most this many texels never leave VRAM
+        int ResidentSize;
+
+        TextureStreamer(size_t memoryBudget = 64 * 1024 * 1024, size_t bytesPerFrame = 2 * 1024 * 1024, int residentSize = 64)
+                : MemoryBudget(memoryBudget), BytesPerFrame(bytesPerFrame), ResidentSize(residentSize) {
+        }
+
+        TextureStreamer(const TextureStreamer &) = delete;
+        TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+        // levels[0] is the full size image, every next one half of the previous down to 1x1; compressed
+        // levels hold blocks of internalFormat, the others texels of format
+        void Add(GLuint texture, GLenum internalFormat, GLenum format, bool compressed, std::vector<MipLevel> levels,
+                 const std::string &name) {
+            if (levels.empty())
+                return;
+
+            Entry entry;
+            entry.texture = texture;
+            entry.internalFormat = internalFormat;
+            entry.format = format;
+            entry.compressed = compressed;
+            entry.name = name;
+            entry.levels = std::move(levels);
+            entry.residentLevel = (int)entry.levels.size() - 1;
+            for (int level = 0; level < (int)entry.levels.size(); level++) {
+                if (std::max(entry.levels[level].width, entry.levels[level].height) <= ResidentSize) {
+                    entry.residentLevel = level;
+                    break;
+                }
+            }
+            entry.baseLevel = (int)entry.levels.size();
+            entry.requestedLevel = entry.residentLevel;
+
+            glState().BindTexture(0, GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)entry.levels.size() - 1);
+            while (entry.baseLevel > entry.residentLevel)
+                uploadLevel(entry, entry.baseLevel - 1);
+
+            m_Index[texture] = m_Entries.size();
+            m_Entries.push_back(std::move(entry));
+        }
+
+        // forgets the requests of the previous frame, call before the first Request of a frame
+        void BeginFrame() {
+            for (Entry &entry : m_Entries)
+                entry.requested = false;
+        }
+
+        // texture is drawn so that uvPerPixel texture coordinate units fall on one pixel, which needs the
+        // level where one texel covers a pixel; the finest request of the frame wins
+        void Request(GLuint texture, float uvPerPixel) {
+            auto found = m_Index.find(texture);
+            if (found == m_Index.end())
+                return;
+            Entry &entry = m_Entries[found->second];
+            const MipLevel &top = entry.levels[0];
+            float texelsPerPixel = uvPerPixel * (float)std::max(top.width, top.height);
+            int level = texelsPerPixel > 1.0f ? (int)std::floor(std::log2(texelsPerPixel)) : 0;
+            level = std::min(level, entry.residentLevel);
+            entry.requestedLevel = entry.requested ? std::min(entry.requestedLevel, level) : level;
+            entry.requested = true;
+        }
+
+        // evicts down to the budget and streams requested levels in, call once per frame after the requests
+        void Update() {
+            m_LastFrameBytes = 0;
+            while (m_ResidentBytes > MemoryBudget && evictUnrequested(m_ResidentBytes - MemoryBudget)) {
+            }
+            // the budget shrank below what is requested, drop the finest levels that are left
+            while (m_ResidentBytes > MemoryBudget) {
+                Entry *finest = nullptr;
+                for (Entry &entry : m_Entries) {
+                    if (entry.baseLevel < entry.residentLevel && (!finest || entry.baseLevel < finest->baseLevel))
+                        finest = &entry;
+                }
+                if (!finest)
+                    break;
+                evictLevel(*finest);
+            }
+
+            while (m_LastFrameBytes < BytesPerFrame) {
+                // the texture furthest from its request goes first, so every one gets sharper at the same pace
+                Entry *next = nullptr;
+                for (Entry &entry : m_Entries) {
+                    if (entry.requested && entry.baseLevel > entry.requestedLevel &&
+                        (!next || entry.baseLevel - entry.requestedLevel > next->baseLevel - next->requestedLevel))
+                        next = &entry;
+                }
+                if (!next)
+                    break;
+
+                size_t size = next->levels[next->baseLevel - 1].data.size();
+                if (m_ResidentBytes + size > MemoryBudget)
+                    evictUnrequested(m_ResidentBytes + size - MemoryBudget);
+                if (m_ResidentBytes + size > MemoryBudget)
+                    break;
+                uploadLevel(*next, next->baseLevel - 1);
+                m_LastFrameBytes += size;
+            }
+        }
+
+        size_t ResidentBytes() const { return m_ResidentBytes; }
+        size_t LastFrameBytes() const { return m_LastFrameBytes; }
+
+        // requested and resident level of every texture, for the debug overlay
+        void DrawOverlay() {
+            ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_FirstUseEver);
+            ImGui::SetNextWindowSize(ImVec2(520.0f, 300.0f), ImGuiCond_FirstUseEver);
+            if (!ImGui::Begin("Texture streaming")) {
+                ImGui::End();
+                return;
+            }
+            ImGui::Text("resident %.1f / %.1f MB, streamed %.1f KB this frame", m_ResidentBytes / 1048576.0,
+                        MemoryBudget / 1048576.0, m_LastFrameBytes / 1024.0);
+            if (ImGui::BeginTable("textures", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable)) {
+                ImGui::TableSetupColumn("texture");
+                ImGui::TableSetupColumn("requested");
+                ImGui::TableSetupColumn("resident");
+                ImGui::TableSetupColumn("KB");
+                ImGui::TableHeadersRow();
+                for (const Entry &entry : m_Entries) {
+                    const MipLevel &requested = entry.levels[entry.requestedLevel];
+                    const MipLevel &resident = entry.levels[entry.baseLevel];
+                    ImGui::TableNextRow();
+                    ImGui::TableNextColumn();
+                    ImGui::TextUnformatted(entry.name.c_str());
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%d (%dx%d)%s", entry.requestedLevel, requested.width, requested.height,
+                                entry.requested ? "" : " idle");
+                    ImGui::TableNextColumn();
+                    ImVec4 color = entry.baseLevel > entry.requestedLevel ? ImVec4(1.0f, 0.6f, 0.2f, 1.0f)
+                                                                          : ImVec4(0.5f, 1.0f, 0.5f, 1.0f);
+                    ImGui::TextColored(color, "%d (%dx%d)", entry.baseLevel, resident.width, resident.height);
+                    ImGui::TableNextColumn();
+                    ImGui::Text("%zu", residentBytes(entry) / 1024);
+                }
+                ImGui::EndTable();
+            }
+            ImGui::End();
+        }
+
+        // the textures themselves belong to their owners, only the CPU copies are dropped
+        void Release() {
+            m_Entries.clear();
+            m_Index.clear();
+            m_ResidentBytes = 0;
+        }
+
+    private:
+        struct Entry {
+            GLuint texture = 0;
+            GLenum internalFormat = GL_RGBA8;
+            GLenum format = GL_RGBA;
+            bool compressed = false;
+            std::string name;
+            std::vector<MipLevel> levels;
+            // finest level in VRAM, levels.size() before anything is uploaded
+            int baseLevel = 0;
+            // coarsest level that is never evicted
+            int residentLevel = 0;
+            int requestedLevel = 0;
+            bool requested = false;
+        };
+
+        std::vector<Entry> m_Entries;
+        std::unordered_map<GLuint, size_t> m_Index;
+        size_t m_ResidentBytes = 0;
+        size_t m_LastFrameBytes = 0;
+
+        static size_t residentBytes(const Entry &entry) {
+            size_t bytes = 0;
+            for (int level = entry.baseLevel; level < (int)entry.levels.size(); level++)
+                bytes += entry.levels[level].data.size();
+            return bytes;
+        }
+
+        // levels are only ever added or removed at the fine end, so BASE_LEVEL..MAX_LEVEL stays complete
+        void uploadLevel(Entry &entry, int level) {
+            const MipLevel &mip = entry.levels[level];
+            glState().BindTexture(0, GL_TEXTURE_2D, entry.texture);
+            if (entry.compressed) {
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, entry.internalFormat, mip.width, mip.height, 0,
+                                       (GLsizei)mip.data.size(), mip.data.data());
+            } else {
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glTexImage2D(GL_TEXTURE_2D, level, (GLint)entry.internalFormat, mip.width, mip.height, 0, entry.format,
+                             GL_UNSIGNED_BYTE, mip.data.data());
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            }
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level);
+            entry.baseLevel = level;
+            m_ResidentBytes += mip.data.size();
+        }
+
+        // clamps past the finest level first and then respecifies it empty, which releases its storage
+        void evictLevel(Entry &entry) {
+            int level = entry.baseLevel;
+            glState().BindTexture(0, GL_TEXTURE_2D, entry.texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level + 1);
+            if (entry.compressed)
+                glCompressedTexImage2D(GL_TEXTURE_2D, level, entry.internalFormat, 0, 0, 0, 0, nullptr);
+            else
+                glTexImage2D(GL_TEXTURE_2D, level, (GLint)entry.internalFormat, 0, 0, 0, entry.format, GL_UNSIGNED_BYTE, nullptr);
+            entry.baseLevel = level + 1;
+            m_ResidentBytes -= entry.levels[level].data.size();
+        }
+
+        // evicts levels finer than requested, textures that were not drawn this frame first;
+        // false when there was nothing to evict
+        bool evictUnrequested(size_t bytes) {
+            bool evicted = false;
+            for (int pass = 0; pass < 2 && bytes > 0; pass++) {
+                for (Entry &entry : m_Entries) {
+                    if (pass == 0 && entry.requested)
+                        continue;
+                    int keep = entry.requested ? entry.requestedLevel : entry.residentLevel;
+                    while (entry.baseLevel < keep && bytes > 0) {
+                        size_t size = entry.levels[entry.baseLevel].data.size();
+                        evictLevel(entry);
+                        bytes = size >= bytes ? 0 : bytes - size;
+                        evicted = true;
+                    }
+                }
+            }
+            return evicted;
+        }
+    };
+
+    // created on first use, which has to be after the GL context is current
+    inline TextureStreamer &textureStreamer() {
+        static TextureStreamer streamer;
+        return streamer;
+    }
+
+}
+
+#endif //PROJECT_BASE_TEXTURESTREAMER_H
@@ -0,0 +1,182 @@
+#ifndef PROJECT_BASE_TEXTUREUPLOADQUEUE_H
+#define PROJECT_BASE_TEXTUREUPLOADQUEUE_H
+
+#include <glad/glad.h>
+#include <rg/GLState.h>
+#include <rg/MipChain.h>
+#include <rg/StreamBuffer.h>
+#include <rg/TextureFormat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <vector>
+
+namespace rg {
+
+    // Spreads texel uploads over frames so a texture loaded mid-session never stalls one of them.
+    //
+    // Enqueue() only allocates the storage of the levels. Process(), called once per frame, copies as many
+    // whole rows as the byte and time budget allow into a staging ring of pixel unpack buffers (a
+    // StreamBuffer, so a region is only rewritten once the GPU has fenced past it) and sources
+    // glTexSubImage2D from there; the copy to the texture happens on the GPU timeline instead of inside
+    // the call. Levels arrive coarse to fine and GL_TEXTURE_BASE_LEVEL follows the last complete one, so
+    // a texture is blurry for a few frames rather than unfinished. The mip chain comes from the CPU
+    // (rg/MipChain.h) instead of glGenerateMipmap, which is slow on software rasterizers.
+    //
+    // Block compressed textures come with their mips and are small, they are still uploaded directly.
+    class TextureUploadQueue {
+    public:
+        // upload budget of one frame, at least one row is uploaded per frame regardless
+        GLsizeiptr BytesPerFrame;
+        double MillisecondsPerFrame;
+
+        TextureUploadQueue(GLsizeiptr bytesPerFrame = 4 * 1024 * 1024, double millisecondsPerFrame = 2.0)
+                : BytesPerFrame(bytesPerFrame), MillisecondsPerFrame(millisecondsPerFrame),
+                  m_Staging(bytesPerFrame) {
+        }
+
+        TextureUploadQueue(const TextureUploadQueue &) = delete;
+        TextureUploadQueue &operator=(const TextureUploadQueue &) = delete;
+
+        // takes the levels, already packed to format, and uploads them to texture over the next frames;
+        // a single level leaves the texture without mips
+        void Enqueue(GLuint texture, const TextureFormat &format, std::vector<MipLevel> levels) {
+            if (levels.empty())
+                return;
+            int lastLevel = (int)levels.size() - 1;
+            glState().BindTexture(0, GL_TEXTURE_2D, texture);
+            for (int level = 0; level <= lastLevel; level++)
+                glTexImage2D(GL_TEXTURE_2D, level, format.internalFormat, levels[level].width, levels[level].height, 0,
+                             format.format, GL_UNSIGNED_BYTE, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, lastLevel);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, lastLevel);
+            applyTextureSwizzle(GL_TEXTURE_2D, format);
+
+            Upload upload;
+            upload.texture = texture;
+            upload.format = format;
+            upload.level = lastLevel;
+            upload.levels = std::move(levels);
+            for (const MipLevel &level : upload.levels)
+                m_PendingBytes += level.data.size();
+            m_Queue.push_back(std::move(upload));
+        }
+
+        // uploads within the frame budget, call once per frame before drawing
+        void Process() {
+            processWithin(BytesPerFrame, MillisecondsPerFrame);
+        }
+
+        // uploads everything that is queued, for loading screens and startup
+        void Flush() {
+            while (!m_Queue.empty())
+                processWithin(m_Staging.FrameSize(), 1e9);
+        }
+
+        bool Idle() const { return m_Queue.empty(); }
+        size_t Pending() const { return m_Queue.size(); }
+        size_t PendingBytes() const { return m_PendingBytes; }
+        size_t LastFrameBytes() const { return m_LastFrameBytes; }
+        double LastFrameMilliseconds() const { return m_LastFrameMilliseconds; }
+
+        void Release() {
+            m_Queue.clear();
+            m_PendingBytes = 0;
+            m_Staging.Release();
+        }
+
+    private:
+        struct Upload {
+            GLuint texture = 0;
+            TextureFormat format = {GL_RGBA8, GL_RGBA, 4};
+            // level being uploaded, counts down to 0
+            int level = 0;
+            int nextRow = 0;
+            std::vector<MipLevel> levels;
+        };
+
+        StreamBuffer m_Staging;
+        std::deque<Upload> m_Queue;
+        size_t m_PendingBytes = 0;
+        size_t m_LastFrameBytes = 0;
+        double m_LastFrameMilliseconds = 0.0;
+
+        void processWithin(GLsizeiptr byteBudget, double millisecondBudget) {
+            m_LastFrameBytes = 0;
+            m_LastFrameMilliseconds = 0.0;
+            if (m_Queue.empty())
+                return;
+
+            auto start = std::chrono::steady_clock::now();
+            m_Staging.BeginFrame();
+            // the staging region holds one frame's budget, the budget can not be larger than that
+            GLsizeiptr remaining = std::min(byteBudget, m_Staging.FrameSize());
+
+            while (!m_Queue.empty()) {
+                Upload &upload = m_Queue.front();
+                const MipLevel &mip = upload.levels[upload.level];
+                GLsizeiptr rowBytes = (GLsizeiptr)mip.width * upload.format.channels;
+                int rows = (int)std::min<GLsizeiptr>(mip.height - upload.nextRow, remaining / rowBytes);
+                if (rowBytes > m_Staging.FrameSize()) {
+                    // a single row does not fit the staging region, let the driver copy it all from client memory
+                    rows = mip.height - upload.nextRow;
+                } else if (rows <= 0) {
+                    if (m_LastFrameBytes > 0)
+                        break;
+                    // the budget is smaller than a row, one per frame still makes progress
+                    rows = 1;
+                }
+
+                GLsizeiptr size = rows * rowBytes;
+                const unsigned char *source = mip.data.data() + upload.nextRow * rowBytes;
+                GLintptr offset = 0;
+                void *staging = rowBytes > m_Staging.FrameSize() ? nullptr : m_Staging.Allocate(size, 4, offset);
+                if (staging) {
+                    std::memcpy(staging, source, size);
+                    m_Staging.Commit();
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_Staging.Buffer());
+                    source = (const unsigned char *)offset;
+                }
+
+                glState().BindTexture(0, GL_TEXTURE_2D, upload.texture);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                glTexSubImage2D(GL_TEXTURE_2D, upload.level, 0, upload.nextRow, mip.width, rows, upload.format.format,
+                                GL_UNSIGNED_BYTE, source);
+                glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                if (staging)
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+                upload.nextRow += rows;
+                remaining -= size;
+                m_LastFrameBytes += size;
+                m_PendingBytes -= size;
+
+                if (upload.nextRow == mip.height) {
+                    // the level is complete, sample it from now on
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, upload.level);
+                    upload.nextRow = 0;
+                    if (upload.level-- == 0)
+                        m_Queue.pop_front();
+                }
+
+                m_LastFrameMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                if (remaining <= 0 || m_LastFrameMilliseconds >= millisecondBudget)
+                    break;
+            }
+
+            m_Staging.EndFrame();
+        }
+    };
+
+    // created on first use, which has to be after the GL context and extensions are loaded
+    inline TextureUploadQueue &textureUploadQueue() {
+        static TextureUploadQueue queue;
+        return queue;
+    }
+
+}
+
+#endif //PROJECT_BASE_TEXTUREUPLOADQUEUE_H
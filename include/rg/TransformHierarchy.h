@@ -0,0 +1,76 @@
+#ifndef PROJECT_BASE_TRANSFORMHIERARCHY_H
+#define PROJECT_BASE_TRANSFORMHIERARCHY_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+namespace rg {
+
+    // Parent relative transforms with cached world matrices.
+    //
+    // Nodes live in flat arrays in which every parent comes before its children; hierarchies added
+    // breadth first end up ordered by depth. Update() is then a single pass from front to back: a node
+    // is recomputed when its own local matrix was set or its parent was recomputed in the same pass,
+    // everything else keeps the world matrix it had.
+    class TransformHierarchy {
+    public:
+        static const unsigned int NoParent = ~0u;
+
+        // parent has to be added already, the node starts out dirty
+        unsigned int Add(unsigned int parent, const glm::mat4 &local = glm::mat4(1.0f)) {
+            unsigned int node = (unsigned int)m_Parent.size();
+            m_Parent.push_back(parent);
+            m_Depth.push_back(parent == NoParent ? 0 : m_Depth[parent] + 1);
+            m_Local.push_back(local);
+            // valid right away as long as the parent is up to date, loaders rely on it
+            m_World.push_back(parent == NoParent ? local : m_World[parent] * local);
+            m_Dirty.push_back(1);
+            m_Changed.push_back(0);
+            return node;
+        }
+
+        void SetLocal(unsigned int node, const glm::mat4 &local) {
+            m_Local[node] = local;
+            m_Dirty[node] = 1;
+        }
+
+        // recomputes the world matrices of dirty nodes and their descendants, returns how many
+        unsigned int Update() {
+            unsigned int updated = 0;
+            for (size_t i = 0; i < m_Parent.size(); i++) {
+                unsigned int parent = m_Parent[i];
+                bool dirty = m_Dirty[i] || (parent != NoParent && m_Changed[parent]);
+                m_Changed[i] = dirty ? 1 : 0;
+                if (!dirty)
+                    continue;
+                m_World[i] = parent == NoParent ? m_Local[i] : m_World[parent] * m_Local[i];
+                m_Dirty[i] = 0;
+                updated++;
+            }
+            m_LastUpdated = updated;
+            return updated;
+        }
+
+        const glm::mat4 &Local(unsigned int node) const { return m_Local[node]; }
+        const glm::mat4 &World(unsigned int node) const { return m_World[node]; }
+        // the world matrix was recomputed by the last Update
+        bool Changed(unsigned int node) const { return m_Changed[node] != 0; }
+        unsigned int Parent(unsigned int node) const { return m_Parent[node]; }
+        unsigned int Depth(unsigned int node) const { return m_Depth[node]; }
+        unsigned int Size() const { return (unsigned int)m_Parent.size(); }
+        unsigned int LastUpdated() const { return m_LastUpdated; }
+
+    private:
+        std::vector<unsigned int> m_Parent;
+        std::vector<unsigned int> m_Depth;
+        std::vector<glm::mat4> m_Local;
+        std::vector<glm::mat4> m_World;
+        std::vector<unsigned char> m_Dirty;
+        std::vector<unsigned char> m_Changed;
+        unsigned int m_LastUpdated = 0;
+    };
+
+}
+
+#endif //PROJECT_BASE_TRANSFORMHIERARCHY_H
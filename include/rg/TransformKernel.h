@@ -0,0 +1,377 @@
+#ifndef PROJECT_BASE_TRANSFORMKERNEL_H
+#define PROJECT_BASE_TRANSFORMKERNEL_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#define RG_TRANSFORM_SSE2 1
+#endif
+
+// the AVX2 path is compiled for its own function only and picked at run time, the rest of the
+// program does not need -mavx2
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RG_TRANSFORM_AVX2 1
+#endif
+
+namespace rg {
+
+    // Upper 3x3 of the inverse transpose of a world matrix, for transforming normals. Columns are
+    // padded to vec4 the way std140 lays out a mat3, so it can be copied into uniform blocks as is.
+    struct NormalMatrix {
+        glm::vec4 columns[3];
+    };
+
+    // Translation, rotation and scale of many objects with one array per component, the layout the
+    // batched kernels load four or eight objects at a time from.
+    struct TransformArrays {
+        std::vector<float> px, py, pz;
+        std::vector<float> qx, qy, qz, qw;
+        std::vector<float> sx, sy, sz;
+
+        size_t Size() const { return px.size(); }
+
+        void Push(const glm::vec3 &position, const glm::quat &rotation, const glm::vec3 &scale) {
+            px.push_back(position.x); py.push_back(position.y); pz.push_back(position.z);
+            qx.push_back(rotation.x); qy.push_back(rotation.y); qz.push_back(rotation.z); qw.push_back(rotation.w);
+            sx.push_back(scale.x); sy.push_back(scale.y); sz.push_back(scale.z);
+        }
+
+        void SetPosition(size_t i, const glm::vec3 &position) {
+            px[i] = position.x; py[i] = position.y; pz[i] = position.z;
+        }
+        void SetRotation(size_t i, const glm::quat &rotation) {
+            qx[i] = rotation.x; qy[i] = rotation.y; qz[i] = rotation.z; qw[i] = rotation.w;
+        }
+        void SetScale(size_t i, const glm::vec3 &scale) {
+            sx[i] = scale.x; sy[i] = scale.y; sz[i] = scale.z;
+        }
+
+        glm::vec3 Position(size_t i) const { return glm::vec3(px[i], py[i], pz[i]); }
+        glm::quat Rotation(size_t i) const { return glm::quat(qw[i], qx[i], qy[i], qz[i]); }
+        glm::vec3 Scale(size_t i) const { return glm::vec3(sx[i], sy[i], sz[i]); }
+
+        // transform i of from into slot i
+        void Copy(size_t i, const TransformArrays &from) {
+            px[i] = from.px[i]; py[i] = from.py[i]; pz[i] = from.pz[i];
+            qx[i] = from.qx[i]; qy[i] = from.qy[i]; qz[i] = from.qz[i]; qw[i] = from.qw[i];
+            sx[i] = from.sx[i]; sy[i] = from.sy[i]; sz[i] = from.sz[i];
+        }
+
+        // slot i from transform i of a (t = 0) to the one of b (t = 1): position and scale linearly,
+        // the rotation along the shorter arc, normalized
+        void Blend(size_t i, const TransformArrays &a, const TransformArrays &b, float t) {
+            px[i] = a.px[i] + (b.px[i] - a.px[i]) * t;
+            py[i] = a.py[i] + (b.py[i] - a.py[i]) * t;
+            pz[i] = a.pz[i] + (b.pz[i] - a.pz[i]) * t;
+            float sign = a.qx[i] * b.qx[i] + a.qy[i] * b.qy[i] + a.qz[i] * b.qz[i] + a.qw[i] * b.qw[i] < 0.0f ? -1.0f : 1.0f;
+            float x = a.qx[i] + (sign * b.qx[i] - a.qx[i]) * t;
+            float y = a.qy[i] + (sign * b.qy[i] - a.qy[i]) * t;
+            float z = a.qz[i] + (sign * b.qz[i] - a.qz[i]) * t;
+            float w = a.qw[i] + (sign * b.qw[i] - a.qw[i]) * t;
+            float length = std::sqrt(x * x + y * y + z * z + w * w);
+            qx[i] = x / length; qy[i] = y / length; qz[i] = z / length; qw[i] = w / length;
+            sx[i] = a.sx[i] + (b.sx[i] - a.sx[i]) * t;
+            sy[i] = a.sy[i] + (b.sy[i] - a.sy[i]) * t;
+            sz[i] = a.sz[i] + (b.sz[i] - a.sz[i]) * t;
+        }
+
+        // moves the last transform into i and drops the last
+        void EraseSwap(size_t i) {
+            std::vector<float> *arrays[] = {&px, &py, &pz, &qx, &qy, &qz, &qw, &sx, &sy, &sz};
+            for (std::vector<float> *array : arrays) {
+                (*array)[i] = array->back();
+                array->pop_back();
+            }
+        }
+    };
+
+    enum class TransformKernel {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    inline const char *transformKernelName(TransformKernel kernel) {
+        switch (kernel) {
+            case TransformKernel::SSE2: return "SSE2";
+            case TransformKernel::AVX2: return "AVX2+FMA";
+            default: return "scalar";
+        }
+    }
+
+    inline bool transformKernelSupported(TransformKernel kernel) {
+        switch (kernel) {
+            case TransformKernel::Scalar:
+                return true;
+            case TransformKernel::SSE2:
+#ifdef RG_TRANSFORM_SSE2
+                return true;
+#else
+                return false;
+#endif
+            case TransformKernel::AVX2:
+#ifdef RG_TRANSFORM_AVX2
+                return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+                return false;
+#endif
+        }
+        return false;
+    }
+
+    // the widest kernel this CPU runs, checked once
+    inline TransformKernel activeTransformKernel() {
+        static const TransformKernel kernel = transformKernelSupported(TransformKernel::AVX2) ? TransformKernel::AVX2 :
+                                              transformKernelSupported(TransformKernel::SSE2) ? TransformKernel::SSE2 :
+                                              TransformKernel::Scalar;
+        return kernel;
+    }
+
+    namespace detail {
+
+        // world = T * R * S and normal = R * S^-1 straight from the quaternion, no trig and no matrix
+        // products; the quaternion is expected to be unit length, as for glm::mat4_cast
+        inline void composeTransformsScalar(const TransformArrays &in, size_t begin, size_t end, glm::mat4 *world,
+                                            NormalMatrix *normal) {
+            for (size_t i = begin; i < end; i++) {
+                float x = in.qx[i], y = in.qy[i], z = in.qz[i], w = in.qw[i];
+                float xx = x * x, yy = y * y, zz = z * z;
+                float xy = x * y, xz = x * z, yz = y * z;
+                float wx = w * x, wy = w * y, wz = w * z;
+                glm::vec3 c0(1.0f - 2.0f * (yy + zz), 2.0f * (xy + wz), 2.0f * (xz - wy));
+                glm::vec3 c1(2.0f * (xy - wz), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + wx));
+                glm::vec3 c2(2.0f * (xz + wy), 2.0f * (yz - wx), 1.0f - 2.0f * (xx + yy));
+
+                glm::mat4 &m = world[i];
+                m[0] = glm::vec4(c0 * in.sx[i], 0.0f);
+                m[1] = glm::vec4(c1 * in.sy[i], 0.0f);
+                m[2] = glm::vec4(c2 * in.sz[i], 0.0f);
+                m[3] = glm::vec4(in.px[i], in.py[i], in.pz[i], 1.0f);
+
+                NormalMatrix &n = normal[i];
+                n.columns[0] = glm::vec4(c0 / in.sx[i], 0.0f);
+                n.columns[1] = glm::vec4(c1 / in.sy[i], 0.0f);
+                n.columns[2] = glm::vec4(c2 / in.sz[i], 0.0f);
+            }
+        }
+
+#ifdef RG_TRANSFORM_SSE2
+        // the x, y, z, w vectors of one column of four matrices, stored as that column of each matrix
+        inline void storeColumns4(__m128 x, __m128 y, __m128 z, __m128 w, float *first, size_t stride) {
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+            _mm_storeu_ps(first, x);
+            _mm_storeu_ps(first + stride, y);
+            _mm_storeu_ps(first + 2 * stride, z);
+            _mm_storeu_ps(first + 3 * stride, w);
+        }
+
+        // four transforms per step, every lane one transform; the tail goes through the scalar loop
+        inline void composeTransformsSSE2(const TransformArrays &in, size_t begin, size_t end, glm::mat4 *world,
+                                          NormalMatrix *normal) {
+            const __m128 one = _mm_set1_ps(1.0f);
+            const __m128 two = _mm_set1_ps(2.0f);
+            const __m128 zero = _mm_setzero_ps();
+            const size_t worldStride = sizeof(glm::mat4) / sizeof(float);
+            const size_t normalStride = sizeof(NormalMatrix) / sizeof(float);
+            size_t i = begin;
+            for (; i + 4 <= end; i += 4) {
+                __m128 x = _mm_loadu_ps(&in.qx[i]), y = _mm_loadu_ps(&in.qy[i]);
+                __m128 z = _mm_loadu_ps(&in.qz[i]), w = _mm_loadu_ps(&in.qw[i]);
+                __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+                __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+                __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+                __m128 r00 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+                __m128 r01 = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+                __m128 r02 = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+                __m128 r10 = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+                __m128 r11 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+                __m128 r12 = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+                __m128 r20 = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+                __m128 r21 = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+                __m128 r22 = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+                __m128 sx = _mm_loadu_ps(&in.sx[i]), sy = _mm_loadu_ps(&in.sy[i]), sz = _mm_loadu_ps(&in.sz[i]);
+                float *m = &world[i][0][0];
+                storeColumns4(_mm_mul_ps(r00, sx), _mm_mul_ps(r01, sx), _mm_mul_ps(r02, sx), zero, m, worldStride);
+                storeColumns4(_mm_mul_ps(r10, sy), _mm_mul_ps(r11, sy), _mm_mul_ps(r12, sy), zero, m + 4, worldStride);
+                storeColumns4(_mm_mul_ps(r20, sz), _mm_mul_ps(r21, sz), _mm_mul_ps(r22, sz), zero, m + 8, worldStride);
+                storeColumns4(_mm_loadu_ps(&in.px[i]), _mm_loadu_ps(&in.py[i]), _mm_loadu_ps(&in.pz[i]), one, m + 12,
+                              worldStride);
+
+                float *n = &normal[i].columns[0][0];
+                storeColumns4(_mm_div_ps(r00, sx), _mm_div_ps(r01, sx), _mm_div_ps(r02, sx), zero, n, normalStride);
+                storeColumns4(_mm_div_ps(r10, sy), _mm_div_ps(r11, sy), _mm_div_ps(r12, sy), zero, n + 4, normalStride);
+                storeColumns4(_mm_div_ps(r20, sz), _mm_div_ps(r21, sz), _mm_div_ps(r22, sz), zero, n + 8, normalStride);
+            }
+            composeTransformsScalar(in, i, end, world, normal);
+        }
+#endif
+
+#ifdef RG_TRANSFORM_AVX2
+        __attribute__((target("avx2,fma")))
+        inline void storeColumns8(__m256 x, __m256 y, __m256 z, __m256 w, float *first, size_t stride) {
+            // transposes within each 128 bit half: the low halves hold lanes 0..3, the high ones 4..7
+            __m256 t0 = _mm256_unpacklo_ps(x, y), t1 = _mm256_unpackhi_ps(x, y);
+            __m256 t2 = _mm256_unpacklo_ps(z, w), t3 = _mm256_unpackhi_ps(z, w);
+            __m256 c0 = _mm256_shuffle_ps(t0, t2, 0x44), c1 = _mm256_shuffle_ps(t0, t2, 0xEE);
+            __m256 c2 = _mm256_shuffle_ps(t1, t3, 0x44), c3 = _mm256_shuffle_ps(t1, t3, 0xEE);
+            _mm_storeu_ps(first, _mm256_castps256_ps128(c0));
+            _mm_storeu_ps(first + stride, _mm256_castps256_ps128(c1));
+            _mm_storeu_ps(first + 2 * stride, _mm256_castps256_ps128(c2));
+            _mm_storeu_ps(first + 3 * stride, _mm256_castps256_ps128(c3));
+            _mm_storeu_ps(first + 4 * stride, _mm256_extractf128_ps(c0, 1));
+            _mm_storeu_ps(first + 5 * stride, _mm256_extractf128_ps(c1, 1));
+            _mm_storeu_ps(first + 6 * stride, _mm256_extractf128_ps(c2, 1));
+            _mm_storeu_ps(first + 7 * stride, _mm256_extractf128_ps(c3, 1));
+        }
+
+        // eight transforms per step, the diagonal with fused multiply-adds
+        __attribute__((target("avx2,fma")))
+        inline void composeTransformsAVX2(const TransformArrays &in, size_t begin, size_t end, glm::mat4 *world,
+                                          NormalMatrix *normal) {
+            const __m256 one = _mm256_set1_ps(1.0f);
+            const __m256 two = _mm256_set1_ps(2.0f);
+            const __m256 minusTwo = _mm256_set1_ps(-2.0f);
+            const __m256 zero = _mm256_setzero_ps();
+            const size_t worldStride = sizeof(glm::mat4) / sizeof(float);
+            const size_t normalStride = sizeof(NormalMatrix) / sizeof(float);
+            size_t i = begin;
+            for (; i + 8 <= end; i += 8) {
+                __m256 x = _mm256_loadu_ps(&in.qx[i]), y = _mm256_loadu_ps(&in.qy[i]);
+                __m256 z = _mm256_loadu_ps(&in.qz[i]), w = _mm256_loadu_ps(&in.qw[i]);
+                __m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+                __m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+                __m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+                __m256 r00 = _mm256_fmadd_ps(minusTwo, _mm256_add_ps(yy, zz), one);
+                __m256 r01 = _mm256_mul_ps(two, _mm256_add_ps(xy, wz));
+                __m256 r02 = _mm256_mul_ps(two, _mm256_sub_ps(xz, wy));
+                __m256 r10 = _mm256_mul_ps(two, _mm256_sub_ps(xy, wz));
+                __m256 r11 = _mm256_fmadd_ps(minusTwo, _mm256_add_ps(xx, zz), one);
+                __m256 r12 = _mm256_mul_ps(two, _mm256_add_ps(yz, wx));
+                __m256 r20 = _mm256_mul_ps(two, _mm256_add_ps(xz, wy));
+                __m256 r21 = _mm256_mul_ps(two, _mm256_sub_ps(yz, wx));
+                __m256 r22 = _mm256_fmadd_ps(minusTwo, _mm256_add_ps(xx, yy), one);
+
+                __m256 sx = _mm256_loadu_ps(&in.sx[i]), sy = _mm256_loadu_ps(&in.sy[i]), sz = _mm256_loadu_ps(&in.sz[i]);
+                float *m = &world[i][0][0];
+                storeColumns8(_mm256_mul_ps(r00, sx), _mm256_mul_ps(r01, sx), _mm256_mul_ps(r02, sx), zero, m, worldStride);
+                storeColumns8(_mm256_mul_ps(r10, sy), _mm256_mul_ps(r11, sy), _mm256_mul_ps(r12, sy), zero, m + 4,
+                              worldStride);
+                storeColumns8(_mm256_mul_ps(r20, sz), _mm256_mul_ps(r21, sz), _mm256_mul_ps(r22, sz), zero, m + 8,
+                              worldStride);
+                storeColumns8(_mm256_loadu_ps(&in.px[i]), _mm256_loadu_ps(&in.py[i]), _mm256_loadu_ps(&in.pz[i]), one,
+                              m + 12, worldStride);
+
+                float *n = &normal[i].columns[0][0];
+                storeColumns8(_mm256_div_ps(r00, sx), _mm256_div_ps(r01, sx), _mm256_div_ps(r02, sx), zero, n,
+                              normalStride);
+                storeColumns8(_mm256_div_ps(r10, sy), _mm256_div_ps(r11, sy), _mm256_div_ps(r12, sy), zero, n + 4,
+                              normalStride);
+                storeColumns8(_mm256_div_ps(r20, sz), _mm256_div_ps(r21, sz), _mm256_div_ps(r22, sz), zero, n + 8,
+                              normalStride);
+            }
+            composeTransformsScalar(in, i, end, world, normal);
+        }
+#endif
+
+    }
+
+    // Writes world[i] = translate(p) * mat4_cast(q) * scale(s) and normal[i] = its inverse transpose
+    // for every i in [begin, end), both in one pass over the arrays. world and normal are indexed like
+    // the arrays. A kernel the CPU does not run falls back to the next narrower one.
+    inline void composeTransforms(const TransformArrays &in, size_t begin, size_t end, glm::mat4 *world,
+                                  NormalMatrix *normal, TransformKernel kernel = activeTransformKernel()) {
+#ifdef RG_TRANSFORM_AVX2
+        if (kernel == TransformKernel::AVX2 && activeTransformKernel() == TransformKernel::AVX2) {
+            detail::composeTransformsAVX2(in, begin, end, world, normal);
+            return;
+        }
+#endif
+#ifdef RG_TRANSFORM_SSE2
+        if (kernel != TransformKernel::Scalar) {
+            detail::composeTransformsSSE2(in, begin, end, world, normal);
+            return;
+        }
+#endif
+        detail::composeTransformsScalar(in, begin, end, world, normal);
+    }
+
+    // Times building world and normal matrices for 1k, 100k and 1M transforms, chained glm calls
+    // (translate * mat4_cast * scale, then transpose(inverse(mat3))) against every kernel this CPU
+    // runs. The largest deviation from the glm result is printed next to each kernel.
+    inline void benchmarkTransformKernels(std::ostream &out, int runs = 10) {
+        out << "TRANSFORM_BENCHMARK:: average of " << runs << " runs, " << transformKernelName(activeTransformKernel())
+            << " picked on this CPU" << std::endl;
+        const size_t counts[] = {1000, 100000, 1000000};
+        for (size_t count : counts) {
+            TransformArrays transforms;
+            unsigned int seed = 1;
+            auto random = [&seed] {
+                seed = seed * 1664525u + 1013904223u;
+                return (float)(seed >> 8) / (float)(1u << 24) * 2.0f - 1.0f;
+            };
+            for (size_t i = 0; i < count; i++) {
+                glm::quat rotation = glm::normalize(glm::quat(random(), random(), random(), random()));
+                glm::vec3 scale(1.5f + random(), 1.5f + random(), 1.5f + random());
+                transforms.Push(glm::vec3(random(), random(), random()) * 100.0f, rotation, scale);
+            }
+            std::vector<glm::mat4> world(count), referenceWorld(count);
+            std::vector<NormalMatrix> normal(count);
+            std::vector<glm::mat3> referenceNormal(count);
+
+            auto start = std::chrono::steady_clock::now();
+            for (int run = 0; run < runs; run++) {
+                for (size_t i = 0; i < count; i++) {
+                    glm::mat4 m = glm::translate(glm::mat4(1.0f), transforms.Position(i));
+                    m = m * glm::mat4_cast(transforms.Rotation(i));
+                    m = glm::scale(m, transforms.Scale(i));
+                    referenceWorld[i] = m;
+                    referenceNormal[i] = glm::transpose(glm::inverse(glm::mat3(m)));
+                }
+            }
+            double chained = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+            out << "  " << count << " transforms, glm chain   " << chained << " ms, " << chained * 1.0e6 / count
+                << " ns per transform" << std::endl;
+
+            const TransformKernel kernels[] = {TransformKernel::Scalar, TransformKernel::SSE2, TransformKernel::AVX2};
+            for (TransformKernel kernel : kernels) {
+                if (!transformKernelSupported(kernel))
+                    continue;
+                start = std::chrono::steady_clock::now();
+                for (int run = 0; run < runs; run++)
+                    composeTransforms(transforms, 0, count, world.data(), normal.data(), kernel);
+                double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+
+                float deviation = 0.0f;
+                for (size_t i = 0; i < count; i++) {
+                    for (int c = 0; c < 4; c++)
+                        for (int r = 0; r < 4; r++)
+                            deviation = std::max(deviation, std::abs(world[i][c][r] - referenceWorld[i][c][r]));
+                    for (int c = 0; c < 3; c++)
+                        for (int r = 0; r < 3; r++)
+                            deviation = std::max(deviation, std::abs(normal[i].columns[c][r] - referenceNormal[i][c][r]));
+                }
+                out << "  " << count << " transforms, " << transformKernelName(kernel) << " kernel " << milliseconds
+                    << " ms, " << milliseconds * 1.0e6 / count << " ns per transform, " << chained / milliseconds
+                    << "x the chain, largest deviation " << deviation << std::endl;
+            }
+        }
+    }
+
+}
+
+#endif //PROJECT_BASE_TRANSFORMKERNEL_H
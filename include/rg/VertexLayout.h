@@ -0,0 +1,105 @@
+#ifndef PROJECT_BASE_VERTEXLAYOUT_H
+#define PROJECT_BASE_VERTEXLAYOUT_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <rg/GeometryArena.h>
+
+#include <cstring>
+#include <vector>
+
+namespace rg {
+
+    // GL description of a vertex attribute type
+    template<typename T>
+    struct AttributeType;
+
+    template<> struct AttributeType<float> { static constexpr GLint Components = 1; static constexpr GLenum Type = GL_FLOAT; };
+    template<> struct AttributeType<glm::vec2> { static constexpr GLint Components = 2; static constexpr GLenum Type = GL_FLOAT; };
+    template<> struct AttributeType<glm::vec3> { static constexpr GLint Components = 3; static constexpr GLenum Type = GL_FLOAT; };
+    template<> struct AttributeType<glm::vec4> { static constexpr GLint Components = 4; static constexpr GLenum Type = GL_FLOAT; };
+
+    // an attribute of type T read from the given shader location
+    template<GLuint AttributeLocation, typename T>
+    struct Attribute {
+        typedef T Type;
+        static constexpr GLuint Location = AttributeLocation;
+        static constexpr GLsizei Size = (GLsizei)sizeof(T);
+    };
+
+    // an attribute filled from Member of a Source struct by VertexLayout::Pack
+    template<GLuint AttributeLocation, typename Source, typename T, T Source::*Member>
+    struct MemberAttribute : Attribute<AttributeLocation, T> {
+        static const T &Get(const Source &source) { return source.*Member; }
+    };
+
+    // Interleaved vertex layout described entirely by its attribute list, e.g.
+    //
+    //   typedef rg::VertexLayout<rg::Attribute<0, glm::vec3>, rg::Attribute<2, glm::vec2>> Layout;
+    //
+    // Stride, offsets and the mask of used locations are compile time constants; Format() turns the
+    // list into the VertexFormat the geometry arena sets the VAO up from, so no attribute pointer is
+    // written by hand. Attributes follow each other without padding in the order given.
+    template<typename... Attributes>
+    struct VertexLayout;
+
+    template<>
+    struct VertexLayout<> {
+        static constexpr GLsizei Stride = 0;
+        static constexpr unsigned int AttributeMask = 0;
+
+        static constexpr GLuint OffsetOf(GLuint) { return 0; }
+
+        static void AddTo(VertexFormat &) {}
+
+        template<typename Source>
+        static void PackOne(const Source &, unsigned char *) {}
+    };
+
+    template<typename First, typename... Rest>
+    struct VertexLayout<First, Rest...> {
+        static constexpr GLsizei Stride = First::Size + VertexLayout<Rest...>::Stride;
+        static constexpr unsigned int AttributeMask = (1u << First::Location) | VertexLayout<Rest...>::AttributeMask;
+        static constexpr unsigned int AttributeCount = 1 + sizeof...(Rest);
+
+        // byte offset of the attribute at location inside a vertex
+        static constexpr GLuint OffsetOf(GLuint location) {
+            return First::Location == location ? 0 : First::Size + VertexLayout<Rest...>::OffsetOf(location);
+        }
+
+        // the arena format of this layout, built once
+        static const VertexFormat &Format() {
+            static const VertexFormat format = [] {
+                VertexFormat result;
+                AddTo(result);
+                return result;
+            }();
+            return format;
+        }
+
+        // copies the members the attributes name out of every source vertex, needs MemberAttributes
+        template<typename Source>
+        static std::vector<unsigned char> Pack(const std::vector<Source> &vertices) {
+            std::vector<unsigned char> packed(vertices.size() * Stride);
+            for (size_t i = 0; i < vertices.size(); i++)
+                PackOne(vertices[i], packed.data() + i * Stride);
+            return packed;
+        }
+
+        static void AddTo(VertexFormat &format) {
+            typedef AttributeType<typename First::Type> Type;
+            format.attributes.push_back({First::Location, Type::Components, Type::Type, GL_FALSE, (GLuint)format.stride});
+            format.stride += First::Size;
+            VertexLayout<Rest...>::AddTo(format);
+        }
+
+        template<typename Source>
+        static void PackOne(const Source &vertex, unsigned char *destination) {
+            std::memcpy(destination, &First::Get(vertex), First::Size);
+            VertexLayout<Rest...>::PackOne(vertex, destination + First::Size);
+        }
+    };
+
+}
+
+#endif //PROJECT_BASE_VERTEXLAYOUT_H
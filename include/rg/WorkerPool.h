@@ -0,0 +1,428 @@
+#ifndef PROJECT_BASE_WORKERPOOL_H
+#define PROJECT_BASE_WORKERPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace rg {
+
+    // The one pool of threads every CPU job of the program runs on: decoding images, building mip
+    // chains, culling and the entity systems. Tasks never touch GL; results reach the GL thread
+    // through futures or by waiting on a TaskGroup.
+    //
+    // Work stealing: every worker owns a deque and takes its newest task first, so a task that splits
+    // its work keeps the freshest (smallest, cache warm) piece to itself. Idle workers steal the oldest
+    // task of another deque, usually the largest piece still unsplit. Tasks submitted from threads
+    // outside the pool go to a shared queue all workers take from. A thread waiting on a TaskGroup runs
+    // the queued tasks of that group instead of blocking, so nested parallel work never deadlocks, and
+    // sleeps when none are left; it never picks up unrelated work such as an image decode, which could
+    // hold up the render thread for a whole frame.
+    class WorkerPool {
+    public:
+        // 0 uses every hardware thread but the one running GL. pinThreads binds worker i to core i + 1
+        // (Linux only), leaving core 0 to the GL thread.
+        explicit WorkerPool(unsigned int threadCount = 0, bool pinThreads = false) {
+            unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+            if (threadCount == 0)
+                threadCount = std::max(1u, hardware - 1);
+            for (unsigned int i = 0; i < threadCount; i++)
+                m_Queues.emplace_back(new Queue());
+            for (unsigned int i = 0; i < threadCount; i++) {
+                m_Threads.emplace_back([this, i] { run(i); });
+                if (pinThreads)
+                    m_Pinned += pin(m_Threads.back(), (i + 1) % hardware) ? 1 : 0;
+            }
+        }
+
+        WorkerPool(const WorkerPool &) = delete;
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        ~WorkerPool() {
+            {
+                std::lock_guard<std::mutex> lock(m_SleepMutex);
+                m_Stopping = true;
+            }
+            m_Wake.notify_all();
+            for (std::thread &thread : m_Threads)
+                thread.join();
+        }
+
+        template<typename Function>
+        auto Submit(Function function) -> std::future<decltype(function())> {
+            typedef decltype(function()) Result;
+            auto task = std::make_shared<std::packaged_task<Result()>>(std::move(function));
+            std::future<Result> result = task->get_future();
+            Spawn([task] { (*task)(); });
+            return result;
+        }
+
+        // queues task without a way to wait for it, on the deque of the calling worker when there is one;
+        // group tags it for RunOne, a TaskGroup passes itself
+        void Spawn(std::function<void()> task, const void *group = nullptr) {
+            int worker = currentWorker(this);
+            Queue &queue = worker >= 0 ? *m_Queues[worker] : m_Injected;
+            {
+                std::lock_guard<std::mutex> lock(queue.mutex);
+                queue.tasks.push_back(Task{std::move(task), group});
+            }
+            m_Pending++;
+            if (m_Sleeping > 0) {
+                std::lock_guard<std::mutex> lock(m_SleepMutex);
+                m_Wake.notify_one();
+            }
+        }
+
+        // runs one queued task tagged with group on the calling thread, false when there was none; for
+        // threads waiting on that group
+        bool RunOne(const void *group) {
+            std::function<void()> task;
+            if (!takeOfGroup(currentWorker(this), group, task))
+                return false;
+            task();
+            return true;
+        }
+
+        unsigned int ThreadCount() const { return (unsigned int)m_Threads.size(); }
+        unsigned int PinnedCount() const { return m_Pinned; }
+        // tasks run so far and how many of them a worker took from another worker's deque
+        unsigned long long Executed() const { return m_Executed; }
+        unsigned long long Stolen() const { return m_Stolen; }
+
+    private:
+        struct Task {
+            std::function<void()> function;
+            const void *group;
+        };
+
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Queue>> m_Queues;
+        Queue m_Injected;
+        std::vector<std::thread> m_Threads;
+        // queued and not taken yet, over all queues
+        std::atomic<long long> m_Pending{0};
+        std::atomic<int> m_Sleeping{0};
+        std::atomic<unsigned long long> m_Executed{0};
+        std::atomic<unsigned long long> m_Stolen{0};
+        std::mutex m_SleepMutex;
+        std::condition_variable m_Wake;
+        bool m_Stopping = false;
+        unsigned int m_Pinned = 0;
+
+        // index of the calling thread among the workers of pool, -1 outside of it
+        static int &workerIndex() {
+            static thread_local int index = -1;
+            return index;
+        }
+        static WorkerPool *&workerPoolOf() {
+            static thread_local WorkerPool *pool = nullptr;
+            return pool;
+        }
+        static int currentWorker(const WorkerPool *pool) { return workerPoolOf() == pool ? workerIndex() : -1; }
+
+        static bool popBack(Queue &queue, std::function<void()> &task) {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty())
+                return false;
+            task = std::move(queue.tasks.back().function);
+            queue.tasks.pop_back();
+            return true;
+        }
+
+        static bool popFront(Queue &queue, std::function<void()> &task) {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty())
+                return false;
+            task = std::move(queue.tasks.front().function);
+            queue.tasks.pop_front();
+            return true;
+        }
+
+        // the newest or oldest task of group in queue
+        static bool popOfGroup(Queue &queue, const void *group, bool newest, std::function<void()> &task) {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            for (size_t i = 0; i < queue.tasks.size(); i++) {
+                size_t index = newest ? queue.tasks.size() - 1 - i : i;
+                if (queue.tasks[index].group != group)
+                    continue;
+                task = std::move(queue.tasks[index].function);
+                queue.tasks.erase(queue.tasks.begin() + (std::ptrdiff_t)index);
+                return true;
+            }
+            return false;
+        }
+
+        // own deque newest first, then the shared queue, then the oldest task of the other workers
+        bool take(int worker, std::function<void()> &task) {
+            if (m_Pending <= 0)
+                return false;
+            bool found = (worker >= 0 && popBack(*m_Queues[worker], task)) || popFront(m_Injected, task);
+            for (size_t i = 1; !found && i <= m_Queues.size(); i++) {
+                size_t victim = (size_t)(worker + i) % m_Queues.size();
+                if ((int)victim != worker && popFront(*m_Queues[victim], task)) {
+                    found = true;
+                    m_Stolen++;
+                }
+            }
+            if (found) {
+                m_Pending--;
+                m_Executed++;
+            }
+            return found;
+        }
+
+        // the same order as take, but only tasks of group
+        bool takeOfGroup(int worker, const void *group, std::function<void()> &task) {
+            if (m_Pending <= 0)
+                return false;
+            bool found = (worker >= 0 && popOfGroup(*m_Queues[worker], group, true, task)) ||
+                         popOfGroup(m_Injected, group, false, task);
+            for (size_t i = 1; !found && i <= m_Queues.size(); i++) {
+                size_t victim = (size_t)(worker + i) % m_Queues.size();
+                if ((int)victim != worker && popOfGroup(*m_Queues[victim], group, false, task)) {
+                    found = true;
+                    m_Stolen++;
+                }
+            }
+            if (found) {
+                m_Pending--;
+                m_Executed++;
+            }
+            return found;
+        }
+
+        void run(int worker) {
+            workerIndex() = worker;
+            workerPoolOf() = this;
+            while (true) {
+                std::function<void()> task;
+                if (take(worker, task)) {
+                    task();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(m_SleepMutex);
+                m_Sleeping++;
+                m_Wake.wait(lock, [this] { return m_Stopping || m_Pending > 0; });
+                m_Sleeping--;
+                if (m_Stopping && m_Pending <= 0)
+                    return;
+            }
+        }
+
+        static bool pin(std::thread &thread, unsigned int core) {
+#if defined(__linux__)
+            cpu_set_t cores;
+            CPU_ZERO(&cores);
+            CPU_SET(core, &cores);
+            return pthread_setaffinity_np(thread.native_handle(), sizeof(cores), &cores) == 0;
+#else
+            return false;
+#endif
+        }
+    };
+
+    // how the shared pool is created, only read by the first call to workerPool()
+    struct WorkerPoolOptions {
+        unsigned int threadCount = 0;
+        bool pinThreads = false;
+    };
+
+    inline WorkerPoolOptions &workerPoolOptions() {
+        static WorkerPoolOptions options;
+        return options;
+    }
+
+    inline WorkerPool &workerPool() {
+        static WorkerPool pool(workerPoolOptions().threadCount, workerPoolOptions().pinThreads);
+        return pool;
+    }
+
+    // A parent for any number of child tasks: Wait() returns once every task run through the group
+    // has finished, including the ones those tasks added to the group themselves. The waiting thread
+    // runs queued tasks of this group meanwhile and sleeps while the rest are running elsewhere.
+    // Tasks capturing the group by reference keep it alive until Wait.
+    class TaskGroup {
+    public:
+        explicit TaskGroup(WorkerPool &pool = workerPool()) : m_Pool(pool) {}
+        TaskGroup(const TaskGroup &) = delete;
+        TaskGroup &operator=(const TaskGroup &) = delete;
+        ~TaskGroup() { Wait(); }
+
+        template<typename Function>
+        void Run(Function function) {
+            m_Unfinished++;
+            m_Queued++;
+            m_Pool.Spawn([this, function] {
+                m_Queued--;
+                function();
+                finish();
+            }, this);
+            // a task the waiting thread can run itself
+            if (m_Waiting) {
+                std::lock_guard<std::mutex> lock(m_Mutex);
+                m_Wake.notify_all();
+            }
+        }
+
+        void Wait() {
+            while (m_Unfinished > 0) {
+                if (m_Pool.RunOne(this))
+                    continue;
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Waiting = true;
+                m_Wake.wait(lock, [this] { return m_Unfinished == 0 || m_Queued > 0; });
+                m_Waiting = false;
+            }
+            // the last task may still be inside finish, the group has to outlive it
+            std::lock_guard<std::mutex> lock(m_Mutex);
+        }
+
+    private:
+        WorkerPool &m_Pool;
+        std::atomic<unsigned int> m_Unfinished{0};
+        // run through the group and not taken from a queue yet
+        std::atomic<unsigned int> m_Queued{0};
+        std::atomic<bool> m_Waiting{false};
+        std::mutex m_Mutex;
+        std::condition_variable m_Wake;
+
+        // all but the last task leave without the lock; the last one counts down under it, so Wait
+        // cannot return and destroy the group before the notification is out
+        void finish() {
+            unsigned int unfinished = m_Unfinished;
+            while (unfinished > 1 && !m_Unfinished.compare_exchange_weak(unfinished, unfinished - 1)) {
+            }
+            if (unfinished > 1)
+                return;
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            if (--m_Unfinished == 0)
+                m_Wake.notify_all();
+        }
+    };
+
+    namespace detail {
+
+        // halves [begin, end) until the piece is at most chunk long, queueing the upper halves
+        template<typename Function>
+        void splitRange(TaskGroup &group, size_t begin, size_t end, size_t chunk, const Function &function) {
+            while (end - begin > chunk) {
+                size_t middle = begin + (end - begin) / 2;
+                group.Run([&group, middle, end, chunk, &function] { splitRange(group, middle, end, chunk, function); });
+                end = middle;
+            }
+            function(begin, end);
+        }
+
+    }
+
+    // Calls function(begin, end) on ranges covering [0, count) spread over the pool, and returns when
+    // all are done. Ranges are split in halves down to about four per thread but never below grain
+    // items, so small counts stay coarse and large ones balance; count <= grain runs inline. Safe to
+    // call from inside a task. Ranges must not touch the same data.
+    template<typename Function>
+    void parallelFor(WorkerPool &pool, size_t count, size_t grain, const Function &function) {
+        if (count <= grain) {
+            if (count > 0)
+                function((size_t)0, count);
+            return;
+        }
+        size_t pieces = ((size_t)pool.ThreadCount() + 1) * 4;
+        size_t chunk = std::max(std::max(grain, (size_t)1), (count + pieces - 1) / pieces);
+        TaskGroup group(pool);
+        detail::splitRange(group, 0, count, chunk, function);
+        group.Wait();
+    }
+
+    // Throughput and latency of the shared pool: empty tasks queued from outside, a tree of tasks
+    // spawning their own children, a parallelFor against the same loop on one thread, and the time
+    // from Submit until a task starts on an idle pool.
+    inline void benchmarkWorkerPool(std::ostream &out) {
+        WorkerPool &pool = workerPool();
+        out << "WORKER_POOL_BENCHMARK:: " << pool.ThreadCount() << " workers, " << pool.PinnedCount() << " pinned"
+            << std::endl;
+        typedef std::chrono::steady_clock Clock;
+
+        const unsigned int flatCount = 100000;
+        std::atomic<unsigned int> counter{0};
+        auto start = Clock::now();
+        {
+            TaskGroup group(pool);
+            for (unsigned int i = 0; i < flatCount; i++)
+                group.Run([&counter] { counter++; });
+            group.Wait();
+        }
+        double flat = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        out << "  " << flatCount << " tasks from one thread   " << flat << " ms, " << flatCount / flat * 1.0e-3
+            << " M tasks/s" << std::endl;
+
+        // every task below the depth limit adds two children to the same group
+        const int depth = 17;
+        unsigned long long stolenBefore = pool.Stolen();
+        start = Clock::now();
+        {
+            TaskGroup group(pool);
+            std::function<void(int)> spawn = [&group, &spawn](int level) {
+                if (level == 0)
+                    return;
+                group.Run([&spawn, level] { spawn(level - 1); });
+                group.Run([&spawn, level] { spawn(level - 1); });
+            };
+            spawn(depth);
+            group.Wait();
+        }
+        double tree = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        unsigned int treeCount = (2u << depth) - 2;
+        out << "  " << treeCount << " tasks as a tree          " << tree << " ms, " << treeCount / tree * 1.0e-3
+            << " M tasks/s, " << pool.Stolen() - stolenBefore << " stolen" << std::endl;
+
+        std::vector<float> values(1 << 22);
+        for (size_t i = 0; i < values.size(); i++)
+            values[i] = (float)i;
+        auto work = [&values](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++)
+                values[i] = std::sqrt(values[i] * 1.0001f + 1.0f);
+        };
+        start = Clock::now();
+        work(0, values.size());
+        double serial = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        start = Clock::now();
+        parallelFor(pool, values.size(), 1024, work);
+        double parallel = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        out << "  parallelFor over " << values.size() << " floats   " << parallel << " ms against " << serial
+            << " ms on one thread, " << serial / parallel << "x" << std::endl;
+
+        // the pool sleeps between samples, so this includes waking a worker up
+        std::vector<double> latencies;
+        for (int i = 0; i < 200; i++) {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            auto submitted = Clock::now();
+            Clock::time_point started = pool.Submit([] { return Clock::now(); }).get();
+            latencies.push_back(std::chrono::duration<double, std::micro>(started - submitted).count());
+        }
+        std::sort(latencies.begin(), latencies.end());
+        out << "  Submit to start on an idle pool   median " << latencies[latencies.size() / 2] << " us, 99th percentile "
+            << latencies[latencies.size() * 99 / 100] << " us" << std::endl;
+    }
+
+}
+
+#endif //PROJECT_BASE_WORKERPOOL_H
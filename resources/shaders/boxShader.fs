@@ -3,13 +3,11 @@
 out vec4 FragColor;
 
 struct Material {
-    sampler2D texture_diffuse1;
-    sampler2D texture_specular1;
+    sampler2DArray texture_diffuse1;
+    sampler2DArray texture_specular1;
 };
 
 struct PointLight {
-    vec3 position;
-
     float constant;
     float linear;
     float quadratic;
@@ -28,7 +26,6 @@ struct DirLight {
 };
 
 struct SpotLight {
-    float ind;
     vec3 position;
     vec3 direction;
     float cutOff;
@@ -43,16 +40,26 @@ struct SpotLight {
     vec3 specular;
 };
 
-in vec2 TexCoords;
+// xy in the diffuse layer, zw in the specular layer
+in vec4 TexCoords;
 in vec3 FragPos;
 in vec3 Normal;
+flat in vec2 MaterialLayers;
 
 uniform SpotLight spotLight;
 uniform DirLight dirLight;
 uniform PointLight pointLight;
-uniform vec3 viewPos;
 uniform Material material;
 
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPosition;
+    vec4 pointLightPosition;
+    // animated spot light colour, w switches the spot light on and off
+    vec4 spotLightColor;
+};
+
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 {
     vec3 lightDir = normalize(-light.direction);
@@ -61,26 +68,26 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0f);
 
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, vec3(TexCoords.xy, MaterialLayers.x)));
+    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, vec3(TexCoords.xy, MaterialLayers.x)));
+    vec3 specular = light.specular * spec * texture(material.texture_specular1, vec3(TexCoords.zw, MaterialLayers.y)).xxx;
     return (ambient + diffuse + specular);
 }
 
 vec3 CalcPointLight(PointLight light,vec3 normal, vec3 fragPos,vec3 viewDir){
 
-    vec3 lightDir = normalize(light.position - fragPos);
+    vec3 lightDir = normalize(pointLightPosition.xyz - fragPos);
     float diff = max(dot(normal, lightDir), 0.0);
 
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0f);
 
-    float distance = length(light.position - fragPos);
+    float distance = length(pointLightPosition.xyz - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
 
-    vec3 ambient = light.ambient * texture(material.texture_diffuse1, TexCoords).rgb;
-    vec3 diffuse = light.diffuse * diff * texture(material.texture_diffuse1, TexCoords).rgb;
-    vec3 specular = light.specular * spec * texture(material.texture_specular1, TexCoords).rgb;
+    vec3 ambient = light.ambient * texture(material.texture_diffuse1, vec3(TexCoords.xy, MaterialLayers.x)).rgb;
+    vec3 diffuse = light.diffuse * diff * texture(material.texture_diffuse1, vec3(TexCoords.xy, MaterialLayers.x)).rgb;
+    vec3 specular = light.specular * spec * texture(material.texture_specular1, vec3(TexCoords.zw, MaterialLayers.y)).xxx;
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -102,9 +109,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
 
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, vec3(TexCoords.xy, MaterialLayers.x)));
+    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, vec3(TexCoords.xy, MaterialLayers.x)));
+    vec3 specular = light.specular * spec * texture(material.texture_specular1, vec3(TexCoords.zw, MaterialLayers.y)).xxx;
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
@@ -113,9 +120,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 
 void main(){
      vec3 normal = normalize(Normal);
-     vec3 viewDir = normalize(viewPos - FragPos);
+     vec3 viewDir = normalize(viewPosition.xyz - FragPos);
      vec3 result = CalcDirLight(dirLight,normal,viewDir);
      result+=CalcPointLight(pointLight, normal, FragPos, viewDir);
-     result+=CalcSpotLight(spotLight,normal,FragPos,viewDir)*spotLight.ind;
+     result+=CalcSpotLight(spotLight,normal,FragPos,viewDir)*spotLightColor.w;
      FragColor = vec4(result, 1.0);
 }
\ No newline at end of file
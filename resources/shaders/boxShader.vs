@@ -4,18 +4,43 @@ layout (location = 0 ) in vec3 aPos;
 layout (location = 1 ) in vec3 aNormal;
 layout (location = 2 ) in vec2 aTexCoords;
 
-out vec2 TexCoords;
+// xy in the diffuse layer, zw in the specular layer
+out vec4 TexCoords;
 out vec3 FragPos;
 out vec3 Normal;
+flat out vec2 MaterialLayers;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#define MAX_BOXES 32
+
+struct BoxInstance {
+    mat4 model;
+    // inverse transpose of the model matrix, from the transform system
+    mat3 normalMatrix;
+    // x: layer of the diffuse array, y: layer of the specular array, z: the set of arrays bound
+    vec4 material;
+    // xy: part of the diffuse layer its image covers, zw: the same for the specular layer
+    vec4 texScale;
+};
+layout (std140) uniform BoxInstances {
+    BoxInstance boxes[MAX_BOXES];
+};
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPosition;
+    vec4 pointLightPosition;
+    // animated spot light colour, w switches the spot light on and off
+    vec4 spotLightColor;
+};
+
+invariant gl_Position;
 
 void main(){
 
+    mat4 model = boxes[gl_InstanceID].model;
+    MaterialLayers = boxes[gl_InstanceID].material.xy;
     FragPos=vec3(model*vec4(aPos,1.0));
-    Normal = mat3(transpose(inverse(model)))*aNormal;
-    TexCoords=aTexCoords;
+    Normal = boxes[gl_InstanceID].normalMatrix*aNormal;
+    TexCoords=vec4(aTexCoords, aTexCoords)*boxes[gl_InstanceID].texScale;
     gl_Position = projection*view*vec4(FragPos,1.0f);
 }
\ No newline at end of file
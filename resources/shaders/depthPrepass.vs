@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPosition;
+    vec4 pointLightPosition;
+    // animated spot light colour, w switches the spot light on and off
+    vec4 spotLightColor;
+};
+
+// must produce bit-identical depth to the shading pass, which tests with GL_EQUAL
+invariant gl_Position;
+
+void main()
+{
+    vec3 FragPos = vec3(model * vec4(aPos, 1.0));
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
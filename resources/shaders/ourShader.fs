@@ -10,8 +10,6 @@ struct DirLight {
 };
 
 struct PointLight {
-    vec3 position;
-
     vec3 specular;
     vec3 diffuse;
     vec3 ambient;
@@ -22,7 +20,6 @@ struct PointLight {
 };
 
 struct SpotLight {
-    float ind;
     vec3 position;
     vec3 direction;
     float cutOff;
@@ -31,10 +28,6 @@ struct SpotLight {
     float constant;
     float linear;
     float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
 };
 
 struct Material {
@@ -52,17 +45,25 @@ uniform DirLight dirLight;
 uniform PointLight pointLight;
 uniform SpotLight spotLight;
 uniform Material material;
-uniform vec3 viewPosition;
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPosition;
+    vec4 pointLightPosition;
+    // animated spot light colour, w switches the spot light on and off
+    vec4 spotLightColor;
+};
 
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
-    vec3 lightDir = normalize(light.position - fragPos);
+    vec3 lightDir = normalize(pointLightPosition.xyz - fragPos);
     float diff = max(dot(normal, lightDir), 0.0);
 
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
 
-    float distance = length(light.position - fragPos);
+    float distance = length(pointLightPosition.xyz - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
     vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
 
@@ -102,9 +103,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
     float epsilon = light.cutOff - light.outerCutOff;
     float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
 
-    vec3 ambient = light.ambient * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.texture_diffuse1, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.texture_specular1, TexCoords));
+    vec3 ambient = spotLightColor.rgb * vec3(texture(material.texture_diffuse1, TexCoords));
+    vec3 diffuse = spotLightColor.rgb * diff * vec3(texture(material.texture_diffuse1, TexCoords));
+    vec3 specular = spotLightColor.rgb * spec * vec3(texture(material.texture_specular1, TexCoords).xxx);
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
     specular *= attenuation * intensity;
@@ -114,9 +115,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 void main()
 {
     vec3 normal = normalize(Normal);
-    vec3 viewDir = normalize(viewPosition - FragPos);
+    vec3 viewDir = normalize(viewPosition.xyz - FragPos);
     vec3 result = CalcPointLight(pointLight, normal, FragPos, viewDir);
     result += CalcDirLight(dirLight,normal,viewDir);
-    result += CalcSpotLight(spotLight,normal,FragPos,viewDir)*spotLight.ind;
+    result += CalcSpotLight(spotLight,normal,FragPos,viewDir)*spotLightColor.w;
     FragColor = vec4(result, 1.0);
 }
\ No newline at end of file
@@ -3,7 +3,6 @@
 out vec4 FragColor;
 
 struct SpotLight {
-    float ind;
     vec3 position;
     vec3 direction;
     float cutOff;
@@ -13,14 +12,10 @@ struct SpotLight {
     float linear;
     float quadratic;
 
-    vec3 ambient;
-    vec3 diffuse;
     vec3 specular;
 };
 
 struct PointLight {
-    vec3 position;
-
     vec3 specular;
     vec3 diffuse;
     vec3 ambient;
@@ -44,11 +39,19 @@ struct DirLight {
    in vec3 FragPos;
 
    uniform sampler2D floor_texture;
-   uniform vec3 viewPos;
    uniform SpotLight spotLight;
    uniform DirLight dirLight;
    uniform PointLight pointLight;
 
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec4 viewPosition;
+    vec4 pointLightPosition;
+    // animated spot light colour, w switches the spot light on and off
+    vec4 spotLightColor;
+};
+
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 {
     vec3 lightDir = normalize(-light.direction);
@@ -65,13 +68,13 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
-    vec3 lightDir = normalize(light.position - fragPos);
+    vec3 lightDir = normalize(pointLightPosition.xyz - fragPos);
     float diff = max(dot(normal, lightDir), 0.0);
 
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), 64.0f);
 
-    float distance = length(light.position - fragPos);
+    float distance = length(pointLightPosition.xyz - fragPos);
     float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));
 
     vec3 ambient = light.ambient * vec3(texture(floor_texture,  TexCoords));
@@ -99,8 +102,8 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
      float epsilon = light.cutOff - light.outerCutOff;
      float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
 
-     vec3 ambient = light.ambient * vec3(texture(floor_texture, TexCoords));
-     vec3 diffuse = light.diffuse * diff * vec3(texture(floor_texture, TexCoords));
+     vec3 ambient = spotLightColor.rgb * vec3(texture(floor_texture, TexCoords));
+     vec3 diffuse = spotLightColor.rgb * diff * vec3(texture(floor_texture, TexCoords));
      vec3 specular = light.specular * spec * vec3(texture(floor_texture, TexCoords));
      ambient *= attenuation * intensity;
      diffuse *= attenuation * intensity;
@@ -110,9 +113,9 @@ vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
    void main()
    {
         vec3 normal = normalize(Normal);
-        vec3 viewDir = normalize(viewPos - FragPos);
+        vec3 viewDir = normalize(viewPosition.xyz - FragPos);
         vec3 result = CalcDirLight(dirLight,normal,viewDir);
-        result += CalcSpotLight(spotLight,normal,FragPos,viewDir)*spotLight.ind;
+        result += CalcSpotLight(spotLight,normal,FragPos,viewDir)*spotLightColor.w;
         result += CalcPointLight(pointLight,normal,FragPos,viewDir);
         FragColor = vec4(result,1.0);
    }
\ No newline at end of file
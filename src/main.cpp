@@ -1,6 +1,9 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <stb_image.h>
+#include <imgui.h>
+#include <imgui_impl_glfw.h>
+#include <imgui_impl_opengl3.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -10,31 +13,85 @@
 #include <learnopengl/shader_m.h>
 #include <learnopengl/camera.h>
 #include <learnopengl/model.h>
-
+#include <rg/CommandBuffer.h>
+#include <rg/CompressedTexture.h>
+#include <rg/DepthPrepass.h>
+#include <rg/EntityStore.h>
+#include <rg/FrameArena.h>
+#include <rg/FrameClock.h>
+#include <rg/FrameMailbox.h>
+#include <rg/FramePacer.h>
+#include <rg/FrameTiming.h>
+#include <rg/GeometryArena.h>
+#include <rg/GLExtensions.h>
+#include <rg/GLState.h>
+#include <rg/RedrawTracker.h>
+#include <rg/ShaderInterface.h>
+#include <rg/StaticBatch.h>
+#include <rg/StreamBuffer.h>
+#include <rg/TextureArray.h>
+#include <rg/TextureDecoder.h>
+#include <rg/TextureFormat.h>
+#include <rg/TextureStreamer.h>
+#include <rg/VertexLayout.h>
+#include <rg/TextureUploadQueue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <new>
 #include <string>
+#include <thread>
+#include <vector>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow *window);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
+void window_refresh_callback(GLFWwindow *window);
+void window_focus_callback(GLFWwindow *window, int focused);
+void window_iconify_callback(GLFWwindow *window, int iconified);
 
 
-unsigned int loadTexture(const char *path);
+unsigned int loadTexture(const char *path, rg::TextureUsage usage = rg::TextureUsage::Color);
 unsigned int loadCubemap(vector<std::string>faces);
+void bindFrameDataBlock(const Shader& shader);
+unsigned long long heapAllocationCount();
 // settings
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
+// the fixed step the scene and camera advance by, also the longest the simulation thread waits for
+// input before looking at the clock again
+const double SIMULATION_STEP = 1.0 / 240.0;
+// objects per command buffer when per-object draws are recorded on the worker pool
+const size_t COMMAND_PARTITION = 256;
+// frames drawn before RG_CHECK_FRAME_ALLOCATIONS expects the thread that draws to make no heap allocations in a frame
+const unsigned long ALLOCATION_CHECK_WARMUP = 120;
 
 float lastX = SCR_WIDTH / 2.0f;
 float lastY = SCR_HEIGHT / 2.0f;
 bool firstMouse = true;
 
-// timing
+// timing: the simulation step processInput moves the camera by
 float deltaTime = 0.0f;
-float lastFrame = 0.0f;
 
 float ind=1.0f;
+// F1 shows the texture streaming and depth pre-pass overlays
+bool showStreamingOverlay = false;
+// P stops and restarts the animations, the scene then comes to rest
+bool animationsPlaying = true;
+// picked with 3/4/5, handed to the renderer with every frame
+rg::DepthPrepassMode depthPrepassMode = rg::DepthPrepassMode::Auto;
+// as last reported by GLFW, the renderer sets the viewport from it
+int framebufferWidth = SCR_WIDTH;
+int framebufferHeight = SCR_HEIGHT;
+
+rg::DepthPrepass depthPrepass;
+// told by the window callbacks when the window needs drawing again
+rg::RedrawTracker redrawTracker;
 
 struct SpotLight {
     glm::vec3 position;
@@ -65,11 +122,78 @@ struct PointLight {
     float ind;
 };
 
+// per-frame values shared by all programs, std140 layout of the FrameData uniform block
+struct FrameData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 viewPosition;
+    glm::vec4 pointLightPosition;
+    glm::vec4 spotLightColor;
+};
+const GLuint FRAME_DATA_BINDING = 0;
+
+// one gift box, std140 layout of an element of the BoxInstances uniform block in boxShader.vs; how many
+// fit in the block, MAX_BOXES there, is read back from the linked program
+struct BoxInstance {
+    glm::mat4 model;
+    rg::NormalMatrix normalMatrix;
+    // x: layer of the diffuse array, y: layer of the specular array, z: the set of arrays
+    glm::vec4 material;
+    // xy: part of the diffuse layer its image covers, zw: the same for the specular layer
+    glm::vec4 texScale;
+};
+static_assert(sizeof(BoxInstance) == 144, "BoxInstance must match the std140 stride of boxes[] in boxShader.vs");
+const GLuint BOX_INSTANCES_BINDING = 1;
+// pairs of diffuse and specular arrays, z of the box material picks one
+const unsigned int BOX_MATERIAL_SETS = 2;
+
+// Everything the renderer needs of one simulation step, copied out of the scene so the simulation
+// can go on with the next step while this one is drawn. Handed to the render thread through a
+// FrameMailbox and never changed once published.
+struct FrameSnapshot {
+    // when the input this frame reflects was sampled
+    std::chrono::steady_clock::time_point inputTime;
+    // simulation time of the interpolated state, seconds
+    double time = 0.0;
+    // wall time since the frame before
+    float deltaTime = 0.0f;
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec3 viewPosition;
+    glm::vec3 pointLightPosition;
+    float spotLightOn = 1.0f;
+    rg::DepthPrepassMode depthPrepassMode = rg::DepthPrepassMode::Auto;
+    bool showStreamingOverlay = false;
+    int framebufferWidth = 0, framebufferHeight = 0;
+    int windowWidth = 0, windowHeight = 0;
+    glm::mat4 sledModel;
+    glm::mat4 windowModel;
+    glm::mat4 roomModel;
+    std::vector<rg::RenderInstance> boxes;
+    struct Light {
+        rg::LightType type;
+        glm::vec3 color;
+        glm::mat4 model;
+    };
+    std::vector<Light> lights;
+};
+
+// renderable batches of the entity store
+enum SceneBatch : unsigned int {
+    BOX_BATCH
+};
+
 Camera camera(glm::vec3(-4.0f, 5.0f, 15.0f));
 glm::vec3 lightPos = glm::vec3(0.0f,0.0f,0.0f);
 
-int main()
+int main(int argc, char** argv)
 {
+    // --pin-workers binds every worker thread to a core of its own, read before anything uses the pool
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--pin-workers") == 0)
+            rg::workerPoolOptions().pinThreads = true;
+    }
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -91,9 +215,13 @@ int main()
         return -1;
     }
     glfwMakeContextCurrent(window);
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, mouse_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
+    glfwSetWindowFocusCallback(window, window_focus_callback);
+    glfwSetWindowIconifyCallback(window, window_iconify_callback);
 
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
@@ -104,12 +232,44 @@ int main()
         std::cout << "Failed to initialize GLAD" << std::endl;
         return -1;
     }
-
+    rg::loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+
+    // the benchmarks run in the order given and the program exits after them; they combine with
+    // options such as --pin-workers
+    //   --benchmark-mipmaps compares the CPU mip chains with glGenerateMipmap on this driver
+    //   --benchmark-entities times the entity store systems from 1k to 100k entities
+    //   --benchmark-transforms times the batched transform kernels from 1k to 1M transforms
+    //   --benchmark-jobs times task throughput and wake-up latency of the worker pool
+    //   --benchmark-commands times recording draw commands on one thread and on the worker pool
+    //   --benchmark-model-storage times the per-frame mesh loops over flattened and per-mesh storage
+    bool benchmarked = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--benchmark-mipmaps") == 0)
+            rg::benchmarkMipmapGeneration(std::cout);
+        else if (std::strcmp(argv[i], "--benchmark-entities") == 0)
+            rg::benchmarkEntityStore(std::cout);
+        else if (std::strcmp(argv[i], "--benchmark-transforms") == 0)
+            rg::benchmarkTransformKernels(std::cout);
+        else if (std::strcmp(argv[i], "--benchmark-jobs") == 0)
+            rg::benchmarkWorkerPool(std::cout);
+        else if (std::strcmp(argv[i], "--benchmark-commands") == 0)
+            rg::benchmarkCommandRecording(std::cout);
+        else if (std::strcmp(argv[i], "--benchmark-model-storage") == 0)
+            benchmarkModelStorage(std::cout);
+        else
+            continue;
+        benchmarked = true;
+    }
+    if (benchmarked)
+    {
+        glfwTerminate();
+        return 0;
+    }
 
     stbi_set_flip_vertically_on_load(false);
     // configure global opengl state
     // -----------------------------
-    glEnable(GL_DEPTH_TEST);
+    rg::glState().SetEnabled(GL_DEPTH_TEST, true);
 
     glm::vec3 pointLightColor = glm::vec3(0.5f, 0.5f, 0.6f);
 
@@ -126,7 +286,8 @@ int main()
     spotlight.position=glm::vec3(-4.5f,5.5f,-5.5f);
     spotlight.direction= glm::vec3(0.0f,-1.0f,0.0f);
     spotlight.ambient=glm::vec3(0.2f,0.5f,0.2f);
-    spotlight.diffuse=glm::vec3(0.2f*sin(glfwGetTime()*5.0f), 0.5f, 0.2f);
+    // pulses with the simulation time, the frame data carries the current colour
+    spotlight.diffuse=glm::vec3(0.0f, 0.5f, 0.2f);
     spotlight.specular=glm::vec3( 0.2f, 0.5f, 0.2f);
     spotlight.constant= 1.0;
     spotlight.linear=0.09;
@@ -144,6 +305,30 @@ int main()
     Shader ourShader("resources/shaders/ourShader.vs","resources/shaders/ourShader.fs");
     Shader skyBoxShader("resources/shaders/skyBox.vs","resources/shaders/skyBox.fs");
     Shader windowShader("resources/shaders/window.vs","resources/shaders/window.fs");
+    Shader depthShader("resources/shaders/depthPrepass.vs","resources/shaders/depthPrepass.fs");
+
+    bindFrameDataBlock(boxShader);
+    // the whole block is bound for every draw, a shorter range leaves the shader undefined; boxes
+    // beyond what one block holds go into further draws
+    unsigned int boxInstancesIndex = glGetUniformBlockIndex(boxShader.ID, "BoxInstances");
+    GLint boxInstancesSize = 0;
+    if (boxInstancesIndex != GL_INVALID_INDEX) {
+        glUniformBlockBinding(boxShader.ID, boxInstancesIndex, BOX_INSTANCES_BINDING);
+        glGetActiveUniformBlockiv(boxShader.ID, boxInstancesIndex, GL_UNIFORM_BLOCK_DATA_SIZE, &boxInstancesSize);
+    }
+    const size_t boxesPerDraw = (size_t)boxInstancesSize / sizeof(BoxInstance);
+    if (boxesPerDraw == 0)
+        std::cout << "ERROR::BOX_SHADER::NO_BOX_INSTANCES_BLOCK" << std::endl;
+    bindFrameDataBlock(roomShader);
+    bindFrameDataBlock(lightCube);
+    bindFrameDataBlock(ourShader);
+    bindFrameDataBlock(skyBoxShader);
+    bindFrameDataBlock(windowShader);
+    bindFrameDataBlock(depthShader);
+
+    // camera, point light position and the animated spot light colour are streamed every frame,
+    // 64 KiB per frame leaves room for instance data next to the FrameData block
+    rg::StreamBuffer frameStream(64 * 1024);
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
     float vertices[] = {
@@ -300,80 +485,56 @@ int main()
 
     };
 
-    unsigned int VBO, VAO;
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-    glBindVertexArray(VAO);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
-    unsigned int skyboxVAO, skyboxVBO;
-    glGenVertexArrays(1, &skyboxVAO);
-    glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-
-    unsigned int roomVBO, roomVAO;
-    glGenVertexArrays(1, &roomVAO);
-    glGenBuffers(1, &roomVBO);
-    glBindVertexArray(roomVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, roomVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(room), room, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE,11 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 11 * sizeof(float), (void*)(9 * sizeof(float)));
-    glEnableVertexAttribArray(3);
-
-    unsigned int cubeVAO, cubeVBO,EBO;
-    glGenVertexArrays(1, &cubeVAO);
-    glGenBuffers(1, &cubeVBO);
-    glBindVertexArray(cubeVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-    glGenBuffers(1,&EBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER,sizeof(indices),indices,GL_STATIC_DRAW);
-
-    unsigned int transparentVAO, transparentVBO;
-    glGenVertexArrays(1, &transparentVAO);
-    glGenBuffers(1, &transparentVBO);
-    glBindVertexArray(transparentVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, transparentVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(transparentVertices), transparentVertices, GL_STATIC_DRAW);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
-    glBindVertexArray(0);
-
-    unsigned int ng1 = loadTexture(FileSystem::getPath("resources/textures/c1.jpg").c_str());
-    unsigned int ng2 = loadTexture(FileSystem::getPath("resources/textures/c2.jpg").c_str());
-    unsigned int ng3 = loadTexture(FileSystem::getPath("resources/textures/c3.png").c_str());
+    // all static geometry is suballocated from the shared arena, one VAO per vertex format
+    typedef rg::VertexLayout<rg::Attribute<0, glm::vec3>, rg::Attribute<1, glm::vec3>, rg::Attribute<2, glm::vec2>> BoxLayout;
+    typedef rg::VertexLayout<rg::Attribute<0, glm::vec3>, rg::Attribute<1, glm::vec3>, rg::Attribute<2, glm::vec3>,
+                             rg::Attribute<3, glm::vec2>> RoomLayout;
+    typedef rg::VertexLayout<rg::Attribute<0, glm::vec3>, rg::Attribute<1, glm::vec2>> WindowLayout;
+    static_assert(BoxLayout::Stride == 8 * sizeof(float) && RoomLayout::Stride == 11 * sizeof(float) &&
+                  WindowLayout::Stride == 5 * sizeof(float), "layouts have to match the vertex arrays");
+    const rg::VertexFormat& boxFormat = BoxLayout::Format();
+    const rg::VertexFormat& roomFormat = RoomLayout::Format();
+    const rg::VertexFormat& windowFormat = WindowLayout::Format();
+
+    rg::GeometryArena& arena = rg::geometryArena();
+    rg::GeometryAllocation boxGeometry = arena.Allocate(boxFormat, vertices, 36);
+    rg::GeometryAllocation lightCubeGeometry = arena.Allocate(boxFormat, vertices, 36, indices, sizeof(indices) / sizeof(indices[0]));
+    rg::GeometryAllocation skyboxGeometry = arena.Allocate(positionVertexFormat(), skyboxVertices, 36);
+    rg::GeometryAllocation roomGeometry = arena.Allocate(roomFormat, room, sizeof(room) / RoomLayout::Stride);
+    rg::GeometryAllocation windowGeometry = arena.Allocate(windowFormat, transparentVertices, 6);
+
+    // tightly packed box positions for the depth pre-pass
+    float boxDepthVertices[36 * 3];
+    for (unsigned int i = 0; i < 36; i++) {
+        boxDepthVertices[i * 3 + 0] = vertices[i * 8 + 0];
+        boxDepthVertices[i * 3 + 1] = vertices[i * 8 + 1];
+        boxDepthVertices[i * 3 + 2] = vertices[i * 8 + 2];
+    }
+    rg::GeometryAllocation boxDepthGeometry = arena.AllocateSharingIndices(positionVertexFormat(), boxDepthVertices, 36, boxGeometry);
+
+    // the gift box materials in two sets of arrays sized to their images, each image keeps its own
+    // resolution and smaller ones are padded: set 0 holds the two large wrapping papers, set 1 the
+    // small third paper and, as diffuse layer 1, the base under the tree
+    rg::TextureArray boxDiffuse[BOX_MATERIAL_SETS], boxSpecular[BOX_MATERIAL_SETS];
+    boxDiffuse[0].Load({
+            FileSystem::getPath("resources/textures/c1.jpg"),
+            FileSystem::getPath("resources/textures/c2.jpg")
+    });
+    boxSpecular[0].Load({
+            FileSystem::getPath("resources/textures/c1s.jpg"),
+            FileSystem::getPath("resources/textures/c2s.jpg")
+    }, 0, 0, rg::TextureUsage::Mask);
+    boxDiffuse[1].Load({
+            FileSystem::getPath("resources/textures/c3.png"),
+            FileSystem::getPath("resources/textures/red.png")
+    });
+    boxSpecular[1].Load({
+            FileSystem::getPath("resources/textures/c3s.jpg")
+    }, 0, 0, rg::TextureUsage::Mask);
     unsigned int floor = loadTexture(FileSystem::getPath("resources/textures/wooden.jpeg").c_str());
     unsigned int slad = loadTexture(FileSystem::getPath("resources/textures/wooden.jpeg").c_str());
     unsigned int star = loadTexture(FileSystem::getPath("resources/textures/base.jpg").c_str());
     unsigned int window1 = loadTexture(FileSystem::getPath("resources/textures/bur.jpg").c_str());
-    unsigned int base = loadTexture(FileSystem::getPath("resources/textures/red.png").c_str());
-    unsigned int c1spec = loadTexture(FileSystem::getPath("resources/textures/c1s.jpg").c_str());
-    unsigned int c2spec = loadTexture(FileSystem::getPath("resources/textures/c2s.jpg").c_str());
-    unsigned int c3spec = loadTexture(FileSystem::getPath("resources/textures/c3s.jpg").c_str());
 
     vector<std::string> faces
             {
@@ -386,22 +547,230 @@ int main()
             };
     unsigned int cubemapTexture = loadCubemap(faces);
 
-    Model treeModel(FileSystem::getPath("resources/objects/tree/tree.obj"));
-    Model starModel(FileSystem::getPath("resources/objects/star/star.obj"));
-    Model sladModel(FileSystem::getPath("resources/objects/sled/sled.obj"));
-    Model clockModel(FileSystem::getPath("resources/objects/sat/sat.obj"));
-    Model mrazModel(FileSystem::getPath("resources/objects/dedaMraz/dedaMraz.obj"));
+    // the models only keep the attributes and maps ourShader reads
+    rg::ShaderInterface modelShaderInterface(ourShader.ID, "material.");
+
+    // the tree, star, clock and santa never move: they are baked into world space once and merged by
+    // material, --no-static-merging keeps their meshes apart to compare draw counts and frame times
+    rg::StaticBatch staticBatch;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--no-static-merging") == 0)
+            staticBatch.Merge = false;
+    }
 
-    treeModel.SetShaderTextureNamePrefix("material.");
-    starModel.SetShaderTextureNamePrefix("material.");
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::translate(model,glm::vec3(glm::vec3(0.0f,-1.0f,0.0f)));
+    model = glm::rotate(model,glm::radians(-90.0f),glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::scale(model,glm::vec3(0.05f,0.05f,0.05f));
+    staticBatch.Add(FileSystem::getPath("resources/objects/tree/tree.obj"), model, &modelShaderInterface);
+
+    // the star has no maps of its own
+    model = glm::mat4(1.0f);
+    model = glm::translate(model,glm::vec3(-0.05f,7.5f,0.0f));
+    model = glm::rotate(model,glm::radians(-90.0f),glm::vec3(-1.0f, 0.0f, 0.0f));
+    model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
+    staticBatch.Add(FileSystem::getPath("resources/objects/star/star.obj"), model, &modelShaderInterface,
+                    {Texture{star, MaterialSlot::Diffuse}});
+
+    model = glm::mat4(1.0f);
+    model = glm::translate(model,glm::vec3(7.8f,6.0f,-2.0f));
+    model = glm::rotate(model,glm::radians(-90.0f),glm::vec3(0.0f, 1.0f, .0f));
+    model = glm::scale(model, glm::vec3(0.045f, 0.045f, 0.045f));
+    staticBatch.Add(FileSystem::getPath("resources/objects/sat/sat.obj"), model, &modelShaderInterface);
+
+    model = glm::mat4(1.0f);
+    model = glm::translate(model,glm::vec3(-4.5f,-1.5f,-5.0f));
+    model = glm::rotate(model,glm::radians(-90.0f),glm::vec3(1.0f,0.0f,0.0f));
+    model = glm::scale(model, glm::vec3(0.03f, 0.03f, 0.03f));
+    staticBatch.Add(FileSystem::getPath("resources/objects/dedaMraz/dedaMraz.obj"), model, &modelShaderInterface);
+
+    Model staticModel = staticBatch.Build();
+    staticBatch.PrintStats(std::cout);
+    Model sladModel(FileSystem::getPath("resources/objects/sled/sled.obj"), false, &modelShaderInterface);
+
+    staticModel.SetShaderTextureNamePrefix("material.");
     sladModel.SetShaderTextureNamePrefix("material.");
-    clockModel.SetShaderTextureNamePrefix("material.");
-    mrazModel.SetShaderTextureNamePrefix("material.");
+
+    // the images were decoded in parallel while the models loaded
+    rg::textureDecoder().Wait();
+    std::cout << "TEXTURE_DECODER:: " << rg::workerPool().ThreadCount() << " workers, "
+              << rg::textureDecoder().Milliseconds() << " ms of decoding and mip chains" << std::endl;
+
+    {
+        Model* loadedModels[] = {&staticModel, &sladModel};
+        unsigned int skippedTextures = 0;
+        unsigned long skippedBytes = 0;
+        for (Model* loaded : loadedModels) {
+            skippedTextures += loaded->pruneStats.skippedTextures;
+            skippedBytes += loaded->pruneStats.skippedTextureBytes + loaded->pruneStats.skippedVertexBytes;
+        }
+        // the maps that were skipped would have taken about as long as the average one that was not
+        double perTexture = rg::textureDecoder().Decoded() > 0 ? rg::textureDecoder().Milliseconds() / rg::textureDecoder().Decoded() : 0.0;
+        std::cout << "MODEL:: pruning saved " << skippedBytes / 1024 << " KB and about " << skippedTextures * perTexture
+                  << " ms of worker time for " << skippedTextures << " maps" << std::endl;
+    }
+
+    arena.PrintStats(std::cout);
+    std::cout << "TEXTURE_FORMAT:: " << rg::textureMemorySaved() / 1024 << " KB of VRAM saved in total" << std::endl;
+
+    // opaque models that take part in the depth pre-pass, the static one is already in world space
+    Model* opaqueModels[] = {&staticModel, &sladModel};
+    const unsigned int opaqueModelCount = sizeof(opaqueModels) / sizeof(opaqueModels[0]);
+    glm::mat4 opaqueMatrices[opaqueModelCount] = {glm::mat4(1.0f), glm::mat4(1.0f)};
+
+    // everything placed in the scene by hand is an entity; the animation system moves the sled and
+    // the point light, the transform system only rebuilds the matrices of what moved
+    rg::EntityStore scene;
+
+    // boxes, indexed like cubePositions, 9 is the base under the tree
+    for (unsigned int i = 0; i < 15; i++) {
+        float angle = 20.0f * i;
+        glm::quat rotation = i == 9 ? glm::quat(1.0f, 0.0f, 0.0f, 0.0f) : glm::angleAxis(angle, glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::vec3 scale = i == 9 ? glm::vec3(1.5f, 0.5f, 1.5f) : i > 9 ? glm::vec3(0.5, 0.3, 0.5) : glm::vec3(1.0f);
+        // the base has no specular map of its own and shares the one of the third paper
+        float set = i == 9 || i % 3 == 2 ? 1.0f : 0.0f;
+        float layer = i == 9 ? 1.0f : i % 3 == 2 ? 0.0f : (float)(i % 3);
+        rg::Entity box = scene.Create();
+        scene.AddTransform(box, cubePositions[i], rotation, scale);
+        scene.AddRenderable(box, BOX_BATCH, boxGeometry, glm::vec4(layer, i == 9 ? 0.0f : layer, set, 0.0f));
+    }
+
+    const rg::Entity windowEntity = scene.Create();
+    scene.AddTransform(windowEntity, glm::vec3(-7.965f,6.5f,-10.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f),
+                       glm::vec3(0.103f, 0.1187f, 0.1f) * glm::vec3(155.0f,135.0f,160.0f));
+
+    const rg::Entity roomEntity = scene.Create();
+    scene.AddTransform(roomEntity, glm::vec3(0.0f,6.5f,-2.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(16.0f));
+
+    const rg::Entity spotLightEntity = scene.Create();
+    scene.AddTransform(spotLightEntity, spotlight.position,
+                       glm::angleAxis(glm::radians(45.0f), glm::vec3(1.0f, 0.0f, 0.0f)) *
+                       glm::angleAxis(glm::radians(45.0f), glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(0.4f));
+    scene.AddLight(spotLightEntity, rg::LightType::Spot, spotlight.specular);
+
+    // circles the tree with a radius of 4, bobbing 2 units up and down
+    const rg::Entity pointLightEntity = scene.Create();
+    scene.AddTransform(pointLightEntity, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.6f));
+    rg::Animation pointLightAnimation;
+    pointLightAnimation.center = glm::vec3(0.0f, 2.0f, 0.0f);
+    pointLightAnimation.radius = 4.0f;
+    pointLightAnimation.height = 2.0f;
+    pointLightAnimation.speed = 1.0f;
+    scene.AddAnimation(pointLightEntity, pointLightAnimation);
+    scene.AddLight(pointLightEntity, rg::LightType::Point, glm::vec3(1.0f));
+
+    // circles the tree the other way with a radius of 5 while it spins around its own axis
+    const rg::Entity sledEntity = scene.Create();
+    scene.AddTransform(sledEntity, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.015f));
+    rg::Animation sledAnimation;
+    sledAnimation.center = glm::vec3(0.0f, -1.5f, 0.0f);
+    sledAnimation.radius = 5.0f;
+    sledAnimation.speed = -1.0f;
+    sledAnimation.phase = -glm::radians(90.0f);
+    sledAnimation.baseRotation = glm::angleAxis(glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    sledAnimation.spinAxis = glm::vec3(0.0f, 0.0f, 1.0f);
+    sledAnimation.spinSpeed = 1.0f;
+    scene.AddAnimation(sledEntity, sledAnimation);
+
+    // CPU time spent culling and submitting the opaque models, printed on exit
+    double opaqueSubmitMilliseconds = 0.0;
+    unsigned long frameCount = 0;
+
+    // per-object draws are recorded off the GL thread, with the uniform locations resolved here once
+    const GLint depthModelLocation = glGetUniformLocation(depthShader.ID, "model");
+    const GLint lightCubeModelLocation = glGetUniformLocation(lightCube.ID, "model");
+    const GLint lightCubeColorLocation = glGetUniformLocation(lightCube.ID, "color");
+    std::vector<rg::CommandBuffer> boxDepthCommands;
+    std::vector<rg::CommandBuffer> lightCubeCommands;
+    {
+        // sized for every entity up front, more boxes coming into view does not grow them mid-run
+        rg::CommandBuffer boxDepth, lightCubeDraw;
+        boxDepth.SetMat4(depthModelLocation, glm::mat4(1.0f));
+        boxDepth.Draw(boxDepthGeometry);
+        lightCubeDraw.SetMat4(lightCubeModelLocation, glm::mat4(1.0f));
+        lightCubeDraw.SetVec3(lightCubeColorLocation, glm::vec3(1.0f));
+        lightCubeDraw.Draw(lightCubeGeometry);
+        rg::reserveCommands(boxDepthCommands, scene.EntityCount(), COMMAND_PARTITION, boxDepth.ByteSize());
+        rg::reserveCommands(lightCubeCommands, scene.EntityCount(), COMMAND_PARTITION, lightCubeDraw.ByteSize());
+    }
+    double commandRecordMilliseconds = 0.0;
+    double commandReplayMilliseconds = 0.0;
+
+    // lights that do not move or change colour only need their uniforms set once
+
+    ourShader.use();
+    ourShader.setVec3("dirLight.direction",-0.2f, 0.0f, -0.3f);
+    ourShader.setVec3("dirLight.ambient", 0.25f, 0.25f, 0.1f);
+    ourShader.setVec3("dirLight.diffuse", 0.2f, 0.2f, 0.7f);
+    ourShader.setVec3("dirLight.specular", 1.0f, 1.0f, 1.0f);
+
+    ourShader.setVec3("pointLight.ambient", pointLight.ambient);
+    ourShader.setVec3("pointLight.diffuse",pointLight.diffuse);
+    ourShader.setVec3("pointLight.specular",pointLight.specular);
+    ourShader.setFloat("material.shininess",64.0f);
+    ourShader.setFloat("pointLight.constant",pointLight.constant);
+    ourShader.setFloat("pointLight.linear",pointLight.linear);
+    ourShader.setFloat("pointLight.quadratic",pointLight.quadratic);
+
+    ourShader.setVec3("spotLight.position",spotlight.position);
+    ourShader.setVec3("spotLight.direction", spotlight.direction);
+    ourShader.setFloat("spotLight.constant", spotlight.constant);
+    ourShader.setFloat("spotLight.linear", spotlight.linear);
+    ourShader.setFloat("spotLight.quadratic", spotlight.quadratic);
+    ourShader.setFloat("spotLight.cutOff", spotlight.cutOff);
+    ourShader.setFloat("spotLight.outerCutOff",spotlight.outerCutOff);
+
+    roomShader.use();
+    roomShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
+    roomShader.setVec3("dirLight.ambient", 0.25f, 0.25f, 0.2f);
+    roomShader.setVec3("dirLight.diffuse", 0.2f, 0.2f, 0.7f);
+    roomShader.setVec3("dirLight.specular", 0.7f, 0.7f, 0.7f);
+
+    roomShader.setVec3("pointLight.ambient", pointLight.ambient);
+    roomShader.setVec3("pointLight.diffuse",pointLight.diffuse);
+    roomShader.setVec3("pointLight.specular",pointLight.specular);
+    roomShader.setFloat("pointLight.constant",pointLight.constant);
+    roomShader.setFloat("pointLight.linear",pointLight.linear);
+    roomShader.setFloat("pointLight.quadratic",pointLight.quadratic);
+
+    roomShader.setVec3("spotLight.position",spotlight.position);
+    roomShader.setVec3("spotLight.direction", spotlight.direction);
+    roomShader.setVec3("spotLight.specular", spotlight.specular);
+    roomShader.setFloat("spotLight.constant", spotlight.constant);
+    roomShader.setFloat("spotLight.linear", spotlight.linear);
+    roomShader.setFloat("spotLight.quadratic", spotlight.quadratic);
+    roomShader.setFloat("spotLight.cutOff", spotlight.cutOff);
+    roomShader.setFloat("spotLight.outerCutOff", spotlight.outerCutOff);
+
+    boxShader.use();
+    boxShader.setVec3("pointLight.ambient", pointLight.ambient);
+    boxShader.setVec3("pointLight.diffuse",pointLight.diffuse);
+    boxShader.setVec3("pointLight.specular",pointLight.specular);
+    boxShader.setFloat("pointLight.constant",pointLight.constant);
+    boxShader.setFloat("pointLight.linear",pointLight.linear);
+    boxShader.setFloat("pointLight.quadratic",pointLight.quadratic);
+
+    boxShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
+    boxShader.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.1f);
+    boxShader.setVec3("dirLight.diffuse", 0.2f, 0.2f, 0.7f);
+    boxShader.setVec3("dirLight.specular", 0.7f, 0.7f, 0.7f);
+
+    boxShader.setVec3("spotLight.position", spotlight.position);
+    boxShader.setVec3("spotLight.direction", spotlight.direction);
+    boxShader.setVec3("spotLight.ambient", spotlight.ambient);
+    boxShader.setVec3("spotLight.diffuse", spotlight.diffuse);
+    boxShader.setVec3("spotLight.specular", spotlight.specular);
+    boxShader.setFloat("spotLight.constant", spotlight.constant);
+    boxShader.setFloat("spotLight.linear", spotlight.linear);
+    boxShader.setFloat("spotLight.quadratic", spotlight.quadratic);
+    boxShader.setFloat("spotLight.cutOff", spotlight.cutOff);
+    boxShader.setFloat("spotLight.outerCutOff", spotlight.outerCutOff);
+    boxShader.setInt("material.texture_diffuse1", 14);
+    boxShader.setInt("material.texture_specular1", 15);
 
     roomShader.use();
     roomShader.setInt("floor_texture",10);
-    glActiveTexture(GL_TEXTURE10);
-    glBindTexture(GL_TEXTURE_2D, floor);
+    rg::glState().BindTexture(10, GL_TEXTURE_2D, floor);
 
     windowShader.use();
     windowShader.setInt("texture1", 11);
@@ -409,376 +778,520 @@ int main()
     skyBoxShader.use();
     skyBoxShader.setInt("skybox", 0);
 
-    // render loop
+    // everything loaded so far is needed for the first frame
+    rg::textureUploadQueue().Flush();
 
-    while (!glfwWindowShouldClose(window))
-    {
+    // --no-render-thread draws on this thread right after every simulation step, to compare FRAME_TIMING
+    bool renderThreaded = true;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--no-render-thread") == 0)
+            renderThreaded = false;
+    }
 
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+    // --vsync=off|on|adaptive, --fps-limit=N frames per second, --max-frames-in-flight=N and
+    // --gl-finish trade throughput for latency; FRAME_TIMING shows what they did
+    rg::FramePacer framePacer;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--vsync=off") == 0)
+            framePacer.VSync = rg::VSyncMode::Off;
+        else if (std::strcmp(argv[i], "--vsync=on") == 0)
+            framePacer.VSync = rg::VSyncMode::On;
+        else if (std::strcmp(argv[i], "--vsync=adaptive") == 0)
+            framePacer.VSync = rg::VSyncMode::Adaptive;
+        else if (std::strncmp(argv[i], "--fps-limit=", 12) == 0)
+            framePacer.TargetFps = std::atof(argv[i] + 12);
+        else if (std::strncmp(argv[i], "--max-frames-in-flight=", 23) == 0)
+            framePacer.MaxFramesInFlight = (unsigned int)std::max(std::atoi(argv[i] + 23), 0);
+        else if (std::strcmp(argv[i], "--gl-finish") == 0)
+            framePacer.FinishAfterSwap = true;
+    }
+    // the interval belongs to the context, set here before the render thread takes it over
+    bool tearControl = glfwExtensionSupported("GLX_EXT_swap_control_tear") || glfwExtensionSupported("WGL_EXT_swap_control_tear");
+    int swapInterval = framePacer.SwapInterval(tearControl);
+    glfwSwapInterval(swapInterval);
+    framePacer.PrintSettings(std::cout, swapInterval);
+
+    // --on-demand only draws frames that show something new and fewer, --unfocused-fps=N per second,
+    // out of focus; REDRAW compares the CPU time it takes with a run drawing continuously
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--on-demand") == 0)
+            redrawTracker.OnDemand = true;
+        else if (std::strncmp(argv[i], "--unfocused-fps=", 16) == 0)
+            redrawTracker.UnfocusedFps = std::atof(argv[i] + 16);
+    }
 
-        processInput(window);
+    // ImGui chains to the callbacks installed above. The GLFW backend may only run on the main
+    // thread, so with the render thread the overlay gets its display size from the snapshots instead;
+    // it takes no input.
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGui_ImplGlfw_InitForOpenGL(window, !renderThreaded);
+    ImGui_ImplOpenGL3_Init("#version 330 core");
+
+    // The simulation side of a frame: input, camera and scene, captured into frame for the renderer.
+    // Keys and animations advance in fixed steps of SIMULATION_STEP on the clock's one snapshot of the
+    // frame, so motion does not depend on the frame rate; what is drawn is interpolated between the
+    // last two steps. Mouse look is applied as the events come in. The animations have a step count of
+    // their own, which stands still while they are paused.
+    rg::FrameClock frameClock(SIMULATION_STEP);
+    unsigned long long animationSteps = 0;
+    glm::vec3 previousCameraPosition = camera.Position;
+    // the scene at time 0 twice, so frames before the first step blend between two equal states
+    scene.Update(0.0);
+    scene.Update(0.0);
+    auto simulate = [&](FrameSnapshot& frame) {
+        unsigned int steps = frameClock.Tick();
+        frame.inputTime = frameClock.Now();
+
+        for (unsigned int step = 0; step < steps; step++) {
+            previousCameraPosition = camera.Position;
+            deltaTime = (float)frameClock.Step;
+            processInput(window);
+
+            if(camera.Position.y<-1.0f) {
+                camera.Position.y=-1.0f;
+            }
 
-        if(camera.Position.y<-1.0f) {
-            camera.Position.y=-1.0f;
-        }
+            if(camera.Position.z>15.0f){
+                camera.Position.z=15.0f;
+            }
+
+            if(camera.Position.x>7){
+                camera.Position.x=7.0f;
+            }
 
-        if(camera.Position.z>15.0f){
-            camera.Position.z=15.0f;
+            frameClock.NextStep();
+            if (animationsPlaying)
+                animationSteps++;
+            scene.Update((double)animationSteps * frameClock.Step);
+        }
+        float alpha = frameClock.Alpha();
+        scene.Interpolate(alpha);
+        glm::vec3 viewPosition = glm::mix(previousCameraPosition, camera.Position, alpha);
+
+        frame.time = ((double)animationSteps - (animationsPlaying ? 1.0 - alpha : 0.0)) * frameClock.Step;
+        frame.deltaTime = (float)frameClock.Delta();
+        frame.projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+        frame.view = glm::lookAt(viewPosition, viewPosition + camera.Front, camera.Up);
+        frame.viewPosition = viewPosition;
+        frame.spotLightOn = ind;
+        frame.depthPrepassMode = depthPrepassMode;
+        frame.showStreamingOverlay = showStreamingOverlay;
+        frame.framebufferWidth = framebufferWidth;
+        frame.framebufferHeight = framebufferHeight;
+        glfwGetWindowSize(window, &frame.windowWidth, &frame.windowHeight);
+
+        frame.sledModel = scene.World(sledEntity);
+        frame.windowModel = scene.World(windowEntity);
+        frame.roomModel = scene.World(roomEntity);
+        frame.boxes = scene.Batch(BOX_BATCH);
+        frame.lights.clear();
+        for (const rg::LightInstance& light : scene.Lights()) {
+            if (light.type == rg::LightType::Point)
+                frame.pointLightPosition = light.position;
+            frame.lights.push_back({light.type, light.color, scene.World(light.entity)});
         }
+    };
+
+    // Whether a simulated frame gets drawn: it is compared with the last one that was, and the
+    // differences are the reasons the redraw tracker decides on.
+    struct DrawnFrame {
+        glm::mat4 projection = glm::mat4(0.0f);
+        glm::mat4 view = glm::mat4(0.0f);
+        double time = 0.0;
+        float spotLightOn = -1.0f;
+        int framebufferWidth = 0, framebufferHeight = 0;
+        bool showStreamingOverlay = false;
+        unsigned long long sceneVersion = 0;
+    } drawn;
+    auto shouldDraw = [&](const FrameSnapshot& frame) {
+        unsigned int reasons = 0;
+        if (frame.view != drawn.view || frame.projection != drawn.projection)
+            reasons |= rg::RedrawCamera;
+        if (scene.Moving() || scene.Version() != drawn.sceneVersion)
+            reasons |= rg::RedrawAnimation;
+        // the spot light pulses with the animation time while it is on
+        if (frame.spotLightOn != drawn.spotLightOn || (frame.spotLightOn != 0.0f && frame.time != drawn.time))
+            reasons |= rg::RedrawLights;
+        if (frame.framebufferWidth != drawn.framebufferWidth || frame.framebufferHeight != drawn.framebufferHeight)
+            reasons |= rg::RedrawWindow;
+        // the overlay shows live numbers
+        if (frame.showStreamingOverlay || drawn.showStreamingOverlay)
+            reasons |= rg::RedrawOverlay;
+
+        bool focused = glfwGetWindowAttrib(window, GLFW_FOCUSED) != 0;
+        bool iconified = glfwGetWindowAttrib(window, GLFW_ICONIFIED) != 0;
+        if (!redrawTracker.BeginFrame(reasons, focused, iconified))
+            return false;
+        drawn.projection = frame.projection;
+        drawn.view = frame.view;
+        drawn.time = frame.time;
+        drawn.spotLightOn = frame.spotLightOn;
+        drawn.framebufferWidth = frame.framebufferWidth;
+        drawn.framebufferHeight = frame.framebufferHeight;
+        drawn.showStreamingOverlay = frame.showStreamingOverlay;
+        drawn.sceneVersion = scene.Version();
+        return true;
+    };
 
-        if(camera.Position.x>7){
-            camera.Position.x=7.0f;
+    // the GL side of a frame, everything it needs of the simulation comes with the snapshot
+    int viewportWidth = framebufferWidth;
+    int viewportHeight = framebufferHeight;
+    auto renderFrame = [&](const FrameSnapshot& frame) {
+        unsigned long long allocationsBefore = heapAllocationCount();
+        rg::frameArena().Reset();
+
+        if (frame.framebufferWidth != viewportWidth || frame.framebufferHeight != viewportHeight) {
+            viewportWidth = frame.framebufferWidth;
+            viewportHeight = frame.framebufferHeight;
+            glViewport(0, 0, viewportWidth, viewportHeight);
         }
 
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        spotlight.ind=ind;
-
-        ourShader.use();
-
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        glm::mat4 view = camera.GetViewMatrix();
-
-        ourShader.setMat4("projection", projection);
-        ourShader.setMat4("view", view);
-
-        ourShader.setVec3("dirLight.direction",-0.2f, 0.0f, -0.3f);
-        ourShader.setVec3("dirLight.ambient", 0.25f, 0.25f, 0.1f);
-        ourShader.setVec3("dirLight.diffuse", 0.2f, 0.2f, 0.7f);
-        ourShader.setVec3("dirLight.specular", 1.0f, 1.0f, 1.0f);
-
-        pointLight.position=glm::vec3(4.0*cos(currentFrame),2.0f*sin(currentFrame)+2.0,4.0*sin(currentFrame));
-        ourShader.setVec3("pointLight.position",pointLight.position);
-        ourShader.setVec3("pointLight.ambient", pointLight.ambient);
-        ourShader.setVec3("pointLight.diffuse",pointLight.diffuse);
-        ourShader.setVec3("pointLight.specular",pointLight.specular);
-        ourShader.setFloat("material.shininess",64.0f);
-        ourShader.setFloat("pointLight.constant",pointLight.constant);
-        ourShader.setFloat("pointLight.linear",pointLight.linear);
-        ourShader.setFloat("pointLight.quadratic",pointLight.quadratic);
-
-        ourShader.setVec3("viewPosition",camera.Position);
-
-        ourShader.setVec3("spotLight.position",spotlight.position);
-        ourShader.setVec3("spotLight.direction", spotlight.direction);
-        ourShader.setVec3("spotLight.ambient", glm::vec3(0.2f*sin(glfwGetTime()*5.0f), 0.5f*sin(glfwGetTime()*2.0f), 0.2f));
-        ourShader.setVec3("spotLight.diffuse", glm::vec3(0.2f*sin(glfwGetTime()*5.0f), 0.5f*sin(glfwGetTime()*2.0f), 0.2f));
-        ourShader.setVec3("spotLight.specular", glm::vec3(0.2f*sin(glfwGetTime()*5.0f), 0.5f*sin(glfwGetTime()*2.0f), 0.2f));
-        ourShader.setFloat("spotLight.constant", spotlight.constant);
-        ourShader.setFloat("spotLight.linear", spotlight.linear);
-        ourShader.setFloat("spotLight.quadratic", spotlight.quadratic);
-        ourShader.setFloat("spotLight.cutOff", spotlight.cutOff);
-        ourShader.setFloat("spotLight.outerCutOff",spotlight.outerCutOff);
-        ourShader.setFloat("spotLight.ind",spotlight.ind);
-
-        //tree
-
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model,glm::vec3(glm::vec3(0.0f,-1.0f,0.0f)));
-        model = glm::rotate(model,glm::radians(-90.0f),glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::scale(model,glm::vec3(0.05f,0.05f,0.05f));
-        ourShader.setMat4("model", model);
-        treeModel.Draw(ourShader);
-
-        //slad
-
-        ourShader.setInt("material.texture_diffuse1",12);
-        glActiveTexture(GL_TEXTURE12);
-        glBindTexture(GL_TEXTURE_2D,slad);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, -glm::vec3(0.0f + sin(glfwGetTime()) * 5.0f, 1.5f,
-                                                     0.0f + cos(glfwGetTime()) * 5.0f));
-        model = glm::rotate(model, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-        model = glm::rotate(model, (float) glfwGetTime(), glm::vec3(0.0f, 0.0f, 1.0f));
-        model = glm::scale(model,glm::vec3(0.015f,0.015f,0.015f));
-        ourShader.setMat4("model", model);
-        sladModel.Draw(ourShader);
-
-        //star
-
-        ourShader.setInt("material.texture_diffuse1",13);
-        glActiveTexture(GL_TEXTURE13);
-        glBindTexture(GL_TEXTURE_2D,star);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model,glm::vec3(-0.05f,7.5f,0.0f));
-        model = glm::rotate(model,glm::radians(-90.0f),glm::vec3(-1.0f, 0.0f, 0.0f));
-        model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
-        ourShader.setMat4("model", model);
-        starModel.Draw(ourShader);
-
-        //clock
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model,glm::vec3(7.8f,6.0f,-2.0f));
-        model = glm::rotate(model,glm::radians(-90.0f),glm::vec3(0.0f, 1.0f, .0f));
-        model = glm::scale(model, glm::vec3(0.045f, 0.045f, 0.045f));
-        ourShader.setMat4("model", model);
-        clockModel.Draw(ourShader);
-
-        //santa
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model,glm::vec3(-4.5f,-1.5f,-5.0f));
-        model = glm::rotate(model,glm::radians(-90.0f),glm::vec3(1.0f,0.0f,0.0f));
-        model = glm::scale(model, glm::vec3(0.03f, 0.03f, 0.03f));
-        ourShader.setMat4("model", model);
-        mrazModel.Draw(ourShader);
-
-        glBindVertexArray(transparentVAO);
-
-        windowShader.use();
-
-        projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        view = camera.GetViewMatrix();
-        windowShader.setMat4("projection", projection);
-        windowShader.setMat4("view", view);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model,glm::vec3(-7.965f,6.5f,-10.0f));
-        model = glm::scale(model, glm::vec3(0.103f, 0.1187f, 0.1f));
-        model = scale(model,glm::vec3(155.0f,135.0f,160.0f));
-        windowShader.setMat4("model", model);
-
-        glActiveTexture(GL_TEXTURE11);
-        glBindTexture(GL_TEXTURE_2D, window1);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        const glm::mat4& projection = frame.projection;
+        const glm::mat4& view = frame.view;
+
+        frameStream.BeginFrame();
+        rg::textureDecoder().Poll();
+        rg::textureUploadQueue().Process();
+        GLintptr frameDataOffset = 0;
+        FrameData* frameData = (FrameData*)frameStream.AllocateUniform(sizeof(FrameData), frameDataOffset);
+        if (frameData) {
+            frameData->projection = projection;
+            frameData->view = view;
+            frameData->viewPosition = glm::vec4(frame.viewPosition, 1.0f);
+            frameData->pointLightPosition = glm::vec4(frame.pointLightPosition, 1.0f);
+            frameData->spotLightColor = glm::vec4(0.2f*sin(frame.time*5.0), 0.5f*sin(frame.time*2.0), 0.2f, frame.spotLightOn);
+        }
+        frameStream.Commit();
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, frameStream.Buffer(), frameDataOffset, sizeof(FrameData));
+
+        // only nodes inside the models that were moved are recomputed
+        for (unsigned int i = 0; i < opaqueModelCount; i++)
+            opaqueModels[i]->UpdateTransforms();
+        opaqueMatrices[1] = frame.sledModel;
+
+        // the boxes inside the view, in the frame arena, are what both box passes draw
+        glm::mat4 viewProjection = projection * view;
+        const std::vector<rg::RenderInstance>& boxes = frame.boxes;
+        rg::FrameVector<unsigned int> visibleBoxes;
+        visibleBoxes.reserve(boxes.size());
+        const glm::vec3 boxMin(-0.5f), boxMax(0.5f);
+        for (size_t i = 0; i < boxes.size(); i++) {
+            glm::vec4 planes[6];
+            unsigned char visible;
+            extractFrustumPlanes(viewProjection * boxes[i].model, planes);
+            if (cullMeshBounds(&boxMin, &boxMax, 1, planes, &visible))
+                visibleBoxes.push_back((unsigned int)i);
+        }
 
-        roomShader.use();
-        roomShader.setVec3("viewPos",camera.Position);
-        roomShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        roomShader.setVec3("dirLight.ambient", 0.25f, 0.25f, 0.2f);
-        roomShader.setVec3("dirLight.diffuse", 0.2f, 0.2f, 0.7f);
-        roomShader.setVec3("dirLight.specular", 0.7f, 0.7f, 0.7f);
-
-        roomShader.setVec3("pointLight.position",pointLight.position);
-        roomShader.setVec3("pointLight.ambient", pointLight.ambient);
-        roomShader.setVec3("pointLight.diffuse",pointLight.diffuse);
-        roomShader.setVec3("pointLight.specular",pointLight.specular);
-
-        roomShader.setFloat("pointLight.constant",pointLight.constant);
-        roomShader.setFloat("pointLight.linear",pointLight.linear);
-        roomShader.setFloat("pointLight.quadratic",pointLight.quadratic);
-
-        roomShader.setVec3("spotLight.position",spotlight.position);
-        roomShader.setVec3("spotLight.direction", spotlight.direction);
-        roomShader.setVec3("spotLight.ambient", glm::vec3(0.2f*sin(glfwGetTime()*5.0f), 0.5f*sin(glfwGetTime()*2.0f), 0.2f));
-        roomShader.setVec3("spotLight.diffuse", glm::vec3(0.2f*sin(glfwGetTime()*5.0f), 0.5f*sin(glfwGetTime()*2.0f), 0.2f));
-        roomShader.setVec3("spotLight.specular", spotlight.specular);
-        roomShader.setFloat("spotLight.constant", spotlight.constant);
-        roomShader.setFloat("spotLight.linear", spotlight.linear);
-        roomShader.setFloat("spotLight.quadratic", spotlight.quadratic);
-        roomShader.setFloat("spotLight.cutOff", spotlight.cutOff);
-        roomShader.setFloat("spotLight.outerCutOff", spotlight.outerCutOff);
-        roomShader.setFloat("spotLight.ind",spotlight.ind);
-
-        projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        roomShader.setMat4("projection", projection);
-        view=camera.GetViewMatrix();
-        roomShader.setMat4("view", view);
-
-        model = glm::mat4(1.0f);
-        model=glm::translate(model,glm::vec3(0.0f,6.5f,-2.0f));
-        model=glm::scale(model,glm::vec3(16.0f));
-        roomShader.setMat4("model", model);
-
-        glBindVertexArray(roomVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 18);
-
-        boxShader.use();
-
-        boxShader.setVec3("pointLight.position", pointLight.position);
-        boxShader.setVec3("pointLight.ambient", pointLight.ambient);
-        boxShader.setVec3("pointLight.diffuse",pointLight.diffuse);
-        boxShader.setVec3("pointLight.specular",pointLight.specular);
-        boxShader.setVec3("viewPos",camera.Position);
-
-        boxShader.setFloat("pointLight.constant",pointLight.constant);
-        boxShader.setFloat("pointLight.linear",pointLight.linear);
-        boxShader.setFloat("pointLight.quadratic",pointLight.quadratic);
-
-        boxShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-        boxShader.setVec3("dirLight.ambient", 0.05f, 0.05f, 0.1f);
-        boxShader.setVec3("dirLight.diffuse", 0.2f, 0.2f, 0.7f);
-        boxShader.setVec3("dirLight.specular", 0.7f, 0.7f, 0.7f);
-
-        boxShader.setVec3("spotLight.position", spotlight.position);
-        boxShader.setVec3("spotLight.direction", spotlight.direction);
-        boxShader.setVec3("spotLight.ambient", spotlight.ambient);
-        boxShader.setVec3("spotLight.diffuse", spotlight.diffuse);
-        boxShader.setVec3("spotLight.specular", spotlight.specular);
-        boxShader.setFloat("spotLight.constant", spotlight.constant);
-        boxShader.setFloat("spotLight.linear", spotlight.linear);
-        boxShader.setFloat("spotLight.quadratic", spotlight.quadratic);
-        boxShader.setFloat("spotLight.cutOff", spotlight.cutOff);
-        boxShader.setFloat("spotLight.outerCutOff", spotlight.outerCutOff);
-        boxShader.setFloat("spotLight.ind",spotlight.ind);
-        glBindVertexArray(VAO);
-
-        projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-        boxShader.setMat4("projection", projection);
-        view = camera.GetViewMatrix();
-        boxShader.setMat4("view", view);
-
-        for (unsigned int i = 0; i < 9; i++)
-        {
-            int n = i%3+1;
-            std::string name = "ng";
-            name.append(to_string(n));
 
-            boxShader.setInt("material.texture_diffuse1", 14);
-            boxShader.setInt("material.texture_specular1", 15);
+        // mip levels the models need at their current distance, streamed in before they are drawn
+        float pixelsPerUnit = projection[1][1] * SCR_HEIGHT * 0.5f;
+        rg::textureStreamer().BeginFrame();
+        for (unsigned int i = 0; i < opaqueModelCount; i++)
+            opaqueModels[i]->RequestTextureDetail(opaqueMatrices[i], frame.viewPosition, pixelsPerUnit);
+        rg::textureStreamer().Update();
 
-            if(name == "ng1") {
+        auto opaqueSubmitStart = std::chrono::steady_clock::now();
 
-                glActiveTexture(GL_TEXTURE14);
-                glBindTexture(GL_TEXTURE_2D,ng1);
-                glActiveTexture(GL_TEXTURE15);
-                glBindTexture(GL_TEXTURE_2D,c1spec);
+        // meshes outside the view are skipped by the shading pass of their model
+        for (unsigned int i = 0; i < opaqueModelCount; i++)
+            opaqueModels[i]->Cull(viewProjection * opaqueMatrices[i]);
 
+        // every mesh is an occluder of its own, a sphere around the whole static scene would cover the screen
+        depthPrepass.Mode = frame.depthPrepassMode;
+        depthPrepass.BeginFrame(projection, view, SCR_WIDTH, SCR_HEIGHT);
+        for (unsigned int i = 0; i < opaqueModelCount; i++) {
+            const MeshArrays& meshes = opaqueModels[i]->meshes;
+            for (size_t m = 0; m < meshes.Size(); m++)
+                depthPrepass.AddOccluder(opaqueMatrices[i], meshes.boundsMin[m], meshes.boundsMax[m], meshes.triangleCount[m]);
+        }
+        for (const rg::RenderInstance& box : boxes)
+            depthPrepass.AddOccluder(box.model, glm::vec3(-0.5f), glm::vec3(0.5f), 12);
+
+        bool depthPass = depthPrepass.Decide();
+
+        // one draw per box in the depth pass and per light cube, recorded in partitions of
+        // COMMAND_PARTITION objects on the worker pool and replayed below in order
+        auto recordStart = std::chrono::steady_clock::now();
+        rg::recordCommands(rg::workerPool(), depthPass ? visibleBoxes.size() : 0, COMMAND_PARTITION, boxDepthCommands,
+                           [&](rg::CommandBuffer& commands, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                commands.SetMat4(depthModelLocation, boxes[visibleBoxes[i]].model);
+                commands.Draw(boxDepthGeometry);
             }
-
-            if(name == "ng2") {
-
-                glActiveTexture(GL_TEXTURE14);
-                glBindTexture(GL_TEXTURE_2D,ng2);
-                glActiveTexture(GL_TEXTURE15);
-                glBindTexture(GL_TEXTURE_2D,c2spec);
-
+        });
+        // the spot light (malo svetlo) pulses and goes dark when switched off
+        glm::vec3 spotPulse = glm::vec3(sin(frame.time*5.0), sin(frame.time*2.0), 1.0f) * frame.spotLightOn;
+        rg::recordCommands(rg::workerPool(), frame.lights.size(), COMMAND_PARTITION, lightCubeCommands,
+                           [&](rg::CommandBuffer& commands, size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                const FrameSnapshot::Light& light = frame.lights[i];
+                commands.SetMat4(lightCubeModelLocation, light.model);
+                commands.SetVec3(lightCubeColorLocation, light.type == rg::LightType::Spot ? light.color * spotPulse : light.color);
+                commands.Draw(lightCubeGeometry);
             }
-
-            if(name == "ng3") {
-
-                glActiveTexture(GL_TEXTURE14);
-                glBindTexture(GL_TEXTURE_2D, ng3);
-                glActiveTexture(GL_TEXTURE15);
-                glBindTexture(GL_TEXTURE_2D,c3spec);
-
+        });
+        auto recordEnd = std::chrono::steady_clock::now();
+        commandRecordMilliseconds += std::chrono::duration<double, std::milli>(recordEnd - recordStart).count();
+        double replayMilliseconds = 0.0;
+
+        if (depthPass) {
+            depthPrepass.BeginDepthPass();
+            rg::glState().ColorMask(GL_FALSE);
+            depthShader.use();
+            for (unsigned int i = 0; i < opaqueModelCount; i++) {
+                opaqueModels[i]->DrawDepth(depthShader, opaqueMatrices[i]);
             }
-
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            model = glm::rotate(model,angle,glm::vec3(0.0f,1.0f,0.0f));
-            boxShader.setMat4("model", model);
-
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            auto replayStart = std::chrono::steady_clock::now();
+            rg::replayCommands(boxDepthCommands, arena);
+            replayMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - replayStart).count();
+            rg::glState().ColorMask(GL_TRUE);
+            depthPrepass.EndDepthPass();
         }
+        depthPrepass.BeginShadingPass();
 
-        for (unsigned int i = 10; i < 15; i++) {
-
-            int n = i%3+1;
-            std::string name = "ng";
-            name.append(to_string(n));
+        ourShader.use();
 
-            boxShader.setInt("material.texture_diffuse1", 14);
-            boxShader.setInt("material.texture_specular1", 15);
+        //tree, star, clock and santa
 
-            if(name == "ng1") {
+        staticModel.Draw(ourShader, opaqueMatrices[0]);
 
-                glActiveTexture(GL_TEXTURE14);
-                glBindTexture(GL_TEXTURE_2D,ng1);
-                glActiveTexture(GL_TEXTURE15);
-                glBindTexture(GL_TEXTURE_2D,c1spec);
+        //slad
 
+        ourShader.setInt("material.texture_diffuse1",12);
+        rg::glState().BindTexture(12, GL_TEXTURE_2D, slad);
+        sladModel.Draw(ourShader, opaqueMatrices[1]);
+
+        opaqueSubmitMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - opaqueSubmitStart).count();
+        frameCount++;
+
+        // the visible boxes are drawn instanced per material set, as many per call as the BoxInstances
+        // block holds; each reads its matrix and material layers by gl_InstanceID
+        if (!visibleBoxes.empty() && boxesPerDraw > 0) {
+            boxShader.use();
+            for (unsigned int set = 0; set < BOX_MATERIAL_SETS; set++) {
+                rg::glState().BindTexture(14, GL_TEXTURE_2D_ARRAY, boxDiffuse[set].Id());
+                rg::glState().BindTexture(15, GL_TEXTURE_2D_ARRAY, boxSpecular[set].Id());
+                size_t next = 0;
+                while (true) {
+                    while (next < visibleBoxes.size() && (unsigned int)boxes[visibleBoxes[next]].material.z != set)
+                        next++;
+                    if (next == visibleBoxes.size())
+                        break;
+                    GLintptr boxInstancesOffset = 0;
+                    BoxInstance* boxInstances = (BoxInstance*)frameStream.AllocateUniform(boxInstancesSize, boxInstancesOffset);
+                    if (!boxInstances)
+                        break;
+                    size_t count = 0;
+                    for (; next < visibleBoxes.size() && count < boxesPerDraw; next++) {
+                        const rg::RenderInstance& box = boxes[visibleBoxes[next]];
+                        if ((unsigned int)box.material.z != set)
+                            continue;
+                        boxInstances[count].model = box.model;
+                        boxInstances[count].normalMatrix = box.normal;
+                        boxInstances[count].material = box.material;
+                        boxInstances[count].texScale = glm::vec4(boxDiffuse[set].LayerScale((int)box.material.x),
+                                                                 boxSpecular[set].LayerScale((int)box.material.y));
+                        count++;
+                    }
+                    frameStream.Commit();
+                    glBindBufferRange(GL_UNIFORM_BUFFER, BOX_INSTANCES_BINDING, frameStream.Buffer(), boxInstancesOffset, boxInstancesSize);
+                    arena.DrawInstanced(boxGeometry, (GLsizei)count);
+                }
             }
+        }
 
-            if(name == "ng2") {
+        depthPrepass.EndShadingPass();
 
-                glActiveTexture(GL_TEXTURE14);
-                glBindTexture(GL_TEXTURE_2D,ng2);
-                glActiveTexture(GL_TEXTURE15);
-                glBindTexture(GL_TEXTURE_2D,c2spec);
+        windowShader.use();
 
-            }
+        windowShader.setMat4("model", frame.windowModel);
 
-            if(name == "ng3") {
+        rg::glState().BindTexture(11, GL_TEXTURE_2D, window1);
+        arena.Draw(windowGeometry);
 
-                glActiveTexture(GL_TEXTURE14);
-                glBindTexture(GL_TEXTURE_2D, ng3);
-                glActiveTexture(GL_TEXTURE15);
-                glBindTexture(GL_TEXTURE_2D,c3spec);
+        roomShader.use();
 
-            }
+        roomShader.setMat4("model", frame.roomModel);
 
-            glm::mat4 model = glm::mat4(1.0f);
-            model = glm::translate(model, cubePositions[i]);
-            float angle = 20.0f * i;
-            model = glm::scale(model, glm::vec3(0.5, 0.3, 0.5));
-            model = glm::rotate(model,angle,glm::vec3(0.0f,1.0f,0.0f));
-            boxShader.setMat4("model", model);
+        arena.Draw(roomGeometry);
 
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+        rg::glState().DepthFunc(GL_LEQUAL);
+        skyBoxShader.use();
+        rg::glState().BindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        arena.Draw(skyboxGeometry);
+        rg::glState().DepthFunc(GL_LESS);
+
+        // a small cube at every light
+        lightCube.use();
+        auto replayStart = std::chrono::steady_clock::now();
+        rg::replayCommands(lightCubeCommands, arena);
+        replayMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - replayStart).count();
+        commandReplayMilliseconds += replayMilliseconds;
+
+        if (frame.showStreamingOverlay) {
+            ImGui_ImplOpenGL3_NewFrame();
+            if (renderThreaded) {
+                ImGuiIO& io = ImGui::GetIO();
+                io.DisplaySize = ImVec2((float)frame.windowWidth, (float)frame.windowHeight);
+                if (frame.windowWidth > 0 && frame.windowHeight > 0)
+                    io.DisplayFramebufferScale = ImVec2((float)frame.framebufferWidth / frame.windowWidth,
+                                                        (float)frame.framebufferHeight / frame.windowHeight);
+                io.DeltaTime = std::max(frame.deltaTime, 0.0001f);
+            } else {
+                ImGui_ImplGlfw_NewFrame();
+            }
+            ImGui::NewFrame();
+            rg::textureStreamer().DrawOverlay();
+            depthPrepass.DrawOverlay();
+            ImGui::Render();
+            // the backend restores every binding it touches, so the state cache stays valid
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
         }
 
-        //base
+        frameStream.EndFrame();
+        rg::glState().EndFrame();
+
+        // textures still on their way arrive over the next frames, which are drawn for them on demand
+        // too; the simulation thread may be waiting for events and is woken up
+        bool assetsArriving = rg::textureDecoder().Pending() > 0 || !rg::textureUploadQueue().Idle() ||
+                              rg::textureStreamer().LastFrameBytes() > 0;
+        if (assetsArriving) {
+            redrawTracker.Invalidate(rg::RedrawAssets);
+            if (renderThreaded && redrawTracker.OnDemand)
+                glfwPostEmptyEvent();
+        }
 
-        boxShader.setInt("material.texture_diffuse1", 16);
-        glActiveTexture(GL_TEXTURE16);
-        glBindTexture(GL_TEXTURE_2D,base);
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, cubePositions[9]);
-        model = glm::scale(model, glm::vec3(1.5f, 0.5f, 1.5f));
-        boxShader.setMat4("model", model);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        // past the warm-up and with no texture data in flight the thread that draws gets through a frame
+        // without the heap, temporaries go to the frame arena; only builds configured with
+        // RG_CHECK_FRAME_ALLOCATIONS count, and they only report it. The count is that
+        // thread's own: the snapshot copies of the simulation thread and whatever tasks allocate on the
+        // workers are not part of it, a range a parallelFor splits onto the pool from here is
+        bool steadyState = frameCount > ALLOCATION_CHECK_WARMUP && !assetsArriving;
+        unsigned long long frameAllocations = heapAllocationCount() - allocationsBefore;
+        if (steadyState && frameAllocations > 0) {
+            std::cout << "ERROR::FRAME_ARENA::HEAP_ALLOCATIONS_ON_RENDER_THREAD " << frameAllocations << std::endl;
+        }
+    };
 
+    // render loop
 
-        glDepthFunc(GL_LEQUAL);
-        skyBoxShader.use();
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix()));
-        skyBoxShader.setMat4("view", view);
-        skyBoxShader.setMat4("projection", projection);
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS);
+    // With the render thread this thread only handles events, samples input and steps the scene, and
+    // the render thread, which owns the GL context from here on, draws the newest snapshot it finds.
+    // A window being moved or resized no longer holds up drawing, and input is sampled as soon as it
+    // arrives rather than once per frame.
+    rg::FrameTiming frameTiming;
+    if (renderThreaded) {
+        rg::FrameMailbox<FrameSnapshot> frames;
+        std::atomic<bool> rendering(true);
+        glfwMakeContextCurrent(NULL);
+        std::thread renderThread([&] {
+            glfwMakeContextCurrent(window);
+            while (rendering) {
+                // the newest snapshot once the pacer lets the frame start, so it carries the latest input
+                framePacer.BeginFrame();
+                framePacer.WaitForFrame();
+                while (rendering) {
+                    unsigned long long seen = redrawTracker.Publishes();
+                    if (frames.Acquire())
+                        break;
+                    redrawTracker.WaitForPublish(seen, std::chrono::milliseconds(100));
+                }
+                if (!rendering)
+                    break;
+                renderFrame(frames.Front());
+                glfwSwapBuffers(window);
+                framePacer.EndFrame();
+                frameTiming.Presented(frames.Front().inputTime);
+            }
+            glfwMakeContextCurrent(NULL);
+        });
+
+        redrawTracker.Start();
+        while (!glfwWindowShouldClose(window)) {
+            simulate(frames.Back());
+            if (shouldDraw(frames.Back())) {
+                frames.Publish();
+                redrawTracker.NotifyPublished();
+            }
+            // wakes up as soon as there is input, at the latest after one simulation step, or on
+            // demand with nothing to draw when the tracker wants to look again
+            glfwWaitEventsTimeout(redrawTracker.WaitSeconds(SIMULATION_STEP));
+        }
 
-        lightCube.use();
-        lightCube.setMat4("projection", projection);
-        view=camera.GetViewMatrix();
-        lightCube.setMat4("view", view);
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, pointLight.position);
-        model = glm::scale(model, glm::vec3(0.6f)); // Make it a smaller cube
-        lightCube.setMat4("model", model);
-        lightCube.setVec3("color", glm::vec3(1.0f));
-        glBindVertexArray(cubeVAO);
-        glDrawElements(GL_TRIANGLES,36,GL_UNSIGNED_INT,0);
-
-        //malo svetlo
-
-        model = glm::mat4(1.0f);
-        model = glm::translate(model, spotlight.position);
-        model = glm::rotate(model,glm::radians(45.0f),glm::vec3(1.0,0.0,0.0));
-        model = glm::rotate(model,glm::radians(45.0f),glm::vec3(0.0,1.0,0.0));
-        model = glm::scale(model, glm::vec3(0.4f)); // Make it a smaller cube
-        lightCube.setMat4("model", model);
-        lightCube.setVec3("color", glm::vec3(0.2f*sin(glfwGetTime()*5.0f), 0.5f*sin(glfwGetTime()*2.0f), 0.2f)*ind);
-        glBindVertexArray(cubeVAO);
-        glDrawElements(GL_TRIANGLES,36,GL_UNSIGNED_INT,0);
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        rendering = false;
+        // wakes the render thread up to see it is done
+        redrawTracker.NotifyPublished();
+        renderThread.join();
+        glfwMakeContextCurrent(window);
+        std::cout << "RENDER_THREAD:: " << frames.Published() << " snapshots, " << frames.Dropped()
+                  << " replaced by a newer one before they were drawn" << std::endl;
+    } else {
+        FrameSnapshot frame;
+        redrawTracker.Start();
+        while (!glfwWindowShouldClose(window)) {
+            // on demand with nothing to draw the loop sleeps here until there are events
+            double wait = redrawTracker.WaitSeconds(0.0);
+            if (wait > 0.0)
+                glfwWaitEventsTimeout(wait);
+
+            // IO events (keys pressed/released, mouse moved etc.) are polled once the pacer lets the
+            // frame start, right before they are simulated and drawn
+            framePacer.BeginFrame();
+            framePacer.WaitForFrame();
+            glfwPollEvents();
+            simulate(frame);
+            if (!shouldDraw(frame))
+                continue;
+            renderFrame(frame);
+
+            // glfw: swap buffers
+            glfwSwapBuffers(window);
+            framePacer.EndFrame();
+            frameTiming.Presented(frame.inputTime);
+        }
     }
+    frameTiming.Print(std::cout, renderThreaded ? "render thread" : "single thread");
+    framePacer.PrintStats(std::cout);
+    redrawTracker.Print(std::cout);
+
+    rg::glState().PrintStats(std::cout);
+    depthPrepass.PrintStats(std::cout);
+    staticBatch.PrintStats(std::cout);
+    if (frameCount > 0)
+        std::cout << "STATIC_BATCH:: culling and submitting the opaque models took " << opaqueSubmitMilliseconds * 1000.0 / frameCount
+                  << " us of CPU time per frame" << std::endl;
+    if (frameCount > 0)
+        std::cout << "COMMAND_BUFFER:: per-object draws recorded in " << commandRecordMilliseconds * 1000.0 / frameCount
+                  << " us and replayed in " << commandReplayMilliseconds * 1000.0 / frameCount << " us per frame" << std::endl;
+    std::cout << "FRAME_ARENA:: " << rg::frameArena().HighWater() / 1024 << " KB at most per frame, "
+              << rg::frameArena().Capacity() / 1024 << " KB reserved, grown " << rg::frameArena().Overflows()
+              << " times" << std::endl;
+    std::cout << "WORKER_POOL:: " << rg::workerPool().ThreadCount() << " workers (" << rg::workerPool().PinnedCount()
+              << " pinned) ran " << rg::workerPool().Executed() << " tasks, " << rg::workerPool().Stolen()
+              << " of them stolen" << std::endl;
 
     // optional: de-allocate all resources once they've outlived their purpose:
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteVertexArrays(1,&transparentVAO);
-    glDeleteVertexArrays(1,&cubeVAO);
-    glDeleteVertexArrays(1,&roomVAO);
-    glDeleteVertexArrays(1,&skyboxVAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1,&transparentVBO);
-    glDeleteBuffers(1,&cubeVBO);
-    glDeleteBuffers(1,&roomVBO);
-    glDeleteBuffers(1,&skyboxVBO);
+    frameStream.Release();
+    framePacer.Release();
+    depthPrepass.Release();
+    rg::textureUploadQueue().Release();
+    rg::textureStreamer().Release();
+    for (unsigned int set = 0; set < BOX_MATERIAL_SETS; set++) {
+        boxDiffuse[set].Release();
+        boxSpecular[set].Release();
+    }
+    staticModel.Release();
+    sladModel.Release();
+    arena.Release();
+
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui_ImplGlfw_Shutdown();
+    ImGui::DestroyContext();
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     glfwTerminate();
@@ -806,47 +1319,67 @@ void processInput(GLFWwindow *window) {
     if(glfwGetKey(window,GLFW_KEY_2)==GLFW_PRESS){
         ind=1.0f;
     }
+
+    // depth pre-pass: 3 off, 4 always on, 5 decided per frame
+    if(glfwGetKey(window,GLFW_KEY_3)==GLFW_PRESS){
+        depthPrepassMode=rg::DepthPrepassMode::Off;
+    }
+    if(glfwGetKey(window,GLFW_KEY_4)==GLFW_PRESS){
+        depthPrepassMode=rg::DepthPrepassMode::On;
+    }
+    if(glfwGetKey(window,GLFW_KEY_5)==GLFW_PRESS){
+        depthPrepassMode=rg::DepthPrepassMode::Auto;
+    }
+
+    // toggles once per press, not every frame the key is held
+    static bool f1WasPressed = false;
+    bool f1Pressed = glfwGetKey(window,GLFW_KEY_F1)==GLFW_PRESS;
+    if(f1Pressed && !f1WasPressed){
+        showStreamingOverlay=!showStreamingOverlay;
+    }
+    f1WasPressed = f1Pressed;
+
+    static bool pWasPressed = false;
+    bool pPressed = glfwGetKey(window,GLFW_KEY_P)==GLFW_PRESS;
+    if(pPressed && !pWasPressed){
+        animationsPlaying=!animationsPlaying;
+    }
+    pWasPressed = pPressed;
 }
 
-// glfw: whenever the window size changed (by OS or user resize) this callback function executes
+// glfw: whenever the window size changed (by OS or user resize) this callback function executes;
+// it runs on the main thread, which may not own the context, so the renderer applies the viewport
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    framebufferWidth = width;
+    framebufferHeight = height;
 }
 
-unsigned int loadTexture(char const * path)
+unsigned int loadTexture(char const * path, rg::TextureUsage usage)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
 
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
+    // the cooked version is already block compressed and carries its mip chain
+    if (rg::loadCookedTexture(path, GL_TEXTURE_2D, GL_TEXTURE_2D, textureID))
     {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
+        return textureID;
     }
-    else
+
+    // decoded and mipmapped on a worker, the levels arrive over the next frames within the upload budget
+    rg::textureDecoder().Decode(textureID, path, usage, [](GLuint texture, rg::DecodedTexture &decoded)
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
+        rg::textureUploadQueue().Enqueue(texture, decoded.format, std::move(decoded.levels));
+    });
+    rg::glState().BindTexture(0, GL_TEXTURE_2D, textureID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     return textureID;
 }
@@ -873,15 +1406,32 @@ void scroll_callback(GLFWwindow *window, double xoffset, double yoffset) {
     camera.ProcessMouseScroll(yoffset);
 }
 
+// glfw: the window was uncovered or otherwise damaged, what was presented last may be gone
+void window_refresh_callback(GLFWwindow *window) {
+    redrawTracker.Invalidate(rg::RedrawWindow);
+}
+
+void window_focus_callback(GLFWwindow *window, int focused) {
+    if (focused)
+        redrawTracker.Invalidate(rg::RedrawWindow);
+}
+
+void window_iconify_callback(GLFWwindow *window, int iconified) {
+    if (!iconified)
+        redrawTracker.Invalidate(rg::RedrawWindow);
+}
+
 unsigned int loadCubemap(vector<std::string> faces)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+    rg::glState().BindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
 
     int width, height, nrChannels;
     for (unsigned int i = 0; i < faces.size(); i++)
     {
+        if (rg::loadCookedTexture(faces[i], GL_TEXTURE_CUBE_MAP, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, textureID))
+            continue;
         unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
         if (data)
         {
@@ -901,4 +1451,46 @@ unsigned int loadCubemap(vector<std::string> faces)
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
     return textureID;
-}
\ No newline at end of file
+}
+// points the FrameData uniform block of a program at the binding the frame stream is bound to
+void bindFrameDataBlock(const Shader& shader)
+{
+    unsigned int blockIndex = glGetUniformBlockIndex(shader.ID, "FrameData");
+    if (blockIndex != GL_INVALID_INDEX)
+        glUniformBlockBinding(shader.ID, blockIndex, FRAME_DATA_BINDING);
+}
+
+#ifdef RG_CHECK_FRAME_ALLOCATIONS
+// With the RG_CHECK_FRAME_ALLOCATIONS option the heap allocations of every thread are counted through
+// operator new, each thread its own, the thread that draws checks that its steady-state frames make none. Both are kept out of line, GCC takes a malloc or free inlined
+// into the caller for one that does not match the new or delete.
+thread_local unsigned long long heapAllocations = 0;
+
+__attribute__((noinline)) void* operator new(std::size_t size)
+{
+    heapAllocations++;
+    if (void* memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, std::size_t) noexcept
+{
+    std::free(memory);
+}
+#endif
+
+// allocations the calling thread made so far, always 0 unless RG_CHECK_FRAME_ALLOCATIONS is set
+unsigned long long heapAllocationCount()
+{
+#ifdef RG_CHECK_FRAME_ALLOCATIONS
+    return heapAllocations;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,203 @@
+// Offline texture cooker: transcodes every image under the given directories into a block compressed
+// .rgtx file with its full mip chain (see rg/CookedTexture.h), which the loaders upload with
+// glCompressedTexImage2D instead of decoding and mipmapping the JPEG/PNG at startup.
+//
+//   texture_cooker [--force] <directory>...
+//
+// A file is only recooked when the hash of its source image differs from the one stored in the
+// existing .rgtx, so rerunning the cook_textures target after editing one image is cheap.
+
+#include <stb_image.h>
+#include <rg/BlockCompression.h>
+#include <rg/CookedTexture.h>
+#include <rg/MipChain.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+    struct CookStats {
+        unsigned int cooked = 0;
+        unsigned int upToDate = 0;
+        unsigned int failed = 0;
+        unsigned long long uncompressedBytes = 0;
+        unsigned long long cookedBytes = 0;
+    };
+
+    std::string toLower(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        return text;
+    }
+
+    bool endsWith(const std::string &text, const std::string &suffix) {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    bool isSourceImage(const std::string &path) {
+        std::string lower = toLower(path);
+        return endsWith(lower, ".jpg") || endsWith(lower, ".jpeg") || endsWith(lower, ".png");
+    }
+
+    void findImages(const std::string &directory, std::vector<std::string> &images) {
+        DIR *dir = opendir(directory.c_str());
+        if (!dir) {
+            std::cout << "ERROR::TEXTURE_COOKER::CANNOT_OPEN " << directory << std::endl;
+            return;
+        }
+        while (dirent *entry = readdir(dir)) {
+            if (std::strcmp(entry->d_name, ".") == 0 || std::strcmp(entry->d_name, "..") == 0)
+                continue;
+            std::string path = directory + "/" + entry->d_name;
+            struct stat info;
+            if (stat(path.c_str(), &info) != 0)
+                continue;
+            if (S_ISDIR(info.st_mode))
+                findImages(path, images);
+            else if (isSourceImage(path))
+                images.push_back(path);
+        }
+        closedir(dir);
+    }
+
+    // picks the smallest format that keeps what the image actually contains; BC4 is only chosen for
+    // grey images, the loader swizzles it back to grey (applyCookedTextureSwizzle)
+    rg::BlockFormat chooseFormat(const std::string &path, const unsigned char *rgba, int width, int height, int components) {
+        bool opaque = true;
+        for (int i = 0; i < width * height && opaque; i++)
+            opaque = rgba[i * 4 + 3] == 255;
+
+        if (toLower(path).find("normal") != std::string::npos)
+            return rg::BlockFormat::BC5;
+        if (components <= 2 && opaque)
+            return rg::BlockFormat::BC4;
+        return opaque ? rg::BlockFormat::BC1 : rg::BlockFormat::BC3;
+    }
+
+    const char *formatName(rg::BlockFormat format) {
+        switch (format) {
+            case rg::BlockFormat::BC1: return "BC1";
+            case rg::BlockFormat::BC3: return "BC3";
+            case rg::BlockFormat::BC4: return "BC4";
+            case rg::BlockFormat::BC5: return "BC5";
+        }
+        return "?";
+    }
+
+    void cook(const std::string &source, bool force, CookStats &stats) {
+        std::string target = rg::cookedTexturePath(source);
+
+        uint64_t sourceSize = 0, sourceHash = 0;
+        int64_t sourceModified = 0;
+        if (!rg::cookedSourceStamp(source, sourceSize, sourceModified)) {
+            std::cout << "ERROR::TEXTURE_COOKER::CANNOT_READ " << source << std::endl;
+            stats.failed++;
+            return;
+        }
+        rg::CookedTexture existing;
+        bool existed = !force && rg::readCookedTexture(target, existing, true);
+        if (existed && rg::cookedStampMatches(existing, sourceSize, sourceModified)) {
+            stats.upToDate++;
+            return;
+        }
+        if (!rg::cookedSourceHash(source, sourceHash)) {
+            std::cout << "ERROR::TEXTURE_COOKER::CANNOT_READ " << source << std::endl;
+            stats.failed++;
+            return;
+        }
+        // an unchanged source that was only touched gets its stamp refreshed, so loads skip the hash
+        if (existed && existing.sourceHash == sourceHash) {
+            if (!rg::writeCookedSourceStamp(target, sourceSize, sourceModified)) {
+                std::cout << "ERROR::TEXTURE_COOKER::CANNOT_WRITE " << target << std::endl;
+                stats.failed++;
+                return;
+            }
+            stats.upToDate++;
+            return;
+        }
+
+        int width, height, components;
+        unsigned char *pixels = stbi_load(source.c_str(), &width, &height, &components, 4);
+        if (!pixels) {
+            std::cout << "ERROR::TEXTURE_COOKER::DECODE_FAILED " << source << ": " << stbi_failure_reason() << std::endl;
+            stats.failed++;
+            return;
+        }
+
+        rg::CookedTexture cooked;
+        cooked.format = chooseFormat(source, pixels, width, height, components);
+        cooked.sourceHash = sourceHash;
+        cooked.sourceSize = sourceSize;
+        cooked.sourceModified = sourceModified;
+
+        // colour formats are filtered in linear light, masks and normals as stored
+        bool srgb = cooked.format == rg::BlockFormat::BC1 || cooked.format == rg::BlockFormat::BC3;
+        std::vector<rg::MipLevel> chain = rg::buildMipChain(pixels, width, height, 4, srgb);
+        stbi_image_free(pixels);
+        unsigned long long cookedBytes = 0;
+        for (const rg::MipLevel &level : chain) {
+            rg::CookedLevel mip;
+            mip.width = (uint32_t)level.width;
+            mip.height = (uint32_t)level.height;
+            mip.data = rg::compressImage(cooked.format, level.data.data(), level.width, level.height);
+            cookedBytes += mip.data.size();
+            cooked.levels.push_back(std::move(mip));
+        }
+
+        if (!rg::writeCookedTexture(target, cooked)) {
+            std::cout << "ERROR::TEXTURE_COOKER::CANNOT_WRITE " << target << std::endl;
+            stats.failed++;
+            return;
+        }
+
+        // what the runtime would have allocated for the decoded image with glGenerateMipmap
+        unsigned long long uncompressed = (unsigned long long)width * height * (components == 4 ? 4 : components == 1 ? 1 : 3) * 4 / 3;
+        stats.cooked++;
+        stats.uncompressedBytes += uncompressed;
+        stats.cookedBytes += cookedBytes;
+        std::cout << formatName(cooked.format) << " " << width << "x" << height << " " << cooked.levels.size()
+                  << " levels " << uncompressed / 1024 << " KB -> " << cookedBytes / 1024 << " KB  " << source << std::endl;
+    }
+
+}
+
+int main(int argc, char **argv) {
+    bool force = false;
+    std::vector<std::string> directories;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--force") == 0)
+            force = true;
+        else
+            directories.push_back(argv[i]);
+    }
+    if (directories.empty()) {
+        std::cout << "usage: texture_cooker [--force] <directory>..." << std::endl;
+        return 1;
+    }
+
+    // same orientation as the runtime loaders
+    stbi_set_flip_vertically_on_load(false);
+
+    std::vector<std::string> images;
+    for (const std::string &directory : directories)
+        findImages(directory, images);
+    std::sort(images.begin(), images.end());
+
+    CookStats stats;
+    for (const std::string &image : images)
+        cook(image, force, stats);
+
+    std::cout << "TEXTURE_COOKER:: " << stats.cooked << " cooked, " << stats.upToDate << " up to date, "
+              << stats.failed << " failed";
+    if (stats.cooked > 0)
+        std::cout << " | " << stats.uncompressedBytes / 1024 << " KB -> " << stats.cookedBytes / 1024 << " KB of VRAM";
+    std::cout << std::endl;
+    return stats.failed == 0 ? 0 : 1;
+}